@@ -59,6 +59,7 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/utsname.h>
@@ -23,8 +23,24 @@
 #include "scanbd.h"
 #include <libgen.h>
 
+// the running config is published with a reference count: the main
+// thread installs it and reads cfg directly, all other threads take a
+// reference with cfg_acquire() for the time they read it. A replaced
+// config is freed with its last reference.
+struct cfg_retired {
+    cfg_t* cfg;
+    int refs;
+    struct cfg_retired* next;
+};
+static pthread_mutex_t cfg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int cfg_refs = 0;                         // the references to cfg
+static struct cfg_retired* cfg_retired = NULL;   // the replaced configs
+// still referenced (guarded by cfg_mutex)
+
 // parsing the config-file via libconfuse
-void cfg_do_parse(const char *config_file_name) {
+// returns the new config or NULL on errors, the running config isn't
+// touched
+cfg_t* cfg_parse_file(const char *config_file_name) {
     slog(SLOG_INFO, "reading config file %s", config_file_name);
 
     cfg_opt_t cfg_numtrigger[] = {
@@ -70,12 +86,25 @@ void cfg_do_parse(const char *config_file_name) {
         CFG_STR(C_SANED, C_SANED_DEF, CFGF_NONE),
         CFG_STR_LIST(C_SANED_OPTS, C_SANED_OPTS_DEF, CFGF_NONE),
         CFG_STR_LIST(C_SANED_ENVS, C_SANED_ENVS_DEF, CFGF_NONE),
+        CFG_INT(C_SANED_POOL, C_SANED_POOL_DEF, CFGF_NONE),
         CFG_STR(C_SCRIPTDIR, C_SCRIPTDIR_DEF, CFGF_NONE),
         CFG_STR(C_DEVICE_INSERT_SCRIPT, C_DEVICE_INSERT_SCRIPT_DEF, CFGF_NONE),
         CFG_STR(C_DEVICE_REMOVE_SCRIPT, C_DEVICE_REMOVE_SCRIPT_DEF, CFGF_NONE),
         CFG_STR(C_SCANBUTTONS_BACKENDS_DIR, C_SCANBUTTONS_BACKENDS_DIR_DEF, CFGF_NONE),
         CFG_INT(C_TIMEOUT, C_TIMEOUT_DEF, CFGF_NONE),
+        CFG_INT(C_TIMEOUT_MAX, C_TIMEOUT_MAX_DEF, CFGF_NONE),
+        CFG_INT(C_BURST_TIMEOUT, C_BURST_TIMEOUT_DEF, CFGF_NONE),
+        CFG_INT(C_BURST_DURATION, C_BURST_DURATION_DEF, CFGF_NONE),
+        CFG_INT(C_POLL_WORKERS, C_POLL_WORKERS_DEF, CFGF_NONE),
+        CFG_STR_LIST(C_USB_IDS, C_USB_IDS_DEF, CFGF_NONE),
+        CFG_INT(C_HOTPLUG_DEBOUNCE, C_HOTPLUG_DEBOUNCE_DEF, CFGF_NONE),
+        CFG_STR(C_DEVICE_CACHE, C_DEVICE_CACHE_DEF, CFGF_NONE),
+        CFG_STR(C_OPTION_CACHE, C_OPTION_CACHE_DEF, CFGF_NONE),
+        CFG_INT(C_ACTION_JOBS, C_ACTION_JOBS_DEF, CFGF_NONE),
+        CFG_INT(C_ACTION_BACKLOG, C_ACTION_BACKLOG_DEF, CFGF_NONE),
+        CFG_STR(C_ACTION_QUEUE, C_ACTION_QUEUE_DEF, CFGF_NONE),
         CFG_STR(C_PIDFILE, C_PIDFILE_DEF, CFGF_NONE),
+        CFG_STR(C_CONTROL_SOCKET, C_CONTROL_SOCKET_DEF, CFGF_NONE),
         CFG_SEC(C_ENVIRONMENT, cfg_environment, CFGF_NONE),
         CFG_SEC(C_FUNCTION, cfg_function, CFGF_MULTI | CFGF_TITLE),
         CFG_SEC(C_ACTION, cfg_action, CFGF_MULTI | CFGF_TITLE),
@@ -97,11 +126,6 @@ void cfg_do_parse(const char *config_file_name) {
         CFG_END()
     };
 
-    if (cfg) {
-        cfg_free(cfg);
-        cfg = NULL;
-    }
-
     char wd[PATH_MAX] = {};
     char config_file[PATH_MAX] = {};
     char* scanbd_conf_dir = NULL;
@@ -109,7 +133,7 @@ void cfg_do_parse(const char *config_file_name) {
     // get current directory
     if (getcwd(wd, PATH_MAX) == NULL) {
         slog(SLOG_ERROR, "can't get working directory");
-        exit(EXIT_FAILURE);
+        return NULL;
     }
 
     // cd into directory where scanbd.conf lives
@@ -121,22 +145,21 @@ void cfg_do_parse(const char *config_file_name) {
 
     if (chdir(scanbd_conf_dir) != 0) {
         slog(SLOG_ERROR, "can't access the directory for: %s", config_file_name);
-        exit(EXIT_FAILURE);
+        return NULL;
     }
 
-    cfg = cfg_init(cfg_options, CFGF_NONE);
+    cfg_t* new_cfg = cfg_init(cfg_options, CFGF_NONE);
 
     int ret = 0;
-    if ((ret = cfg_parse(cfg, config_file_name)) != CFG_SUCCESS) {
+    if ((ret = cfg_parse(new_cfg, config_file_name)) != CFG_SUCCESS) {
         if (CFG_FILE_ERROR == ret) {
             slog(SLOG_ERROR, "can't open config file: %s", config_file_name);
-            exit(EXIT_FAILURE);
         }
         else {
             slog(SLOG_ERROR, "parse error in config file");
-            exit(EXIT_FAILURE);
         }
-        exit(EXIT_FAILURE); // not reached
+        cfg_free(new_cfg);
+        new_cfg = NULL;
     }
 
     // cd back to original
@@ -144,7 +167,264 @@ void cfg_do_parse(const char *config_file_name) {
         slog(SLOG_ERROR, "can't cd back to: %s", wd);
         exit(EXIT_FAILURE);
     }
+    return new_cfg;
+}
+
+// makes new_cfg the running config, the old config is freed once no
+// thread references it any more
+// this function can only be used by the main thread
+void cfg_install(cfg_t* new_cfg) {
+    assert(new_cfg);
+    pthread_mutex_lock(&cfg_mutex);
+    cfg_t* old_cfg = cfg;
+    if ((old_cfg != NULL) && (cfg_refs > 0)) {
+        struct cfg_retired* r = malloc(sizeof(struct cfg_retired));
+        assert(r != NULL);
+        r->cfg = old_cfg;
+        r->refs = cfg_refs;
+        r->next = cfg_retired;
+        cfg_retired = r;
+        old_cfg = NULL;
+    }
+    cfg = new_cfg;
+    cfg_refs = 0;
+    pthread_mutex_unlock(&cfg_mutex);
+    if (old_cfg != NULL) {
+        cfg_free(old_cfg);
+    }
+}
+
+// takes a reference to the running config, it stays valid until
+// cfg_release() even if another config is installed meanwhile
+cfg_t* cfg_acquire(void) {
+    pthread_mutex_lock(&cfg_mutex);
+    cfg_t* c = cfg;
+    assert(c != NULL);
+    cfg_refs += 1;
+    pthread_mutex_unlock(&cfg_mutex);
+    return c;
+}
+
+// drops a reference taken by cfg_acquire(), a replaced config is freed
+// with its last reference
+void cfg_release(cfg_t* c) {
+    assert(c != NULL);
+    cfg_t* unused = NULL;
+    pthread_mutex_lock(&cfg_mutex);
+    if (c == cfg) {
+        assert(cfg_refs > 0);
+        cfg_refs -= 1;
+    }
+    else {
+        struct cfg_retired** rp = &cfg_retired;
+        while((*rp != NULL) && ((*rp)->cfg != c)) {
+            rp = &(*rp)->next;
+        }
+        assert(*rp != NULL);
+        struct cfg_retired* r = *rp;
+        r->refs -= 1;
+        if (r->refs == 0) {
+            *rp = r->next;
+            unused = r->cfg;
+            free(r);
+        }
+    }
+    pthread_mutex_unlock(&cfg_mutex);
+    if (unused != NULL) {
+        cfg_free(unused);
+    }
+}
+
+// parses the config-file and makes it the running config
+void cfg_do_parse(const char *config_file_name) {
+    cfg_t* new_cfg = cfg_parse_file(config_file_name);
+    if (new_cfg == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    cfg_install(new_cfg);
+}
+
+static bool cfg_str_equal(const char* a, const char* b) {
+    if ((a == NULL) || (b == NULL)) {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+static bool cfg_int_opt_equal(cfg_t* a, cfg_t* b, const char* name) {
+    return cfg_getint(a, name) == cfg_getint(b, name);
+}
+
+static bool cfg_bool_opt_equal(cfg_t* a, cfg_t* b, const char* name) {
+    return cfg_getbool(a, name) == cfg_getbool(b, name);
+}
+
+static bool cfg_str_opt_equal(cfg_t* a, cfg_t* b, const char* name) {
+    return cfg_str_equal(cfg_getstr(a, name), cfg_getstr(b, name));
+}
+
+static bool cfg_list_opt_equal(cfg_t* a, cfg_t* b, const char* name) {
+    unsigned int n = cfg_size(a, name);
+    if (n != cfg_size(b, name)) {
+        return false;
+    }
+    for(unsigned int i = 0; i < n; i += 1) {
+        if (!cfg_str_equal(cfg_getnstr(a, name, i), cfg_getnstr(b, name, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool cfg_action_equal(cfg_t* a, cfg_t* b) {
+    cfg_t* num_a = cfg_getsec(a, C_NUMERICAL_TRIGGER);
+    cfg_t* num_b = cfg_getsec(b, C_NUMERICAL_TRIGGER);
+    cfg_t* str_a = cfg_getsec(a, C_STRING_TRIGGER);
+    cfg_t* str_b = cfg_getsec(b, C_STRING_TRIGGER);
+    return cfg_str_opt_equal(a, b, C_FILTER) &&
+           cfg_str_opt_equal(a, b, C_DESC) &&
+           cfg_str_opt_equal(a, b, C_SCRIPT) &&
+           cfg_int_opt_equal(num_a, num_b, C_FROM_VALUE) &&
+           cfg_int_opt_equal(num_a, num_b, C_TO_VALUE) &&
+           cfg_str_opt_equal(str_a, str_b, C_FROM_VALUE) &&
+           cfg_str_opt_equal(str_a, str_b, C_TO_VALUE);
+}
+
+static bool cfg_function_equal(cfg_t* a, cfg_t* b) {
+    return cfg_str_opt_equal(a, b, C_FILTER) &&
+           cfg_str_opt_equal(a, b, C_DESC) &&
+           cfg_str_opt_equal(a, b, C_ENV);
+}
+
+// compares the (multiple, titled) sections name of a and b
+static bool cfg_sections_equal(cfg_t* a, cfg_t* b, const char* name,
+                               bool (*equal)(cfg_t*, cfg_t*)) {
+    unsigned int n = cfg_size(a, name);
+    if (n != cfg_size(b, name)) {
+        return false;
+    }
+    for(unsigned int i = 0; i < n; i += 1) {
+        cfg_t* sec_a = cfg_getnsec(a, name, i);
+        cfg_t* sec_b = cfg_getnsec(b, name, i);
+        if (!cfg_str_equal(cfg_title(sec_a), cfg_title(sec_b)) ||
+                !equal(sec_a, sec_b)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool cfg_device_equal(cfg_t* a, cfg_t* b) {
+    return cfg_str_opt_equal(a, b, C_FILTER) &&
+           cfg_str_opt_equal(a, b, C_DESC) &&
+           cfg_sections_equal(a, b, C_FUNCTION, cfg_function_equal) &&
+           cfg_sections_equal(a, b, C_ACTION, cfg_action_equal);
+}
+
+// the global options and what it takes to apply a change
+enum cfg_opt_kind {
+    CFG_KIND_INT,
+    CFG_KIND_BOOL,
+    CFG_KIND_STR,
+    CFG_KIND_LIST
+};
+
+static const struct {
+    const char* name;
+    enum cfg_opt_kind kind;
+    enum cfg_reload reload;
+} cfg_reload_opts[] = {
+    {C_DEBUG,                    CFG_KIND_BOOL, CFG_RELOAD_HOT},
+    {C_DEBUG_LEVEL,              CFG_KIND_INT,  CFG_RELOAD_HOT},
+    {C_MULTIPLE_ACTIONS,         CFG_KIND_BOOL, CFG_RELOAD_HOT},
+    {C_SCRIPTDIR,                CFG_KIND_STR,  CFG_RELOAD_HOT},
+    {C_DEVICE_INSERT_SCRIPT,     CFG_KIND_STR,  CFG_RELOAD_HOT},
+    {C_DEVICE_REMOVE_SCRIPT,     CFG_KIND_STR,  CFG_RELOAD_HOT},
+    {C_DEVICE_CACHE,             CFG_KIND_STR,  CFG_RELOAD_HOT},
+    {C_OPTION_CACHE,             CFG_KIND_STR,  CFG_RELOAD_HOT},
+    {C_USB_IDS,                  CFG_KIND_LIST, CFG_RELOAD_HOT},
+    {C_HOTPLUG_DEBOUNCE,         CFG_KIND_INT,  CFG_RELOAD_HOT},
+    {C_TIMEOUT,                  CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_TIMEOUT_MAX,              CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_BURST_TIMEOUT,            CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_BURST_DURATION,           CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_POLL_WORKERS,             CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_ACTION_JOBS,              CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_ACTION_BACKLOG,           CFG_KIND_INT,  CFG_RELOAD_THREADS},
+    {C_ACTION_QUEUE,             CFG_KIND_STR,  CFG_RELOAD_THREADS},
+    {C_SCANBUTTONS_BACKENDS_DIR, CFG_KIND_STR,  CFG_RELOAD_FULL},
+    // only used at startup
+    {C_USER,                     CFG_KIND_STR,  CFG_RELOAD_NONE},
+    {C_GROUP,                    CFG_KIND_STR,  CFG_RELOAD_NONE},
+    {C_SANED,                    CFG_KIND_STR,  CFG_RELOAD_NONE},
+    {C_SANED_OPTS,               CFG_KIND_LIST, CFG_RELOAD_NONE},
+    {C_SANED_ENVS,               CFG_KIND_LIST, CFG_RELOAD_NONE},
+    {C_SANED_POOL,               CFG_KIND_INT,  CFG_RELOAD_NONE},
+    {C_PIDFILE,                  CFG_KIND_STR,  CFG_RELOAD_NONE},
+    {C_CONTROL_SOCKET,           CFG_KIND_STR,  CFG_RELOAD_NONE},
+};
+
+// compares the running config with new_cfg and returns what it takes
+// to apply the changes:
+// CFG_RELOAD_NONE: nothing changed
+// CFG_RELOAD_HOT: only actions, functions, scripts, the environment, the
+// hotplug filter or debugging changed, the devices are kept open
+// CFG_RELOAD_THREADS: the polling must be restarted
+// CFG_RELOAD_FULL: the backends must be restarted
+enum cfg_reload cfg_reload_needed(cfg_t* old_cfg, cfg_t* new_cfg) {
+    assert(old_cfg && new_cfg);
+    cfg_t* old_global = cfg_getsec(old_cfg, C_GLOBAL);
+    cfg_t* new_global = cfg_getsec(new_cfg, C_GLOBAL);
+    assert(old_global && new_global);
+
+    enum cfg_reload reload = CFG_RELOAD_NONE;
+    bool changed = false;
+    for(size_t i = 0; i < sizeof(cfg_reload_opts) / sizeof(cfg_reload_opts[0]); i += 1) {
+        const char* name = cfg_reload_opts[i].name;
+        bool equal = true;
+        switch(cfg_reload_opts[i].kind) {
+        case CFG_KIND_INT:
+            equal = cfg_int_opt_equal(old_global, new_global, name);
+            break;
+        case CFG_KIND_BOOL:
+            equal = cfg_bool_opt_equal(old_global, new_global, name);
+            break;
+        case CFG_KIND_STR:
+            equal = cfg_str_opt_equal(old_global, new_global, name);
+            break;
+        case CFG_KIND_LIST:
+            equal = cfg_list_opt_equal(old_global, new_global, name);
+            break;
+        }
+        if (equal) {
+            continue;
+        }
+        changed = true;
+        if (cfg_reload_opts[i].reload == CFG_RELOAD_NONE) {
+            slog(SLOG_WARN, "option %s changed, restart scanbd to apply it", name);
+        }
+        else {
+            slog(SLOG_DEBUG, "option %s changed", name);
+        }
+        if (cfg_reload_opts[i].reload > reload) {
+            reload = cfg_reload_opts[i].reload;
+        }
+    }
 
+    if (!cfg_sections_equal(old_global, new_global, C_ACTION, cfg_action_equal) ||
+            !cfg_sections_equal(old_global, new_global, C_FUNCTION, cfg_function_equal) ||
+            !cfg_str_opt_equal(cfg_getsec(old_global, C_ENVIRONMENT),
+                               cfg_getsec(new_global, C_ENVIRONMENT), C_ENV_DEVICE) ||
+            !cfg_str_opt_equal(cfg_getsec(old_global, C_ENVIRONMENT),
+                               cfg_getsec(new_global, C_ENVIRONMENT), C_ENV_ACTION) ||
+            !cfg_sections_equal(old_cfg, new_cfg, C_DEVICE, cfg_device_equal)) {
+        slog(SLOG_DEBUG, "actions, functions or device sections changed");
+        changed = true;
+    }
+    if (changed && (reload < CFG_RELOAD_HOT)) {
+        reload = CFG_RELOAD_HOT;
+    }
+    return reload;
 }
 
 char *make_script_path_abs(const char *script) {
@@ -163,8 +443,9 @@ char *make_script_path_abs(const char *script) {
         // script has a relative path, determine the directory
         // get the scriptdir from the global config
 
+        cfg_t* c = cfg_acquire();
         cfg_t* cfg_sec_global = NULL;
-    	cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    	cfg_sec_global = cfg_getsec(c, C_GLOBAL);
     	assert(cfg_sec_global);
 
         const char* scriptdir =  cfg_getstr(cfg_sec_global, C_SCRIPTDIR);
@@ -179,7 +460,72 @@ char *make_script_path_abs(const char *script) {
             // scriptdir is relative to config directory
             snprintf(script_abs, PATH_MAX, "%s/%s/%s", SCANBD_CFG_DIR, scriptdir, script);
         }
+        cfg_release(c);
         slog(SLOG_DEBUG, "using relative script path: %s, expanded to: %s", script, script_abs);
     } 
     return script_abs;
 }
+
+// reads the interval settings of the global config section
+void poll_interval_init(poll_interval_t* pi) {
+    assert(pi != NULL);
+
+    cfg_t* c = cfg_acquire();
+    cfg_t* cfg_sec_global = NULL;
+    cfg_sec_global = cfg_getsec(c, C_GLOBAL);
+    assert(cfg_sec_global);
+
+    pi->min = cfg_getint(cfg_sec_global, C_TIMEOUT);
+    if (pi->min <= 0) {
+        pi->min = C_TIMEOUT_DEF;
+    }
+    pi->max = cfg_getint(cfg_sec_global, C_TIMEOUT_MAX);
+    if (pi->max < pi->min) {
+        // no backoff
+        pi->max = pi->min;
+    }
+    pi->burst = cfg_getint(cfg_sec_global, C_BURST_TIMEOUT);
+    if (pi->burst < 0) {
+        pi->burst = 0;
+    }
+    if (pi->burst > pi->min) {
+        pi->burst = pi->min;
+    }
+    pi->burst_duration = cfg_getint(cfg_sec_global, C_BURST_DURATION);
+    if (pi->burst_duration < 0) {
+        pi->burst_duration = 0;
+    }
+    cfg_release(c);
+    pi->current = pi->min;
+    pi->burst_end.tv_sec = 0;
+    pi->burst_end.tv_nsec = 0;
+    slog(SLOG_DEBUG, "poll interval: %d - %d ms, burst: %d ms for %d s",
+         pi->min, pi->max, pi->burst, pi->burst_duration);
+}
+
+// returns the time to wait (ms) until the next poll cycle
+// activity: a value changed or an action was triggered in the last cycle
+int poll_interval_next(poll_interval_t* pi, bool activity) {
+    assert(pi != NULL);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (activity) {
+        pi->current = pi->min;
+        if ((pi->burst > 0) && (pi->burst_duration > 0)) {
+            pi->burst_end = now;
+            pi->burst_end.tv_sec += pi->burst_duration;
+        }
+    }
+    if ((now.tv_sec < pi->burst_end.tv_sec) ||
+            ((now.tv_sec == pi->burst_end.tv_sec) && (now.tv_nsec < pi->burst_end.tv_nsec))) {
+        return pi->burst;
+    }
+    // idle: back off
+    int interval = pi->current;
+    if (pi->current < pi->max) {
+        pi->current = (pi->current > pi->max / 2) ? pi->max : 2 * pi->current;
+    }
+    return interval;
+}
@@ -23,7 +23,36 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// what it takes to apply a changed config, in ascending order
+enum cfg_reload {
+    CFG_RELOAD_NONE,    // nothing changed
+    CFG_RELOAD_HOT,     // the running poll plans are rebuilt
+    CFG_RELOAD_THREADS, // the polling is restarted
+    CFG_RELOAD_FULL     // the backends are restarted
+};
+
+cfg_t* cfg_parse_file(const char *config_file_name);
+void cfg_install(cfg_t* new_cfg);
+cfg_t* cfg_acquire(void);
+void cfg_release(cfg_t* c);
 void cfg_do_parse(const char *config_file_name);
+enum cfg_reload cfg_reload_needed(cfg_t* old_cfg, cfg_t* new_cfg);
 char *make_script_path_abs(const char *script);
 
+// the adaptive interval of a polling loop: the interval doubles with
+// every idle cycle from timeout up to timeout_max, after activity the
+// loop polls every burst_timeout for burst_duration seconds
+struct poll_interval {
+    int min;                    // ms (timeout)
+    int max;                    // ms (timeout_max)
+    int burst;                  // ms (burst_timeout), 0: no burst mode
+    int burst_duration;         // s (burst_duration)
+    int current;                // ms, the actual idle interval
+    struct timespec burst_end;  // end of the burst mode (CLOCK_MONOTONIC)
+};
+typedef struct poll_interval poll_interval_t;
+
+void poll_interval_init(poll_interval_t* pi);
+int poll_interval_next(poll_interval_t* pi, bool activity);
+
 #endif
@@ -0,0 +1,981 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include "control.h"
+#include "slog.h"
+
+// signal handlers -> main thread: one byte per command
+static int control_pipe[2] = {-1, -1};
+
+// the byte written by the posting threads, their requests are queued
+#define CONTROL_WAKEUP 0xff
+
+// the commands read at once by the main thread
+#define CONTROL_MAX_SIGNALS 64
+
+static control_handler_t control_handler = NULL;
+
+static pthread_mutex_t control_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t control_cv = PTHREAD_COND_INITIALIZER;
+// the requests of the threads in FIFO order (guarded by control_mutex)
+static control_request_t* control_queue_head = NULL;
+static control_request_t* control_queue_tail = NULL;
+static bool control_stopping = false;
+
+// a peer closing the control socket must not kill us with SIGPIPE
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+// the length of a command line of the control socket (a command and a
+// sane device name)
+#define CONTROL_LINE_MAX 256
+
+// a connection of the control socket (only used by the main thread)
+struct control_client {
+    int fd;
+    char line[CONTROL_LINE_MAX];
+    size_t len;
+    bool acquired;    // the client holds an acquire
+    char** devices;   // the devices acquired by the client, once per
+    int num_devices;  // acquire
+    int devices_capacity;
+    int passed_fd;    // the descriptor passed with the next command
+};
+
+static void control_client_free(struct control_client*);
+
+static int control_listen_fd = -1;
+static char* control_socket_path = NULL;
+static struct control_client control_clients[CONTROL_MAX_CLIENTS];
+static int num_control_clients = 0;
+// the clients holding an acquire: the first one stops the polling, the
+// last one resumes it
+static int num_control_acquired = 0;
+
+static const char* control_cmd_name(enum control_cmd cmd) {
+    switch(cmd) {
+    case CONTROL_RECONFIGURE:
+        return "reconfigure";
+    case CONTROL_RESTART:
+        return "restart";
+    case CONTROL_ACQUIRE:
+        return "acquire";
+    case CONTROL_RELEASE:
+        return "release";
+    case CONTROL_HOTPLUG:
+        return "hotplug";
+    case CONTROL_SANED:
+        return "saned";
+    case CONTROL_DISCOVERED:
+        return "discovered";
+    case CONTROL_TERMINATE:
+        return "terminate";
+    }
+    return "unknown";
+}
+
+// creates the self-pipe, must be called before the signal handlers are
+// installed
+bool control_init(control_handler_t handler) {
+    assert(handler);
+    control_handler = handler;
+    if (pipe(control_pipe) < 0) {
+        slog(SLOG_ERROR, "Can't create control pipe: %s", strerror(errno));
+        return false;
+    }
+    for(int i = 0; i < 2; i += 1) {
+        int flags = fcntl(control_pipe[i], F_GETFL, 0);
+        if ((flags < 0) || (fcntl(control_pipe[i], F_SETFL, flags | O_NONBLOCK) < 0)) {
+            slog(SLOG_WARN, "Can't set control pipe to non-blocking mode: %s", strerror(errno));
+        }
+        if (fcntl(control_pipe[i], F_SETFD, FD_CLOEXEC) < 0) {
+            slog(SLOG_WARN, "Can't set close-on-exec on control pipe: %s", strerror(errno));
+        }
+    }
+    return true;
+}
+
+// the handler of SIGHUP, SIGALRM, SIGUSR1, SIGUSR2, SIGTERM and SIGINT
+void control_signal_handler(int signal) {
+    // only async-signal-safe calls here
+    int saved_errno = errno;
+    unsigned char c = 0;
+    switch(signal) {
+    case SIGHUP:
+        c = CONTROL_RECONFIGURE;
+        break;
+    case SIGALRM:
+        c = CONTROL_RESTART;
+        break;
+    case SIGUSR1:
+        c = CONTROL_ACQUIRE;
+        break;
+    case SIGUSR2:
+        c = CONTROL_RELEASE;
+        break;
+    case SIGTERM:
+    case SIGINT:
+        c = CONTROL_TERMINATE;
+        break;
+    default:
+        errno = saved_errno;
+        return;
+    }
+    if (control_pipe[PIPE_WRITE] >= 0) {
+        if (write(control_pipe[PIPE_WRITE], &c, 1) < 0) {
+            // pipe full: the signal is lost
+        }
+    }
+    errno = saved_errno;
+}
+
+// queues the request and waits until the main thread has run it
+static void control_post(control_request_t* r) {
+    r->waited = true;
+    r->done = false;
+    r->next = NULL;
+    if (pthread_mutex_lock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (control_stopping || (control_pipe[PIPE_WRITE] < 0)) {
+        if (pthread_mutex_unlock(&control_mutex)) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+        slog(SLOG_WARN, "control loop not running, %s dropped", control_cmd_name(r->cmd));
+        return;
+    }
+    if (control_queue_tail == NULL) {
+        control_queue_head = r;
+    }
+    else {
+        control_queue_tail->next = r;
+    }
+    control_queue_tail = r;
+    unsigned char c = CONTROL_WAKEUP;
+    if (write(control_pipe[PIPE_WRITE], &c, 1) < 0) {
+        if (errno != EAGAIN) {
+            slog(SLOG_WARN, "Can't wake up the control loop: %s", strerror(errno));
+        }
+    }
+    while(!r->done) {
+        pthread_cond_wait(&control_cv, &control_mutex);
+    }
+    if (pthread_mutex_unlock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// runs the command in the main thread and waits for its completion
+void control_call(enum control_cmd cmd) {
+    assert(cmd != CONTROL_HOTPLUG);
+    control_request_t r;
+    memset(&r, 0, sizeof(r));
+    r.cmd = cmd;
+    control_post(&r);
+}
+
+// acquires or releases a single device (by name or number) in the main
+// thread and waits for its completion
+// returns false if the command failed or was dropped
+bool control_call_device(enum control_cmd cmd, const char* device) {
+    assert((cmd == CONTROL_ACQUIRE) || (cmd == CONTROL_RELEASE));
+    assert(device != NULL);
+    control_request_t r;
+    memset(&r, 0, sizeof(r));
+    r.cmd = cmd;
+    r.device = device;
+    r.failed = true;
+    control_post(&r);
+    return !r.failed;
+}
+
+// queues the command for the main thread without waiting for it (like
+// a signal), for threads the main thread may wait for
+void control_notify(enum control_cmd cmd) {
+    assert((cmd != CONTROL_HOTPLUG) && (cmd != CONTROL_SANED));
+    unsigned char c = (unsigned char) cmd;
+    if (control_pipe[PIPE_WRITE] < 0) {
+        slog(SLOG_DEBUG, "control loop not running, %s dropped", control_cmd_name(cmd));
+        return;
+    }
+    if (write(control_pipe[PIPE_WRITE], &c, 1) < 0) {
+        slog(SLOG_WARN, "Can't post %s to the control loop: %s",
+             control_cmd_name(cmd), strerror(errno));
+    }
+}
+
+// reconciles the added and removed devices in the main thread and
+// waits for its completion, the arrays are only used meanwhile
+void control_hotplug(const hotplug_device_t* added, int num_added,
+                     const hotplug_device_t* removed, int num_removed) {
+    control_request_t r;
+    memset(&r, 0, sizeof(r));
+    r.cmd = CONTROL_HOTPLUG;
+    r.added = added;
+    r.num_added = num_added;
+    r.removed = removed;
+    r.num_removed = num_removed;
+    control_post(&r);
+}
+
+// wakes up the threads waiting for the requests
+static void control_complete(control_request_t** batch, int n) {
+    if (pthread_mutex_lock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    bool waited = false;
+    for(int i = 0; i < n; i += 1) {
+        if (batch[i]->waited) {
+            batch[i]->done = true;
+            waited = true;
+        }
+    }
+    if (waited) {
+        if (pthread_cond_broadcast(&control_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+        }
+    }
+    if (pthread_mutex_unlock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// the queued requests aren't run anymore, their posters are woken up
+void control_stop(void) {
+    if (pthread_mutex_lock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    control_stopping = true;
+    for(control_request_t* r = control_queue_head; r != NULL; r = r->next) {
+        slog(SLOG_DEBUG, "control: %s dropped", control_cmd_name(r->cmd));
+        r->done = true;
+    }
+    control_queue_head = control_queue_tail = NULL;
+    if (pthread_cond_broadcast(&control_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&control_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// merges the commands arrived at once, the skipped requests are only
+// completed:
+// - only the last reconfiguration runs, a restart wins over a reread
+// - a stop of the polling directly followed by its resume (e.g. a short
+//   saned session of scanbm in signal-mode) is dropped, unless a thread
+//   waits for the stop
+static void control_coalesce(control_request_t** batch, bool* skip, int n) {
+    int last_reconfigure = -1;
+    bool restart = false;
+    for(int i = 0; i < n; i += 1) {
+        enum control_cmd cmd = batch[i]->cmd;
+        if ((cmd == CONTROL_RECONFIGURE) || (cmd == CONTROL_RESTART)) {
+            if (last_reconfigure >= 0) {
+                skip[last_reconfigure] = true;
+            }
+            last_reconfigure = i;
+            restart |= (cmd == CONTROL_RESTART);
+        }
+    }
+    if (restart) {
+        // reconfigurations only come from signals
+        assert(!batch[last_reconfigure]->waited);
+        batch[last_reconfigure]->cmd = CONTROL_RESTART;
+    }
+    int acquire = -1;
+    for(int i = 0; i < n; i += 1) {
+        if (skip[i]) {
+            continue;
+        }
+        enum control_cmd cmd = batch[i]->cmd;
+        if ((cmd == CONTROL_RELEASE) && (batch[i]->device == NULL) && (acquire >= 0)) {
+            slog(SLOG_DEBUG, "control: acquire/release pair merged");
+            skip[acquire] = true;
+            skip[i] = true;
+            acquire = -1;
+            continue;
+        }
+        acquire = ((cmd == CONTROL_ACQUIRE) && !batch[i]->waited &&
+                   (batch[i]->device == NULL)) ? i : -1;
+    }
+}
+
+static bool control_set_flags(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+        slog(SLOG_WARN, "Can't set non-blocking mode: %s", strerror(errno));
+        return false;
+    }
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+        slog(SLOG_WARN, "Can't set close-on-exec: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static bool control_socket_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        slog(SLOG_ERROR, "control socket path too long: %s", path);
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+// creates the control socket served by control_loop(), accessible for
+// the user and the group of the daemon
+bool control_listen(const char* path, uid_t uid, gid_t gid) {
+    assert(path);
+    slog(SLOG_DEBUG, "control_listen: %s", path);
+    struct sockaddr_un addr;
+    if (!control_socket_address(path, &addr)) {
+        return false;
+    }
+    // remove a stale socket of a crashed daemon
+    struct stat sb;
+    if ((lstat(path, &sb) == 0) && S_ISSOCK(sb.st_mode)) {
+        if (unlink(path) < 0) {
+            slog(SLOG_WARN, "Can't remove stale control socket %s: %s", path, strerror(errno));
+        }
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        slog(SLOG_ERROR, "Can't create control socket: %s", strerror(errno));
+        return false;
+    }
+    if (!control_set_flags(fd)) {
+        close(fd);
+        return false;
+    }
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        slog(SLOG_ERROR, "Can't bind control socket %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (chown(path, uid, gid) < 0) {
+        slog(SLOG_WARN, "Can't chown control socket %s: %s", path, strerror(errno));
+    }
+    if (chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) < 0) {
+        slog(SLOG_WARN, "Can't chmod control socket %s: %s", path, strerror(errno));
+    }
+    if (listen(fd, CONTROL_MAX_CLIENTS) < 0) {
+        slog(SLOG_ERROR, "Can't listen on control socket %s: %s", path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return false;
+    }
+    control_socket_path = strdup(path);
+    assert(control_socket_path);
+    control_listen_fd = fd;
+    slog(SLOG_INFO, "listening on control socket %s", path);
+    return true;
+}
+
+// closes and removes the control socket
+void control_unlisten(void) {
+    if (control_listen_fd < 0) {
+        return;
+    }
+    close(control_listen_fd);
+    control_listen_fd = -1;
+    for(int i = 0; i < num_control_clients; i += 1) {
+        close(control_clients[i].fd);
+        control_client_free(&control_clients[i]);
+    }
+    num_control_clients = 0;
+    if (unlink(control_socket_path) < 0) {
+        slog(SLOG_WARN, "Can't remove control socket %s: %s",
+             control_socket_path, strerror(errno));
+    }
+    free(control_socket_path);
+    control_socket_path = NULL;
+}
+
+// connects to the control socket of the running daemon
+// returns the connection or -1
+int control_connect(const char* path) {
+    assert(path);
+    struct sockaddr_un addr;
+    if (!control_socket_address(path, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        slog(SLOG_WARN, "Can't create socket: %s", strerror(errno));
+        return -1;
+    }
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+        slog(SLOG_WARN, "Can't set close-on-exec: %s", strerror(errno));
+    }
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        slog(SLOG_DEBUG, "Can't connect to control socket %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// sends the data and the descriptor fd (SCM_RIGHTS) over the unix
+// socket sock
+// returns false on errors
+bool control_send_fd(int sock, const void* data, size_t len, int fd) {
+    assert(len > 0);
+    struct iovec iov;
+    iov.iov_base = (void*) data;
+    iov.iov_len = len;
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } u;
+    memset(&u, 0, sizeof(u));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+    ssize_t n = -1;
+    while(((n = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0) && (errno == EINTR)) {
+        // restart
+    }
+    if (n < 0) {
+        slog(SLOG_WARN, "Can't pass descriptor: %s", strerror(errno));
+        return false;
+    }
+    // the rest of a short line without the descriptor
+    size_t written = n;
+    while(written < len) {
+        n = send(sock, (const char*) data + written, len - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            slog(SLOG_WARN, "Can't send to socket: %s", strerror(errno));
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+// sends the command (for the device or NULL, passing the descriptor
+// passfd if not -1) and waits for the reply of the daemon
+// returns true if the daemon replied ok
+static bool control_request_line(int fd, const char* cmd, const char* device, int passfd) {
+    slog(SLOG_DEBUG, "control_command: %s %s", cmd, device ? device : "");
+    char line[CONTROL_LINE_MAX];
+    if (device != NULL) {
+        snprintf(line, sizeof(line), "%s %s\n", cmd, device);
+    }
+    else {
+        snprintf(line, sizeof(line), "%s\n", cmd);
+    }
+    size_t len = strlen(line);
+    if (passfd >= 0) {
+        if (!control_send_fd(fd, line, len, passfd)) {
+            return false;
+        }
+    }
+    size_t written = (passfd >= 0) ? len : 0;
+    while(written < len) {
+        ssize_t n = send(fd, line + written, len - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            slog(SLOG_WARN, "Can't send %s to the control socket: %s", cmd, strerror(errno));
+            return false;
+        }
+        written += n;
+    }
+    size_t received = 0;
+    while(true) {
+        ssize_t n = read(fd, line + received, 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            slog(SLOG_WARN, "Can't read the reply of %s: %s", cmd, strerror(errno));
+            return false;
+        }
+        if (n == 0) {
+            slog(SLOG_WARN, "control socket closed by the daemon");
+            return false;
+        }
+        if (line[received] == '\n') {
+            break;
+        }
+        if (received < sizeof(line) - 1) {
+            received += 1;
+        }
+    }
+    line[received] = '\0';
+    if (strcmp(line, CONTROL_REPLY_OK) != 0) {
+        slog(SLOG_WARN, "%s failed: %s", cmd, line);
+        return false;
+    }
+    return true;
+}
+
+// sends the command (for the device or NULL) and waits for the reply
+// of the daemon
+// returns true if the daemon replied ok
+bool control_command(int fd, const char* cmd, const char* device) {
+    return control_request_line(fd, cmd, device, -1);
+}
+
+// passes the client connection conn to a saned helper of the daemon,
+// the devices (or only device) are acquired until saned exits
+// returns true if a helper took the connection
+bool control_handoff(int fd, const char* device, int conn) {
+    return control_request_line(fd, CONTROL_CMD_SANED, device, conn);
+}
+
+// runs a command of a control socket client
+static bool control_client_run(enum control_cmd cmd, const char* device) {
+    control_request_t r;
+    memset(&r, 0, sizeof(r));
+    r.cmd = cmd;
+    r.device = device;
+    r.fd = -1;
+    slog(SLOG_DEBUG, "control: %s %s", control_cmd_name(cmd), device ? device : "");
+    return control_handler(&r);
+}
+
+static void control_client_reply(struct control_client* c, const char* reply) {
+    char line[CONTROL_LINE_MAX];
+    snprintf(line, sizeof(line), "%s\n", reply);
+    // the reply fits into the socket buffer
+    if (send(c->fd, line, strlen(line), MSG_NOSIGNAL) < 0) {
+        slog(SLOG_WARN, "Can't reply to control client: %s", strerror(errno));
+    }
+}
+
+static void control_client_acquire(struct control_client* c) {
+    if (c->acquired) {
+        return;
+    }
+    c->acquired = true;
+    num_control_acquired += 1;
+    if (num_control_acquired == 1) {
+        control_client_run(CONTROL_ACQUIRE, NULL);
+    }
+}
+
+static void control_client_release(struct control_client* c) {
+    if (!c->acquired) {
+        return;
+    }
+    c->acquired = false;
+    num_control_acquired -= 1;
+    if (num_control_acquired == 0) {
+        control_client_run(CONTROL_RELEASE, NULL);
+    }
+}
+
+static bool control_client_acquire_device(struct control_client* c, const char* device) {
+    if (!control_client_run(CONTROL_ACQUIRE, device)) {
+        return false;
+    }
+    if (c->num_devices == c->devices_capacity) {
+        c->devices_capacity = (c->devices_capacity > 0) ? 2 * c->devices_capacity : 2;
+        c->devices = (char**) realloc(c->devices, c->devices_capacity * sizeof(char*));
+        assert(c->devices != NULL);
+    }
+    c->devices[c->num_devices] = strdup(device);
+    assert(c->devices[c->num_devices] != NULL);
+    c->num_devices += 1;
+    return true;
+}
+
+static bool control_client_release_device(struct control_client* c, const char* device) {
+    for(int i = 0; i < c->num_devices; i += 1) {
+        if (strcmp(c->devices[i], device) == 0) {
+            control_client_run(CONTROL_RELEASE, device);
+            free(c->devices[i]);
+            c->num_devices -= 1;
+            memmove(c->devices + i, c->devices + i + 1,
+                    (c->num_devices - i) * sizeof(char*));
+            return true;
+        }
+    }
+    slog(SLOG_WARN, "device %s not acquired by the control client", device);
+    return false;
+}
+
+// gives back everything the client acquired
+static void control_client_release_all(struct control_client* c) {
+    while(c->num_devices > 0) {
+        control_client_release_device(c, c->devices[c->num_devices - 1]);
+    }
+    control_client_release(c);
+}
+
+static void control_client_free(struct control_client* c) {
+    if (c->passed_fd >= 0) {
+        close(c->passed_fd);
+        c->passed_fd = -1;
+    }
+    for(int i = 0; i < c->num_devices; i += 1) {
+        free(c->devices[i]);
+    }
+    free(c->devices);
+    c->devices = NULL;
+    c->num_devices = 0;
+    c->devices_capacity = 0;
+}
+
+// the command of the line ("acquire" or "acquire <device>"), the device
+// is NULL without argument
+static bool control_client_parse(char* line, const char* cmd, const char** device) {
+    size_t len = strlen(cmd);
+    if (strncmp(line, cmd, len) != 0) {
+        return false;
+    }
+    if (line[len] == '\0') {
+        *device = NULL;
+        return true;
+    }
+    if (!isspace((unsigned char)line[len])) {
+        return false;
+    }
+    char* arg = line + len;
+    while(isspace((unsigned char)*arg)) {
+        arg += 1;
+    }
+    *device = (*arg != '\0') ? arg : NULL;
+    return true;
+}
+
+// runs saned for the connection passed with the command
+static void control_client_saned(struct control_client* c, const char* device) {
+    if (c->passed_fd < 0) {
+        control_client_reply(c, "error no connection passed");
+        return;
+    }
+    control_request_t r;
+    memset(&r, 0, sizeof(r));
+    r.cmd = CONTROL_SANED;
+    r.device = device;
+    r.fd = c->passed_fd;
+    slog(SLOG_DEBUG, "control: %s %s", control_cmd_name(r.cmd), device ? device : "");
+    bool ok = control_handler(&r);
+    // the helper got its own descriptor
+    close(c->passed_fd);
+    c->passed_fd = -1;
+    control_client_reply(c, ok ? CONTROL_REPLY_OK : "error no saned helper");
+}
+
+static void control_client_line(struct control_client* c, char* line) {
+    const char* device = NULL;
+    if (control_client_parse(line, CONTROL_CMD_ACQUIRE, &device)) {
+        if (device == NULL) {
+            control_client_acquire(c);
+        }
+        else if (!control_client_acquire_device(c, device)) {
+            control_client_reply(c, "error no such device");
+            return;
+        }
+        control_client_reply(c, CONTROL_REPLY_OK);
+    }
+    else if (control_client_parse(line, CONTROL_CMD_SANED, &device)) {
+        control_client_saned(c, device);
+    }
+    else if (control_client_parse(line, CONTROL_CMD_RELEASE, &device)) {
+        if (device == NULL) {
+            control_client_release(c);
+        }
+        else if (!control_client_release_device(c, device)) {
+            control_client_reply(c, "error device not acquired");
+            return;
+        }
+        control_client_reply(c, CONTROL_REPLY_OK);
+    }
+    else {
+        slog(SLOG_WARN, "unknown control command: %s", line);
+        control_client_reply(c, "error unknown command");
+    }
+}
+
+// reads the commands of the client, returns false if the connection
+// is closed
+static bool control_client_read(struct control_client* c) {
+    char buf[CONTROL_LINE_MAX];
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    ssize_t n = recvmsg(c->fd, &msg, flags);
+    if (n < 0) {
+        return (errno == EAGAIN) || (errno == EINTR);
+    }
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    if ((cm != NULL) && (cm->cmsg_level == SOL_SOCKET) && (cm->cmsg_type == SCM_RIGHTS)) {
+        // a passed connection for the next command
+        if (c->passed_fd >= 0) {
+            close(c->passed_fd);
+        }
+        memcpy(&c->passed_fd, CMSG_DATA(cm), sizeof(int));
+        if (fcntl(c->passed_fd, F_SETFD, FD_CLOEXEC) < 0) {
+            slog(SLOG_WARN, "Can't set close-on-exec: %s", strerror(errno));
+        }
+    }
+    if (n == 0) {
+        return false;
+    }
+    for(ssize_t i = 0; i < n; i += 1) {
+        if (buf[i] == '\n') {
+            c->line[c->len] = '\0';
+            if ((c->len > 0) && (c->line[c->len - 1] == '\r')) {
+                c->line[c->len - 1] = '\0';
+            }
+            control_client_line(c, c->line);
+            c->len = 0;
+        }
+        else if (c->len < sizeof(c->line) - 1) {
+            c->line[c->len] = buf[i];
+            c->len += 1;
+        }
+    }
+    return true;
+}
+
+static void control_accept(void) {
+    int fd = accept(control_listen_fd, NULL, NULL);
+    if (fd < 0) {
+        if ((errno != EAGAIN) && (errno != EINTR)) {
+            slog(SLOG_WARN, "accept on control socket: %s", strerror(errno));
+        }
+        return;
+    }
+    if (num_control_clients == CONTROL_MAX_CLIENTS) {
+        slog(SLOG_WARN, "too many control clients");
+        close(fd);
+        return;
+    }
+    control_set_flags(fd);
+    struct control_client* c = &control_clients[num_control_clients];
+    memset(c, 0, sizeof(struct control_client));
+    c->fd = fd;
+    c->passed_fd = -1;
+    num_control_clients += 1;
+    slog(SLOG_DEBUG, "control client connected");
+}
+
+// makes the socket fd a client of the control loop which acquires the
+// devices (or only device) until the socket is closed, i.e. the hangup
+// of the socket releases them. Used for the saned helpers.
+// returns false if the devices can't be acquired
+bool control_adopt(int fd, const char* device) {
+    if (num_control_clients == CONTROL_MAX_CLIENTS) {
+        slog(SLOG_WARN, "too many control clients");
+        return false;
+    }
+    struct control_client* c = &control_clients[num_control_clients];
+    memset(c, 0, sizeof(struct control_client));
+    c->fd = fd;
+    c->passed_fd = -1;
+    if (device == NULL) {
+        control_client_acquire(c);
+    }
+    else if (!control_client_acquire_device(c, device)) {
+        return false;
+    }
+    control_set_flags(fd);
+    num_control_clients += 1;
+    return true;
+}
+
+// serves the clients of the control socket with events, a client
+// closing the connection releases its acquire (e.g. scanbm was killed)
+static void control_serve(const struct pollfd* pfds, int num_pfds) {
+    int removed = 0;
+    for(int i = 0; (i < num_pfds) && (i < num_control_clients); i += 1) {
+        struct control_client* c = &control_clients[i];
+        assert(pfds[i].fd == c->fd);
+        if (pfds[i].revents == 0) {
+            continue;
+        }
+        if (control_client_read(c)) {
+            continue;
+        }
+        slog(SLOG_DEBUG, "control client disconnected");
+        if (c->acquired || (c->num_devices > 0)) {
+            slog(SLOG_INFO, "control client closed without release");
+            control_client_release_all(c);
+        }
+        control_client_free(c);
+        close(c->fd);
+        c->fd = -1;
+        removed += 1;
+    }
+    if (removed == 0) {
+        return;
+    }
+    int n = 0;
+    for(int i = 0; i < num_control_clients; i += 1) {
+        if (control_clients[i].fd >= 0) {
+            control_clients[n] = control_clients[i];
+            n += 1;
+        }
+    }
+    num_control_clients = n;
+}
+
+// the main loop: runs the posted commands until terminated
+void control_loop(void) {
+    assert(control_handler);
+    // the commands of the signal handlers of one wakeup
+    control_request_t signalled[CONTROL_MAX_SIGNALS];
+    control_request_t** batch = NULL;
+    bool* skip = NULL;
+    int capacity = 0;
+
+    while(true) {
+        // the pipe, the control socket and its clients
+        struct pollfd pfds[CONTROL_MAX_CLIENTS + 2];
+        int num_pfds = 0;
+        pfds[num_pfds].fd = control_pipe[PIPE_READ];
+        pfds[num_pfds].events = POLLIN;
+        pfds[num_pfds].revents = 0;
+        num_pfds += 1;
+        if (control_listen_fd >= 0) {
+            pfds[num_pfds].fd = control_listen_fd;
+            pfds[num_pfds].events = POLLIN;
+            pfds[num_pfds].revents = 0;
+            num_pfds += 1;
+        }
+        const int first_client = num_pfds;
+        for(int i = 0; i < num_control_clients; i += 1) {
+            pfds[num_pfds].fd = control_clients[i].fd;
+            pfds[num_pfds].events = POLLIN;
+            pfds[num_pfds].revents = 0;
+            num_pfds += 1;
+        }
+        if (poll(pfds, num_pfds, -1) < 0) {
+            if (errno != EINTR) {
+                slog(SLOG_ERROR, "poll: %s", strerror(errno));
+            }
+            continue;
+        }
+        if (num_pfds > first_client) {
+            control_serve(&pfds[first_client], num_pfds - first_client);
+        }
+        if ((control_listen_fd >= 0) && (pfds[1].revents & POLLIN)) {
+            control_accept();
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+        unsigned char buf[CONTROL_MAX_SIGNALS];
+        ssize_t len = read(control_pipe[PIPE_READ], buf, sizeof(buf));
+        if (len <= 0) {
+            continue;
+        }
+        int num_signalled = 0;
+        for(ssize_t i = 0; i < len; i += 1) {
+            if (buf[i] == CONTROL_WAKEUP) {
+                continue;
+            }
+            memset(&signalled[num_signalled], 0, sizeof(control_request_t));
+            signalled[num_signalled].cmd = (enum control_cmd) buf[i];
+            num_signalled += 1;
+        }
+
+        // the queued requests of the threads
+        if (pthread_mutex_lock(&control_mutex)) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        }
+        control_request_t* queued = control_queue_head;
+        control_queue_head = control_queue_tail = NULL;
+        if (pthread_mutex_unlock(&control_mutex)) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+
+        int n = num_signalled;
+        for(control_request_t* r = queued; r != NULL; r = r->next) {
+            n += 1;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (n > capacity) {
+            capacity = n;
+            batch = realloc(batch, capacity * sizeof(control_request_t*));
+            skip = realloc(skip, capacity * sizeof(bool));
+            assert((batch != NULL) && (skip != NULL));
+        }
+        n = 0;
+        for(int i = 0; i < num_signalled; i += 1) {
+            batch[n] = &signalled[i];
+            skip[n] = false;
+            n += 1;
+        }
+        for(control_request_t* r = queued; r != NULL; r = r->next) {
+            batch[n] = r;
+            skip[n] = false;
+            n += 1;
+        }
+
+        control_coalesce(batch, skip, n);
+        for(int i = 0; i < n; i += 1) {
+            if (skip[i]) {
+                slog(SLOG_DEBUG, "control: %s merged", control_cmd_name(batch[i]->cmd));
+                control_complete(&batch[i], 1);
+                continue;
+            }
+            slog(SLOG_DEBUG, "control: %s", control_cmd_name(batch[i]->cmd));
+            if (batch[i]->cmd == CONTROL_TERMINATE) {
+                // the handler doesn't return, the threads waiting for
+                // the remaining requests are stopped by it
+                control_complete(&batch[i + 1], n - i - 1);
+                control_stop();
+            }
+            batch[i]->failed = !control_handler(batch[i]);
+            control_complete(&batch[i], 1);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "common.h"
+#include "scanbd_dbus.h"
+
+// the control loop of the main thread: the signal handlers, the dbus
+// and the udev thread only post commands, the main thread runs them one
+// after another. The signal handlers write the command into a self-pipe,
+// the threads queue their requests and wait for their completion.
+
+enum control_cmd {
+    CONTROL_RECONFIGURE,  // SIGHUP: reread the config
+    CONTROL_RESTART,      // SIGALRM: restart the backends
+    CONTROL_ACQUIRE,      // SIGUSR1, dbus: stop polling (saned starts)
+    CONTROL_RELEASE,      // SIGUSR2, dbus: resume polling (saned exited)
+    // acquire and release can be limited to a single device
+    CONTROL_HOTPLUG,      // udev, dbus: devices added or removed
+    CONTROL_SANED,        // control socket: run saned for a connection
+    CONTROL_DISCOVERED,   // sane: the background device probe finished
+    CONTROL_TERMINATE     // SIGTERM, SIGINT
+};
+
+struct control_request {
+    enum control_cmd cmd;
+    bool waited;                      // the poster waits for it
+    const char* device;               // CONTROL_ACQUIRE, CONTROL_RELEASE:
+    // the device (name or number) or NULL for all devices
+    int fd;                           // CONTROL_SANED: the connection of
+    // the saned client, passed by scanbm
+    const hotplug_device_t* added;    // CONTROL_HOTPLUG only, owned by
+    int num_added;                    // the waiting poster
+    const hotplug_device_t* removed;
+    int num_removed;
+    bool failed;                      // the handler failed
+    bool done;                        // (guarded by the control mutex)
+    struct control_request* next;
+};
+typedef struct control_request control_request_t;
+
+// runs a command in the main thread, returns false if it failed
+typedef bool (*control_handler_t)(const control_request_t*);
+
+extern bool control_init(control_handler_t);
+extern void control_signal_handler(int);
+extern void control_loop(void);
+extern void control_stop(void);
+
+// the control socket: a client acquires the devices by the line
+// "acquire" and releases them by "release" (or by closing the
+// connection), the reply "ok" is sent when the command has run. Both
+// take an optional device name or number ("acquire 1") to stop only
+// this device. The line "saned" (with an optional device) carries the
+// client connection of scanbm (SCM_RIGHTS), a pre-forked helper runs
+// saned for it, the devices are acquired until saned exits.
+#define CONTROL_CMD_ACQUIRE "acquire"
+#define CONTROL_CMD_RELEASE "release"
+#define CONTROL_CMD_SANED   "saned"
+#define CONTROL_REPLY_OK    "ok"
+
+// the connected clients of the control socket
+#define CONTROL_MAX_CLIENTS 16
+
+extern bool control_listen(const char*, uid_t, gid_t);
+extern void control_unlisten(void);
+extern int control_connect(const char*);
+extern bool control_command(int, const char*, const char*);
+extern bool control_handoff(int, const char*, int);
+extern bool control_send_fd(int, const void*, size_t, int);
+extern bool control_adopt(int, const char*);
+
+extern void control_call(enum control_cmd);
+extern bool control_call_device(enum control_cmd, const char*);
+extern void control_notify(enum control_cmd);
+extern void control_hotplug(const hotplug_device_t*, int,
+                            const hotplug_device_t*, int);
+
+#endif
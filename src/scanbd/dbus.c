@@ -27,6 +27,37 @@
 static DBusConnection* conn = NULL;
 static pthread_t dbus_tid = 0;
 
+// the dbus main loop: libdbus registers the watches (fds) and timeouts
+// of the connection via the dbus_loop_* callbacks, the dbus_thread
+// serves them with poll(). The wakeup pipe interrupts the poll() if the
+// watches change, outgoing messages are queued or the thread has to stop.
+struct dbus_loop_timeout {
+    DBusTimeout* timeout;
+    struct timespec deadline;    // CLOCK_MONOTONIC
+};
+static pthread_mutex_t dbus_loop_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DBusWatch** dbus_loop_watches = NULL;
+static int dbus_loop_num_watches = 0;
+static struct dbus_loop_timeout* dbus_loop_timeouts = NULL;
+static int dbus_loop_num_timeouts = 0;
+static bool dbus_loop_stop = false;
+static bool dbus_loop_running = false;
+static int dbus_loop_pipe[2] = {-1, -1};
+
+// the signals queued by dbus_send_signal_async() and
+// dbus_send_signal_argv_async(), sent out by the dbus_thread
+// (guarded by dbus_loop_mutex)
+struct dbus_signal_entry {
+    DBusMessage* signal;
+    struct dbus_signal_entry* next;
+};
+static struct dbus_signal_entry* dbus_signal_queue_head = NULL;
+static struct dbus_signal_entry* dbus_signal_queue_tail = NULL;
+static int dbus_signal_queue_size = 0;
+#define DBUS_SIGNAL_QUEUE_MAX 1024
+
+static void dbus_loop_wakeup(void);
+
 #ifdef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
 // this is non-portable
 static pthread_mutex_t dbus_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
@@ -35,30 +66,16 @@ static pthread_mutex_t dbus_mutex;
 #endif
 
 
-void dbus_send_signal_argv(const char* signal_name, char** argv) {
-    // TODO: we need a better dbus mainloop integrations, so that we
-    // can wakeup the main thread to sendout the messages we generate here
-
+// creates the signal with the strings of argv as array argument
+static DBusMessage* dbus_new_signal_argv(const char* signal_name, char** argv) {
     DBusMessage* signal = NULL;
 
-    if (conn == NULL) {
-        if (!dbus_init()) {
-            return;
-        }
-    }
-    assert(conn);
-
-    if (!conn) {
-        slog(SLOG_DEBUG, "No dbus connection");
-        return;
-    }
-
     assert(signal_name != NULL);
     if ((signal = dbus_message_new_signal(SCANBD_DBUS_OBJECTPATH,
                                           SCANBD_DBUS_INTERFACE,
                                           signal_name)) == NULL) {
         slog(SLOG_ERROR, "Can't create signal");
-        return;
+        return NULL;
     }
 
     if (argv != NULL) {
@@ -81,23 +98,103 @@ void dbus_send_signal_argv(const char* signal_name, char** argv) {
             slog(SLOG_ERROR, "Can't close dbus container");
         }
     }
+    return signal;
+}
+
+// creates the signal with the (optional) string argument arg
+static DBusMessage* dbus_new_signal(const char* signal_name, const char* arg) {
+    DBusMessage* signal = NULL;
+
+    assert(signal_name != NULL);
+    if ((signal = dbus_message_new_signal(SCANBD_DBUS_OBJECTPATH,
+                                          SCANBD_DBUS_INTERFACE,
+                                          signal_name)) == NULL) {
+        slog(SLOG_ERROR, "Can't create signal");
+        return NULL;
+    }
+
+    if (arg != NULL) {
+        DBusMessageIter args;
+        dbus_message_iter_init_append(signal, &args);
+        slog(SLOG_DEBUG, "append string %s to signal %s", arg, signal_name);
+        if (dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &arg) != TRUE) {
+            slog(SLOG_ERROR, "Can't append signal argument");
+        }
+    }
+    return signal;
+}
 
-    slog(SLOG_DEBUG, "now sending signal %s", signal_name);
+// sends the signal and blocks until it is written out, consumes the
+// reference of the signal
+static void dbus_send_message(DBusMessage* signal) {
+    slog(SLOG_DEBUG, "now sending signal %s", dbus_message_get_member(signal));
+    if (!dbus_connection_get_is_connected(conn)) {
+        slog(SLOG_WARN, "dbus connection lost, dropping signal %s",
+             dbus_message_get_member(signal));
+        dbus_message_unref(signal);
+        return;
+    }
     dbus_uint32_t serial;
     if (dbus_connection_send(conn, signal, &serial) != TRUE) {
         slog(SLOG_ERROR, "Can't send signal");
     }
     slog(SLOG_DEBUG, "now flushing the dbus");
-    // TODO: with the standard-main loop this would block without
-    // using a timeout
     dbus_connection_flush(conn);
     slog(SLOG_DEBUG, "unref the signal");
     dbus_message_unref(signal);
 }
 
-void dbus_send_signal(const char* signal_name, const char* arg) {
-    DBusMessage* signal = NULL;
+// queues the signal for the dbus_thread, consumes the reference of the
+// signal. If the dbus_thread isn't running, the signal is sent at once.
+static void dbus_queue_message(DBusMessage* signal) {
+    struct dbus_signal_entry* entry = malloc(sizeof(struct dbus_signal_entry));
+    if (entry == NULL) {
+        slog(SLOG_ERROR, "Can't allocate signal queue entry");
+        dbus_message_unref(signal);
+        return;
+    }
+    entry->signal = signal;
+    entry->next = NULL;
+
+    pthread_mutex_lock(&dbus_loop_mutex);
+    if (!dbus_loop_running) {
+        pthread_mutex_unlock(&dbus_loop_mutex);
+        free(entry);
+        dbus_send_message(signal);
+        return;
+    }
+    if (dbus_signal_queue_size >= DBUS_SIGNAL_QUEUE_MAX) {
+        pthread_mutex_unlock(&dbus_loop_mutex);
+        slog(SLOG_WARN, "dbus signal queue full, dropping signal %s",
+             dbus_message_get_member(signal));
+        free(entry);
+        dbus_message_unref(signal);
+        return;
+    }
+    if (dbus_signal_queue_tail == NULL) {
+        dbus_signal_queue_head = entry;
+    }
+    else {
+        dbus_signal_queue_tail->next = entry;
+    }
+    dbus_signal_queue_tail = entry;
+    dbus_signal_queue_size += 1;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+}
+
+// takes all queued signals (in order)
+static struct dbus_signal_entry* dbus_signal_queue_take(void) {
+    pthread_mutex_lock(&dbus_loop_mutex);
+    struct dbus_signal_entry* entries = dbus_signal_queue_head;
+    dbus_signal_queue_head = NULL;
+    dbus_signal_queue_tail = NULL;
+    dbus_signal_queue_size = 0;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    return entries;
+}
 
+void dbus_send_signal_argv(const char* signal_name, char** argv) {
     if (conn == NULL) {
         if (!dbus_init()) {
             return;
@@ -110,161 +207,113 @@ void dbus_send_signal(const char* signal_name, const char* arg) {
         return;
     }
 
-    assert(signal_name != NULL);
-    if ((signal = dbus_message_new_signal(SCANBD_DBUS_OBJECTPATH,
-                                          SCANBD_DBUS_INTERFACE,
-                                          signal_name)) == NULL) {
-        slog(SLOG_ERROR, "Can't create signal");
+    DBusMessage* signal = dbus_new_signal_argv(signal_name, argv);
+    if (signal != NULL) {
+        dbus_send_message(signal);
+    }
+}
+
+void dbus_send_signal(const char* signal_name, const char* arg) {
+    if (conn == NULL) {
+        if (!dbus_init()) {
+            return;
+        }
+    }
+    assert(conn);
+
+    if (!conn) {
+        slog(SLOG_DEBUG, "No dbus connection");
         return;
     }
 
-    if (arg != NULL) {
-        DBusMessageIter args;
-        dbus_message_iter_init_append(signal, &args);
-        slog(SLOG_DEBUG, "append string %s to signal %s", arg, signal_name);
-        if (dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &arg) != TRUE) {
-            slog(SLOG_ERROR, "Can't append signal argument");
+    DBusMessage* signal = dbus_new_signal(signal_name, arg);
+    if (signal != NULL) {
+        dbus_send_message(signal);
+    }
+}
+
+// like dbus_send_signal_argv(), but doesn't wait for the bus: the
+// signal is sent out by the dbus_thread
+void dbus_send_signal_argv_async(const char* signal_name, char** argv) {
+    if (conn == NULL) {
+        if (!dbus_init()) {
+            return;
         }
     }
+    assert(conn);
 
-    dbus_uint32_t serial;
-    slog(SLOG_DEBUG, "now sending signal %s", signal_name);
-    if (dbus_connection_send(conn, signal, &serial) != TRUE) {
-        slog(SLOG_ERROR, "Can't send signal");
+    if (!conn) {
+        slog(SLOG_DEBUG, "No dbus connection");
+        return;
+    }
+
+    DBusMessage* signal = dbus_new_signal_argv(signal_name, argv);
+    if (signal != NULL) {
+        dbus_queue_message(signal);
+    }
+}
+
+// like dbus_send_signal(), but doesn't wait for the bus: the signal is
+// sent out by the dbus_thread
+void dbus_send_signal_async(const char* signal_name, const char* arg) {
+    if (conn == NULL) {
+        if (!dbus_init()) {
+            return;
+        }
+    }
+    assert(conn);
+
+    if (!conn) {
+        slog(SLOG_DEBUG, "No dbus connection");
+        return;
+    }
+
+    DBusMessage* signal = dbus_new_signal(signal_name, arg);
+    if (signal != NULL) {
+        dbus_queue_message(signal);
     }
-    dbus_connection_flush(conn);
-    dbus_message_unref(signal);
 }
 
 static void hook_device_ex(const char *param, const char *action_name, const char *dev_name) {
-    cfg_t* cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    cfg_t* c = cfg_acquire();
+    cfg_t* cfg_sec_global = cfg_getsec(c, C_GLOBAL);
     assert(cfg_sec_global);
     const char* script = cfg_getstr(cfg_sec_global, param);
 
     if (!script || (strlen(script) == 0)) {
         //script = SCANBD_NULL_STRING;
+        cfg_release(c);
         return; // No hook script, nothing for us to do here.
     }       
 
     cfg_t* global_envs = cfg_getsec(cfg_sec_global, C_ENVIRONMENT);
-    // number of env-vars =
-    // the values in the environment-section (2):
-    // device, action
-    // plus those 4:
-    // PATH, PWD, USER, HOME
-    // plus the sentinel
-    int number_of_envs = 4 + 2 + 1;
-    char** env = calloc(number_of_envs, sizeof(char*));
-    for(int e = 0; e < number_of_envs; e += 1) {
-        env[e] = calloc(NAME_MAX + 1, sizeof(char));
-    }
-    int e = 0;
-    const char* ev = "PATH";
-    if (getenv(ev) != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
-    }
-    else {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, "/usr/sbin:/usr/bin:/sbin:/bin");
-        slog(SLOG_DEBUG, "No PATH, setting env: %s", env[e]);
-        e += 1;
-    }
-    ev = "PWD";
-    if (getenv(ev) != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
-    }
-    else {
-        char buf[PATH_MAX];
-        char* ptr = getcwd(buf, PATH_MAX - 1);
-        if (!ptr) {
-            slog(SLOG_ERROR, "can't get pwd");
-        }
-        else {
-            assert(ptr);
-            snprintf(env[e], NAME_MAX, "%s=%s", ev, ptr);
-            slog(SLOG_DEBUG, "No PWD, setting env: %s", env[e]);
-            e += 1;
-        }
-    }
-    ev = "USER";
-    if (getenv(ev) != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
-    }
-    else {
-        struct passwd* pwd = NULL;
-        pwd = getpwuid(geteuid());
-        assert(pwd);
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_name);
-        slog(SLOG_DEBUG, "No USER, setting env: %s", env[e]);
-        e += 1;
-    }
-    ev = "HOME";
-    if (getenv(ev) != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
-    }
-    else {
-        struct passwd* pwd = 0;
-        pwd = getpwuid(geteuid());
-        assert(pwd);
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_dir);
-        slog(SLOG_DEBUG, "No HOME, setting env: %s", env[e]);
-        e += 1;
-    }
-    ev = cfg_getstr(global_envs, C_DEVICE);
+    // the environment: PATH, PWD, USER, HOME and the values in the
+    // environment-section (device, action)
+    launcher_env_t le;
+    launcher_env_init(&le);
+    launcher_env_add_defaults(&le);
+    const char* ev = cfg_getstr(global_envs, C_DEVICE);
     if (ev != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, dev_name);
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
+        launcher_env_add(&le, ev, "%s", dev_name);
     }
     ev = cfg_getstr(global_envs, C_ACTION);
     if (ev != NULL) {
-        snprintf(env[e], NAME_MAX, "%s=%s", ev, action_name);
-        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-        e += 1;
+        launcher_env_add(&le, ev, "%s", action_name);
     }
-    env[e] = NULL;
-    assert(e == number_of_envs-1);
+    char** env = launcher_env_finish(&le);
 
     char *script_abs = make_script_path_abs(script);
     assert(script_abs);
+    // the script and its environment are copies
+    cfg_release(c);
     if (strcmp(script_abs, SCANBD_NULL_STRING) != 0) {
-        pid_t cpid;
-        if ((cpid = fork()) < 0) {
-            slog(SLOG_ERROR, "Can't fork: %s", strerror(errno));
-        }
-        else if (cpid > 0) { // parent
-            slog(SLOG_INFO, "waiting for child: %s", script_abs);
-            int status;
-            if (waitpid(cpid, &status, 0) < 0) {
-                slog(SLOG_ERROR, "waitpid: %s", strerror(errno));
-            }
-            if (WIFEXITED(status)) {
-                slog(SLOG_INFO, "child %s exited with status: %d",
-                     script_abs, WEXITSTATUS(status));
-            }
-            if (WIFSIGNALED(status)) {
-                slog(SLOG_INFO, "child %s signaled with signal: %d",
-                     script_abs, WTERMSIG(status));
-            }
-        }
-        else { // child
-            slog(SLOG_DEBUG, "exec for %s", script_abs);
-            if (execle(script_abs, script_abs, NULL, env) < 0) {
-                slog(SLOG_ERROR, "execlp: %s", strerror(errno));
-            }
-            exit(EXIT_FAILURE); // not reached
-        }
+        // spawn the script and wait for its termination
+        launcher_run(script_abs, env);
     } // script_abs == SCANBD_NULL_STRING
 
     assert(script_abs != NULL);
     free(script_abs);
+    launcher_env_free(&le);
 }
 
 static void hook_device_insert(const char *dev_name) {
@@ -288,16 +337,14 @@ static void hal_device_added(LibHalContext* ctx, const char *udi) {
         // found new scanner
         slog(SLOG_INFO, "New Scanner: %s", udi);
 #ifdef USE_SANE
-        stop_sane_threads();
+        hook_device_insert(udi);
+
+        // only start polling the new devices, the others keep polling
+        update_sane_devices();
 #else
         stop_scbtn_threads();
-#endif
         slog(SLOG_DEBUG, "sane_exit");
-#ifdef USE_SANE
-        sane_exit();
-#else
         scbtn_shutdown();
-#endif
 
 #ifdef SANE_REINIT_TIMEOUT
         sleep(SANE_REINIT_TIMEOUT); // TODO: don't know if this is
@@ -306,12 +353,6 @@ static void hal_device_added(LibHalContext* ctx, const char *udi) {
 
         hook_device_insert(udi);
 
-        slog(SLOG_DEBUG, "sane_init");
-#ifdef USE_SANE
-        sane_init(NULL, NULL);
-        get_sane_devices();
-        start_sane_threads();
-#else
         if (scanbtnd_init() < 0) {
             slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
             exit(EXIT_FAILURE);
@@ -340,17 +381,15 @@ static void hal_device_removed(LibHalContext* ctx, const char *udi) {
         slog(SLOG_INFO, "Removed Scanner: %s", udi);
     }
 #ifdef USE_SANE
-    stop_sane_threads();
+    // only stop polling the vanished devices, the others keep polling
+    update_sane_devices();
+
+    hook_device_remove(udi);
 #else
     stop_scbtn_threads();
-#endif
 
     slog(SLOG_DEBUG, "sane_exit");
-#ifdef USE_SANE
-    sane_exit();
-#else
     scbtn_shutdown();
-#endif
 
 #ifdef SANE_REINIT_TIMEOUT
     sleep(SANE_REINIT_TIMEOUT);// TODO: don't know if this is really neccessary
@@ -358,12 +397,6 @@ static void hal_device_removed(LibHalContext* ctx, const char *udi) {
 
     hook_device_remove(udi);
 
-    slog(SLOG_DEBUG, "sane_init");
-#ifdef USE_SANE
-    sane_init(NULL, NULL);
-    get_sane_devices();
-    start_sane_threads();
-#else
     if (scanbtnd_init() < 0) {
         slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
         exit(EXIT_FAILURE);
@@ -376,39 +409,58 @@ static void hal_device_removed(LibHalContext* ctx, const char *udi) {
 }
 #endif
 
-// this function is used from dbus_thread and udev_thread
-void dbus_signal_device_added(void) {
+// handles a batch of hotplug events, run by the control loop of the
+// main thread for the dbus_thread and the udev_thread (see
+// control_hotplug()).
+// The hook scripts run for every device, but the devices are reconciled
+// only once for the whole batch
+void dbus_signal_devices_changed(const hotplug_device_t* added, int num_added,
+                                 const hotplug_device_t* removed, int num_removed) {
     if (pthread_mutex_lock(&dbus_mutex)) {
         slog(SLOG_ERROR, "Can't lock mutex");
     }
 #ifndef USE_HAL
-    slog(SLOG_DEBUG, "dbus_signal_device_added");
-    // look for new scanner
+    slog(SLOG_DEBUG, "dbus_signal_devices_changed: %d added, %d removed",
+         num_added, num_removed);
 #ifdef USE_SANE
-    stop_sane_threads();
+    // look for removed scanners:
+    // if the usb address identifies the polled device, stop only this
+    // one without rescanning, otherwise only stop polling the vanished
+    // devices, the others keep polling
+    bool rescan = (num_added > 0);
+    for(int i = 0; i < num_removed; i += 1) {
+        if (remove_sane_device(removed[i].busnum, removed[i].devnum) == 0) {
+            rescan = true;
+        }
+    }
+    for(int i = 0; i < num_removed; i += 1) {
+        hook_device_remove(removed[i].syspath ? removed[i].syspath : "dbus device");
+    }
+    // look for new scanners
+    for(int i = 0; i < num_added; i += 1) {
+        hook_device_insert(added[i].syspath ? added[i].syspath : "dbus device");
+    }
+    if (rescan) {
+        // only start polling the new devices, the others keep polling
+        update_sane_devices();
+    }
 #else
     stop_scbtn_threads();
-#endif // USE_SANE
     slog(SLOG_DEBUG, "sane_exit");
-#ifdef USE_SANE
-    sane_exit();
-#else
     scbtn_shutdown();
-#endif // USE_SANE
 
 #ifdef SANE_REINIT_TIMEOUT
     sleep(SANE_REINIT_TIMEOUT); // TODO: don't know if this is
     // really neccessary
 #endif
 
-    hook_device_insert("dbus device");
+    for(int i = 0; i < num_removed; i += 1) {
+        hook_device_remove(removed[i].syspath ? removed[i].syspath : "dbus device");
+    }
+    for(int i = 0; i < num_added; i += 1) {
+        hook_device_insert(added[i].syspath ? added[i].syspath : "dbus device");
+    }
 
-#ifdef USE_SANE
-    slog(SLOG_DEBUG, "sane_init");
-    sane_init(NULL, NULL);
-    get_sane_devices();
-    start_sane_threads();
-#else
     if (scanbtnd_init() < 0) {
         slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
         exit(EXIT_FAILURE);
@@ -418,78 +470,72 @@ void dbus_signal_device_added(void) {
     get_scbtn_devices();
     start_scbtn_threads();
 #endif // USE_SANE
+#else
+    (void)added;
+    (void)num_added;
+    (void)removed;
+    (void)num_removed;
 #endif // USE_HAL
     if (pthread_mutex_unlock(&dbus_mutex)) {
         slog(SLOG_ERROR, "Can't unlock mutex");
     }
 }
 
-void dbus_signal_device_removed(void) {
-    if (pthread_mutex_lock(&dbus_mutex)) {
-        slog(SLOG_ERROR, "Can't lock mutex");
-    }
-#ifndef USE_HAL
-    slog(SLOG_DEBUG, "dbus_signal_device_removed");
-    // look for removed scanner
-#ifdef USE_SANE
-    stop_sane_threads();
-#else
-    stop_scbtn_threads();
-#endif
-
-    slog(SLOG_DEBUG, "sane_exit");
-#ifdef USE_SANE
-    sane_exit();
-#else
-    scbtn_shutdown();
-#endif
+static const hotplug_device_t hotplug_device_unknown = {NULL, -1, -1, -1, -1};
 
-#ifdef SANE_REINIT_TIMEOUT
-    sleep(SANE_REINIT_TIMEOUT); // TODO: don't know if this is
-    // really neccessary
-#endif
+void dbus_signal_device_added(const hotplug_device_t* hd) {
+    control_hotplug(hd ? hd : &hotplug_device_unknown, 1, NULL, 0);
+}
 
-    hook_device_remove("dbus device");
+void dbus_signal_device_removed(const hotplug_device_t* hd) {
+    control_hotplug(NULL, 0, hd ? hd : &hotplug_device_unknown, 1);
+}
 
-    slog(SLOG_DEBUG, "sane_init");
-#ifdef USE_SANE
-    sane_init(NULL, NULL);
-    get_sane_devices();
-    start_sane_threads();
-#else
-    if (scanbtnd_init() < 0) {
-        slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
-        exit(EXIT_FAILURE);
+// the optional device argument (name or number) of acquire and release
+// returns NULL without argument
+static const char* dbus_method_device(DBusMessage* message) {
+    DBusMessageIter args;
+    if (!dbus_message_iter_init(message, &args)) {
+        return NULL;
     }
-    assert(backend);
-#endif
-
-#endif
-    if (pthread_mutex_unlock(&dbus_mutex)) {
-        slog(SLOG_ERROR, "Can't unlock mutex");
+    if (dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_STRING) {
+        slog(SLOG_WARN, "device argument has wrong type");
+        return NULL;
     }
+    const char* device = NULL;
+    dbus_message_iter_get_basic(&args, &device);
+    return device;
 }
 
 // is called when saned exited
-static void dbus_method_release(void) {
+static void dbus_method_release(DBusMessage* message) {
     slog(SLOG_DEBUG, "dbus_method_release");
+    const char* device = dbus_method_device(message);
+    if (device != NULL) {
+        // start the polling of this device
+        if (!control_call_device(CONTROL_RELEASE, device)) {
+            slog(SLOG_WARN, "Can't release device %s", device);
+        }
+        return;
+    }
     // start all threads
-#ifdef USE_SANE
-    start_sane_threads();
-#else
-    start_scbtn_threads();
-#endif
+    control_call(CONTROL_RELEASE);
 }
 
-// is called before saned started
-static void dbus_method_acquire(void) {
+// is called before saned started, the polling is stopped when the
+// method returns
+static void dbus_method_acquire(DBusMessage* message) {
     slog(SLOG_DEBUG, "dbus_method_acquire");
+    const char* device = dbus_method_device(message);
+    if (device != NULL) {
+        // stop only the polling of this device
+        if (!control_call_device(CONTROL_ACQUIRE, device)) {
+            slog(SLOG_WARN, "Can't acquire device %s", device);
+        }
+        return;
+    }
     // stop all threads
-#ifdef USE_SANE
-    stop_sane_threads();
-#else
-    stop_scbtn_threads();
-#endif
+    control_call(CONTROL_ACQUIRE);
 }
 
 struct sane_trigger_arg {
@@ -572,12 +618,12 @@ static DBusHandlerResult message_func(DBusConnection *connection, DBusMessage *m
     if (dbus_message_is_method_call(message,
                                     SCANBD_DBUS_INTERFACE,
                                     SCANBD_DBUS_METHOD_ACQUIRE)) {
-        dbus_method_acquire();
+        dbus_method_acquire(message);
     }
     else if (dbus_message_is_method_call(message,
                                          SCANBD_DBUS_INTERFACE,
                                          SCANBD_DBUS_METHOD_RELEASE)) {
-        dbus_method_release();
+        dbus_method_release(message);
     }
     else if (dbus_message_is_method_call(message,
                                          SCANBD_DBUS_INTERFACE,
@@ -587,12 +633,12 @@ static DBusHandlerResult message_func(DBusConnection *connection, DBusMessage *m
     else if (dbus_message_is_signal(message,
                                     DBUS_HAL_INTERFACE,
                                     DBUS_HAL_SIGNAL_DEV_ADDED)) {
-        dbus_signal_device_added();
+        dbus_signal_device_added(NULL);
     }
     else if (dbus_message_is_signal(message,
                                     DBUS_HAL_INTERFACE,
                                     DBUS_HAL_SIGNAL_DEV_REMOVED)) {
-        dbus_signal_device_removed();
+        dbus_signal_device_removed(NULL);
     }
 
     /* If the message was handled, send back the reply */
@@ -618,27 +664,323 @@ void dbus_thread_cleanup(void* arg) {
     (void)arg;
 }
 
+// wakes up the poll() of the dbus_thread
+static void dbus_loop_wakeup(void) {
+    if (dbus_loop_pipe[PIPE_WRITE] < 0) {
+        return;
+    }
+    char c = 0;
+    if (write(dbus_loop_pipe[PIPE_WRITE], &c, 1) < 0) {
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            slog(SLOG_WARN, "Can't wakeup dbus thread: %s", strerror(errno));
+        }
+    }
+}
+
+static void dbus_loop_wakeup_main(void* data) {
+    (void)data;
+    dbus_loop_wakeup();
+}
+
+static void dbus_loop_dispatch_status(DBusConnection* connection,
+                                      DBusDispatchStatus status, void* data) {
+    (void)connection;
+    (void)data;
+    if (status == DBUS_DISPATCH_DATA_REMAINS) {
+        dbus_loop_wakeup();
+    }
+}
+
+static dbus_bool_t dbus_loop_add_watch(DBusWatch* watch, void* data) {
+    (void)data;
+    pthread_mutex_lock(&dbus_loop_mutex);
+    DBusWatch** watches = realloc(dbus_loop_watches,
+                                  (dbus_loop_num_watches + 1) * sizeof(DBusWatch*));
+    if (watches == NULL) {
+        pthread_mutex_unlock(&dbus_loop_mutex);
+        slog(SLOG_ERROR, "Can't allocate dbus watch");
+        return FALSE;
+    }
+    dbus_loop_watches = watches;
+    dbus_loop_watches[dbus_loop_num_watches] = watch;
+    dbus_loop_num_watches += 1;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+    return TRUE;
+}
+
+static void dbus_loop_remove_watch(DBusWatch* watch, void* data) {
+    (void)data;
+    pthread_mutex_lock(&dbus_loop_mutex);
+    for(int i = 0; i < dbus_loop_num_watches; i += 1) {
+        if (dbus_loop_watches[i] == watch) {
+            dbus_loop_watches[i] = dbus_loop_watches[dbus_loop_num_watches - 1];
+            dbus_loop_num_watches -= 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+}
+
+static void dbus_loop_toggle_watch(DBusWatch* watch, void* data) {
+    (void)watch;
+    (void)data;
+    // the enabled flag is read when the poll set is built
+    dbus_loop_wakeup();
+}
+
+// this function can only be used in the critical region of dbus_loop_mutex
+static void dbus_loop_arm_timeout(struct dbus_loop_timeout* t) {
+    int interval = dbus_timeout_get_interval(t->timeout);
+    clock_gettime(CLOCK_MONOTONIC, &t->deadline);
+    t->deadline.tv_sec += interval / 1000;
+    t->deadline.tv_nsec += (interval % 1000) * 1000000L;
+    if (t->deadline.tv_nsec >= 1000000000L) {
+        t->deadline.tv_sec += 1;
+        t->deadline.tv_nsec -= 1000000000L;
+    }
+}
+
+static dbus_bool_t dbus_loop_add_timeout(DBusTimeout* timeout, void* data) {
+    (void)data;
+    pthread_mutex_lock(&dbus_loop_mutex);
+    struct dbus_loop_timeout* timeouts = realloc(dbus_loop_timeouts,
+                                                 (dbus_loop_num_timeouts + 1) *
+                                                 sizeof(struct dbus_loop_timeout));
+    if (timeouts == NULL) {
+        pthread_mutex_unlock(&dbus_loop_mutex);
+        slog(SLOG_ERROR, "Can't allocate dbus timeout");
+        return FALSE;
+    }
+    dbus_loop_timeouts = timeouts;
+    dbus_loop_timeouts[dbus_loop_num_timeouts].timeout = timeout;
+    dbus_loop_arm_timeout(&dbus_loop_timeouts[dbus_loop_num_timeouts]);
+    dbus_loop_num_timeouts += 1;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+    return TRUE;
+}
+
+static void dbus_loop_remove_timeout(DBusTimeout* timeout, void* data) {
+    (void)data;
+    pthread_mutex_lock(&dbus_loop_mutex);
+    for(int i = 0; i < dbus_loop_num_timeouts; i += 1) {
+        if (dbus_loop_timeouts[i].timeout == timeout) {
+            dbus_loop_timeouts[i] = dbus_loop_timeouts[dbus_loop_num_timeouts - 1];
+            dbus_loop_num_timeouts -= 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+}
+
+static void dbus_loop_toggle_timeout(DBusTimeout* timeout, void* data) {
+    (void)data;
+    pthread_mutex_lock(&dbus_loop_mutex);
+    for(int i = 0; i < dbus_loop_num_timeouts; i += 1) {
+        if (dbus_loop_timeouts[i].timeout == timeout) {
+            // restart the interval
+            dbus_loop_arm_timeout(&dbus_loop_timeouts[i]);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+}
+
+// installs the dbus_loop_* callbacks at the connection
+static bool dbus_loop_init(void) {
+    assert(conn);
+    if (dbus_loop_pipe[PIPE_READ] < 0) {
+        if (pipe(dbus_loop_pipe) < 0) {
+            slog(SLOG_ERROR, "Can't create dbus wakeup pipe: %s", strerror(errno));
+            return false;
+        }
+        for(int i = 0; i < 2; i += 1) {
+            fcntl(dbus_loop_pipe[i], F_SETFL, fcntl(dbus_loop_pipe[i], F_GETFL) | O_NONBLOCK);
+            fcntl(dbus_loop_pipe[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+    if (!dbus_connection_set_watch_functions(conn, dbus_loop_add_watch,
+                                             dbus_loop_remove_watch,
+                                             dbus_loop_toggle_watch, NULL, NULL)) {
+        slog(SLOG_ERROR, "Can't set dbus watch functions");
+        return false;
+    }
+    if (!dbus_connection_set_timeout_functions(conn, dbus_loop_add_timeout,
+                                               dbus_loop_remove_timeout,
+                                               dbus_loop_toggle_timeout, NULL, NULL)) {
+        slog(SLOG_ERROR, "Can't set dbus timeout functions");
+        return false;
+    }
+    dbus_connection_set_wakeup_main_function(conn, dbus_loop_wakeup_main, NULL, NULL);
+    dbus_connection_set_dispatch_status_function(conn, dbus_loop_dispatch_status,
+                                                 NULL, NULL);
+    return true;
+}
+
 static void* dbus_thread(void* arg) {
     (void)arg;
     // we only expect the main thread to handle signals
     sigset_t mask;
     sigfillset(&mask);
     pthread_sigmask(SIG_BLOCK, &mask, NULL);
-    
-    cfg_t* cfg_sec_global = NULL;
-    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
-    assert(cfg_sec_global);
 
-    int timeout = cfg_getint(cfg_sec_global, C_TIMEOUT);
-    if (timeout <= 0) {
-        timeout = C_TIMEOUT_DEF;
-    }
-    slog(SLOG_DEBUG, "timeout: %d ms", timeout);
+    struct pollfd* fds = NULL;
+    DBusWatch** watches = NULL;
+    int max_fds = 0;
 
-    while(dbus_connection_read_write_dispatch(conn, timeout)) {
-        //slog(SLOG_DEBUG, "Iteration on dbus call");
-        usleep(timeout * 1000);
+    while(true) {
+        // build the poll set from the enabled watches
+        pthread_mutex_lock(&dbus_loop_mutex);
+        if (dbus_loop_stop) {
+            pthread_mutex_unlock(&dbus_loop_mutex);
+            break;
+        }
+        if (max_fds < dbus_loop_num_watches + 1) {
+            max_fds = dbus_loop_num_watches + 1;
+            fds = realloc(fds, max_fds * sizeof(struct pollfd));
+            watches = realloc(watches, max_fds * sizeof(DBusWatch*));
+            assert((fds != NULL) && (watches != NULL));
+        }
+        int nfds = 0;
+        fds[nfds].fd = dbus_loop_pipe[PIPE_READ];
+        fds[nfds].events = POLLIN;
+        watches[nfds] = NULL;
+        nfds += 1;
+        for(int i = 0; i < dbus_loop_num_watches; i += 1) {
+            DBusWatch* w = dbus_loop_watches[i];
+            if (!dbus_watch_get_enabled(w)) {
+                continue;
+            }
+            unsigned int flags = dbus_watch_get_flags(w);
+            fds[nfds].fd = dbus_watch_get_unix_fd(w);
+            fds[nfds].events = 0;
+            if (flags & DBUS_WATCH_READABLE) {
+                fds[nfds].events |= POLLIN;
+            }
+            if (flags & DBUS_WATCH_WRITABLE) {
+                fds[nfds].events |= POLLOUT;
+            }
+            watches[nfds] = w;
+            nfds += 1;
+        }
+        // sleep until the earliest enabled timeout (or forever)
+        int poll_timeout = -1;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for(int i = 0; i < dbus_loop_num_timeouts; i += 1) {
+            if (!dbus_timeout_get_enabled(dbus_loop_timeouts[i].timeout)) {
+                continue;
+            }
+            long ms = (dbus_loop_timeouts[i].deadline.tv_sec - now.tv_sec) * 1000 +
+                    (dbus_loop_timeouts[i].deadline.tv_nsec - now.tv_nsec) / 1000000;
+            if (ms < 0) {
+                ms = 0;
+            }
+            if ((poll_timeout < 0) || (ms < poll_timeout)) {
+                poll_timeout = ms;
+            }
+        }
+        pthread_mutex_unlock(&dbus_loop_mutex);
+
+        if (poll(fds, nfds, poll_timeout) < 0) {
+            if (errno != EINTR) {
+                slog(SLOG_ERROR, "poll: %s", strerror(errno));
+            }
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            char buf[64];
+            while(read(dbus_loop_pipe[PIPE_READ], buf, sizeof(buf)) > 0);
+        }
+        // the watches are removed by libdbus only if the connection is
+        // closed, which doesn't happen while this thread runs
+        for(int i = 1; i < nfds; i += 1) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            unsigned int flags = 0;
+            if (fds[i].revents & POLLIN) {
+                flags |= DBUS_WATCH_READABLE;
+            }
+            if (fds[i].revents & POLLOUT) {
+                flags |= DBUS_WATCH_WRITABLE;
+            }
+            if (fds[i].revents & POLLERR) {
+                flags |= DBUS_WATCH_ERROR;
+            }
+            if (fds[i].revents & POLLHUP) {
+                flags |= DBUS_WATCH_HANGUP;
+            }
+            dbus_watch_handle(watches[i], flags);
+            if (!dbus_connection_get_is_connected(conn)) {
+                // the watches are gone
+                break;
+            }
+        }
+        // handle the expired timeouts
+        while(true) {
+            DBusTimeout* expired = NULL;
+            pthread_mutex_lock(&dbus_loop_mutex);
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            for(int i = 0; i < dbus_loop_num_timeouts; i += 1) {
+                struct dbus_loop_timeout* t = &dbus_loop_timeouts[i];
+                if (dbus_timeout_get_enabled(t->timeout) &&
+                        ((t->deadline.tv_sec < now.tv_sec) ||
+                         ((t->deadline.tv_sec == now.tv_sec) &&
+                          (t->deadline.tv_nsec <= now.tv_nsec)))) {
+                    expired = t->timeout;
+                    dbus_loop_arm_timeout(t);
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&dbus_loop_mutex);
+            if (expired == NULL) {
+                break;
+            }
+            dbus_timeout_handle(expired);
+        }
+        // send out the queued signals, the write watch does the I/O
+        struct dbus_signal_entry* entry = dbus_signal_queue_take();
+        while(entry != NULL) {
+            struct dbus_signal_entry* next = entry->next;
+            if (dbus_connection_send(conn, entry->signal, NULL) != TRUE) {
+                slog(SLOG_ERROR, "Can't send signal");
+            }
+            dbus_message_unref(entry->signal);
+            free(entry);
+            entry = next;
+        }
+        // dispatch all incoming messages
+        while(dbus_connection_dispatch(conn) == DBUS_DISPATCH_DATA_REMAINS);
+
+        if (!dbus_connection_get_is_connected(conn)) {
+            slog(SLOG_WARN, "dbus connection lost");
+            break;
+        }
+    }
+    // nobody drains the queue any more, the senders send synchronously
+    pthread_mutex_lock(&dbus_loop_mutex);
+    dbus_loop_running = false;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    if (!dbus_connection_get_is_connected(conn)) {
+        // the signals queued meanwhile can't be sent out any more
+        // (dbus_stop_dbus_thread() sends them if the thread is stopped)
+        struct dbus_signal_entry* entry = dbus_signal_queue_take();
+        while(entry != NULL) {
+            struct dbus_signal_entry* next = entry->next;
+            slog(SLOG_WARN, "dbus connection lost, dropping signal %s",
+                 dbus_message_get_member(entry->signal));
+            dbus_message_unref(entry->signal);
+            free(entry);
+            entry = next;
+        }
     }
+    free(fds);
+    free(watches);
     return NULL;
 }
 
@@ -765,8 +1107,21 @@ void dbus_start_dbus_thread(void) {
         slog(SLOG_DEBUG, "dbus thread already running");
         dbus_stop_dbus_thread();
     }
+    if (!dbus_loop_init()) {
+        return;
+    }
+    // set before the start, the thread clears it if the connection is
+    // lost
+    pthread_mutex_lock(&dbus_loop_mutex);
+    dbus_loop_stop = false;
+    dbus_loop_running = true;
+    pthread_mutex_unlock(&dbus_loop_mutex);
     if (pthread_create(&dbus_tid, NULL, dbus_thread, NULL) < 0){
         slog(SLOG_ERROR, "Can't create dbus thread: %s", strerror(errno));
+        pthread_mutex_lock(&dbus_loop_mutex);
+        dbus_loop_running = false;
+        pthread_mutex_unlock(&dbus_loop_mutex);
+        dbus_tid = 0;
         return;
     }
     return;
@@ -777,19 +1132,28 @@ void dbus_stop_dbus_thread(void) {
     if (dbus_tid == 0) {
         return;
     }
-    if (pthread_cancel(dbus_tid) < 0) {
-        if (errno == ESRCH) {
-            slog(SLOG_WARN, "dbus thread was already cancelled");
-        }
-        else {
-            slog(SLOG_WARN, "unknown error from pthread_cancel: %s", strerror(errno));
-        }
-    }
+    pthread_mutex_lock(&dbus_loop_mutex);
+    dbus_loop_stop = true;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    dbus_loop_wakeup();
+
     slog(SLOG_DEBUG, "join dbus thread");
     if (pthread_join(dbus_tid, NULL) < 0) {
         slog(SLOG_ERROR, "pthread_join: %s", strerror(errno));
     }
     dbus_tid = 0;
+
+    // send out the signals still queued
+    pthread_mutex_lock(&dbus_loop_mutex);
+    dbus_loop_running = false;
+    pthread_mutex_unlock(&dbus_loop_mutex);
+    struct dbus_signal_entry* entry = dbus_signal_queue_take();
+    while(entry != NULL) {
+        struct dbus_signal_entry* next = entry->next;
+        dbus_send_message(entry->signal);
+        free(entry);
+        entry = next;
+    }
 }
 
 void dbus_call_method(const char* method, const char* value) {
@@ -819,7 +1183,7 @@ void dbus_call_method(const char* method, const char* value) {
     if (value != NULL) {
         DBusMessageIter args;
         dbus_message_iter_init_append(msg, &args);
-        if (dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, value) != TRUE) {
+        if (dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &value) != TRUE) {
             slog(SLOG_ERROR, "Can't compose message");
             return;
         }
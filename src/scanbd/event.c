@@ -0,0 +1,53 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "event.h"
+
+// zeroed memory is an empty ring as well
+void event_ring_init(event_ring_t* ring) {
+    memset(ring, 0, sizeof(event_ring_t));
+}
+
+// appends the transition from -> to
+// returns false if the ring is full, the transition is dropped
+bool event_ring_push(event_ring_t* ring, unsigned long from, unsigned long to) {
+    if (ring->head - ring->tail >= EVENT_RING_SIZE) {
+        ring->dropped += 1;
+        return false;
+    }
+    event_transition_t* ev = &ring->events[ring->head % EVENT_RING_SIZE];
+    ev->from = from;
+    ev->to = to;
+    ring->head += 1;
+    return true;
+}
+
+// takes the oldest transition
+// returns false if the ring is empty
+bool event_ring_pop(event_ring_t* ring, event_transition_t* ev) {
+    if (ring->tail == ring->head) {
+        return false;
+    }
+    *ev = ring->events[ring->tail % EVENT_RING_SIZE];
+    ring->tail += 1;
+    return true;
+}
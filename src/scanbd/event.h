@@ -0,0 +1,56 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include "common.h"
+
+// the value transitions of a watched button since the last poll cycle:
+// a backend latching the presses reports a press (0 -> 1 -> 0) per read,
+// a level read a single transition. The ring
+// is filled and drained by the poll thread of the device, so it is only
+// used in the critical region of the device.
+
+// the transitions kept per option, a power of 2
+#define EVENT_RING_SIZE 16
+
+// a transition of the option value (from -> to)
+struct event_transition {
+    unsigned long from;
+    unsigned long to;
+};
+typedef struct event_transition event_transition_t;
+
+struct event_ring {
+    event_transition_t events[EVENT_RING_SIZE];
+    unsigned int head;           // the next transition to push
+    unsigned int tail;           // the next transition to pop
+    unsigned int dropped;        // the transitions lost while full
+};
+typedef struct event_ring event_ring_t;
+
+extern void event_ring_init(event_ring_t*);
+extern bool event_ring_push(event_ring_t*, unsigned long, unsigned long);
+extern bool event_ring_pop(event_ring_t*, event_transition_t*);
+
+#endif
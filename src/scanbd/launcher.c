@@ -0,0 +1,668 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "launcher.h"
+#include "slog.h"
+
+#include <spawn.h>
+
+// the children started by launcher_spawn(), if the reaper thread isn't
+// running, launcher_wait() reaps the child itself
+struct launcher_child {
+    pid_t pid;
+    bool reaped;
+    bool failed;
+    int status;
+    launcher_done_t done;  // completion callback of launcher_spawn_async()
+    void* arg;
+};
+
+static pthread_mutex_t launcher_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t launcher_cv = PTHREAD_COND_INITIALIZER;
+static struct launcher_child* launcher_children = NULL;
+static int num_launcher_children = 0;
+static int launcher_children_capacity = 0;
+
+static pthread_t launcher_tid = 0;
+static bool launcher_running = false;
+static bool launcher_stopping = false;
+
+// SIGCHLD handler -> reaper thread
+static int launcher_pipe[2] = {-1, -1};
+
+static struct sigaction launcher_old_sa;
+
+extern char** environ;
+
+static void launcher_sigchld_handler(int signal) {
+    (void)signal;
+    // only async-signal-safe calls here
+    int saved_errno = errno;
+    if (write(launcher_pipe[PIPE_WRITE], "c", 1) < 0) {
+        // pipe full: the reaper is woken up anyway
+    }
+    errno = saved_errno;
+}
+
+static void launcher_wakeup(void) {
+    if (write(launcher_pipe[PIPE_WRITE], "w", 1) < 0) {
+        if (errno != EAGAIN) {
+            slog(SLOG_WARN, "Can't wake up the launcher: %s", strerror(errno));
+        }
+    }
+}
+
+// must be called with launcher_mutex held
+// the reaped children with a completion callback are removed from the
+// table and returned in done, the callbacks are called by the caller
+// without holding the mutex
+static int launcher_reap(struct launcher_child* done, int max_done) {
+    bool reaped = false;
+    int num_done = 0;
+    for(int i = 0; i < num_launcher_children; i += 1) {
+        if (num_done == max_done) {
+            // done[] is full, the rest is reaped by the next pass,
+            // otherwise a reaped child with a callback would be lost
+            break;
+        }
+        struct launcher_child* c = &launcher_children[i];
+        if (c->reaped) {
+            continue;
+        }
+        pid_t pid = waitpid(c->pid, &c->status, WNOHANG);
+        if (pid == c->pid) {
+            c->reaped = true;
+        }
+        else if ((pid < 0) && (errno != EINTR)) {
+            slog(SLOG_ERROR, "waitpid for child %d: %s", c->pid, strerror(errno));
+            c->failed = true;
+            c->reaped = true;
+        }
+        if (!c->reaped) {
+            continue;
+        }
+        if (c->done) {
+            done[num_done] = *c;
+            num_done += 1;
+            *c = launcher_children[num_launcher_children - 1];
+            num_launcher_children -= 1;
+            i -= 1;
+        }
+        else {
+            reaped = true;
+        }
+    }
+    if (reaped) {
+        if (pthread_cond_broadcast(&launcher_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+        }
+    }
+    return num_done;
+}
+
+static void launcher_call_done(const struct launcher_child* c) {
+    c->done(c->pid, c->failed ? -1 : c->status, c->arg);
+}
+
+static void* launcher_thread(void* arg) {
+    (void)arg;
+    slog(SLOG_DEBUG, "launcher thread started");
+    // we only expect the main thread to handle signals, but SIGCHLD may
+    // also be handled here, so the reaper doesn't depend on the signal
+    // mask of the main thread
+    sigset_t mask;
+    sigfillset(&mask);
+    sigdelset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+    while(true) {
+        struct pollfd pfd;
+        pfd.fd = launcher_pipe[PIPE_READ];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno != EINTR) {
+                slog(SLOG_ERROR, "poll: %s", strerror(errno));
+            }
+            continue;
+        }
+        char buf[64];
+        while(read(launcher_pipe[PIPE_READ], buf, sizeof(buf)) > 0) {
+            // drain
+        }
+        if (pthread_mutex_lock(&launcher_mutex)) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        }
+        struct launcher_child done[LAUNCHER_MAX_DONE];
+        int num_done = 0;
+        do {
+            num_done = launcher_reap(done, LAUNCHER_MAX_DONE);
+            if (pthread_mutex_unlock(&launcher_mutex)) {
+                slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+            }
+            for(int i = 0; i < num_done; i += 1) {
+                launcher_call_done(&done[i]);
+            }
+            if (pthread_mutex_lock(&launcher_mutex)) {
+                slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            }
+        } while(num_done == LAUNCHER_MAX_DONE);
+        const bool stop = launcher_stopping;
+        if (pthread_mutex_unlock(&launcher_mutex)) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+        if (stop) {
+            break;
+        }
+    }
+    slog(SLOG_DEBUG, "launcher thread stopped");
+    return NULL;
+}
+
+void launcher_start(void) {
+    slog(SLOG_DEBUG, "start launcher thread");
+    if (launcher_running) {
+        slog(SLOG_DEBUG, "launcher thread already running");
+        return;
+    }
+    if (pipe(launcher_pipe) < 0) {
+        slog(SLOG_ERROR, "Can't create launcher pipe: %s", strerror(errno));
+        return;
+    }
+    for(int i = 0; i < 2; i += 1) {
+        int flags = fcntl(launcher_pipe[i], F_GETFL, 0);
+        if ((flags < 0) || (fcntl(launcher_pipe[i], F_SETFL, flags | O_NONBLOCK) < 0)) {
+            slog(SLOG_WARN, "Can't set launcher pipe to non-blocking mode: %s", strerror(errno));
+        }
+        if (fcntl(launcher_pipe[i], F_SETFD, FD_CLOEXEC) < 0) {
+            slog(SLOG_WARN, "Can't set close-on-exec on launcher pipe: %s", strerror(errno));
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(struct sigaction));
+    sa.sa_handler = launcher_sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    if (sigaction(SIGCHLD, &sa, &launcher_old_sa) < 0) {
+        slog(SLOG_ERROR, "Can't install signalhandler for SIGCHLD: %s", strerror(errno));
+        goto fail;
+    }
+
+    launcher_stopping = false;
+    if (pthread_create(&launcher_tid, NULL, launcher_thread, NULL)) {
+        slog(SLOG_ERROR, "Can't create launcher thread: %s", strerror(errno));
+        sigaction(SIGCHLD, &launcher_old_sa, NULL);
+        goto fail;
+    }
+    launcher_running = true;
+    return;
+fail:
+    close(launcher_pipe[PIPE_READ]);
+    close(launcher_pipe[PIPE_WRITE]);
+    launcher_pipe[PIPE_READ] = launcher_pipe[PIPE_WRITE] = -1;
+}
+
+void launcher_stop(void) {
+    slog(SLOG_DEBUG, "stop launcher thread");
+    if (!launcher_running) {
+        slog(SLOG_DEBUG, "no launcher thread to stop");
+        return;
+    }
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    launcher_stopping = true;
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    launcher_wakeup();
+    if (pthread_join(launcher_tid, NULL)) {
+        slog(SLOG_ERROR, "pthread_join: %s", strerror(errno));
+    }
+    launcher_tid = 0;
+
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    launcher_running = false;
+    sigaction(SIGCHLD, &launcher_old_sa, NULL);
+    close(launcher_pipe[PIPE_READ]);
+    close(launcher_pipe[PIPE_WRITE]);
+    launcher_pipe[PIPE_READ] = launcher_pipe[PIPE_WRITE] = -1;
+    // threads still waiting reap their children themselves
+    if (pthread_cond_broadcast(&launcher_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// spawns the child and records it in the child table
+static pid_t launcher_spawn_child(const char* path, char* const* env,
+                                  launcher_done_t done, void* arg) {
+    assert(path);
+    slog(SLOG_DEBUG, "spawn %s", path);
+
+    posix_spawnattr_t attr;
+    if (posix_spawnattr_init(&attr)) {
+        slog(SLOG_ERROR, "posix_spawnattr_init failed");
+        return -1;
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigfillset(&defaults);
+    sigdelset(&defaults, SIGKILL);
+    sigdelset(&defaults, SIGSTOP);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    char* const argv[] = {(char*)path, NULL};
+
+    // register the child before the reaper can see its SIGCHLD
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    pid_t pid = -1;
+    if (num_launcher_children >= launcher_children_capacity) {
+        int capacity = launcher_children_capacity > 0 ? 2 * launcher_children_capacity : 8;
+        struct launcher_child* children = realloc(launcher_children,
+                                                  capacity * sizeof(struct launcher_child));
+        if (children == NULL) {
+            slog(SLOG_ERROR, "Can't allocate memory for child table");
+            goto cleanup;
+        }
+        launcher_children = children;
+        launcher_children_capacity = capacity;
+    }
+    int rc = posix_spawn(&pid, path, NULL, &attr, argv, env ? env : environ);
+    if (rc != 0) {
+        slog(SLOG_ERROR, "Can't spawn %s: %s", path, strerror(rc));
+        pid = -1;
+        goto cleanup;
+    }
+    struct launcher_child* c = &launcher_children[num_launcher_children];
+    c->pid = pid;
+    c->reaped = false;
+    c->failed = false;
+    c->status = 0;
+    c->done = done;
+    c->arg = arg;
+    num_launcher_children += 1;
+cleanup:
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    posix_spawnattr_destroy(&attr);
+    return pid;
+}
+
+// starts the script with the given environment, the child has the
+// default signal dispositions and an empty signal mask, even if the
+// calling thread blocks all signals.
+// returns the pid of the child or -1
+pid_t launcher_spawn(const char* path, char* const* env) {
+    return launcher_spawn_child(path, env, NULL, NULL);
+}
+
+// starts the script like launcher_spawn(), but nobody waits for it:
+// done(pid, wait status, arg) is called by the reaper thread when the
+// child terminated (wait status -1 if it can't be reaped).
+// Without the reaper thread this waits for the child and calls done
+// before returning.
+// returns the pid of the child or -1, then done isn't called
+pid_t launcher_spawn_async(const char* path, char* const* env,
+                           launcher_done_t done, void* arg) {
+    assert(done);
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    const bool running = launcher_running;
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (!running) {
+        pid_t pid = launcher_spawn(path, env);
+        if (pid >= 0) {
+            int status = 0;
+            if (launcher_wait(pid, &status) < 0) {
+                status = -1;
+            }
+            done(pid, status, arg);
+        }
+        return pid;
+    }
+    return launcher_spawn_child(path, env, done, arg);
+}
+
+// records a child forked by the caller, the reaper thread reaps it and
+// calls done(pid, wait status, arg) like for launcher_spawn_async().
+// Without the reaper thread the child isn't waited for.
+void launcher_adopt(pid_t pid, launcher_done_t done, void* arg) {
+    assert(done);
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (!launcher_running) {
+        goto cleanup;
+    }
+    if (num_launcher_children >= launcher_children_capacity) {
+        int capacity = launcher_children_capacity > 0 ? 2 * launcher_children_capacity : 8;
+        struct launcher_child* children = realloc(launcher_children,
+                                                  capacity * sizeof(struct launcher_child));
+        if (children == NULL) {
+            slog(SLOG_ERROR, "Can't allocate memory for child table");
+            goto cleanup;
+        }
+        launcher_children = children;
+        launcher_children_capacity = capacity;
+    }
+    struct launcher_child* c = &launcher_children[num_launcher_children];
+    c->pid = pid;
+    c->reaped = false;
+    c->failed = false;
+    c->status = 0;
+    c->done = done;
+    c->arg = arg;
+    num_launcher_children += 1;
+    // the child may have exited already
+    launcher_wakeup();
+cleanup:
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// must be called with launcher_mutex held
+static struct launcher_child* launcher_find(pid_t pid) {
+    for(int i = 0; i < num_launcher_children; i += 1) {
+        if (launcher_children[i].pid == pid) {
+            return &launcher_children[i];
+        }
+    }
+    return NULL;
+}
+
+// waits for the termination of a child started by launcher_spawn()
+// returns 0 and the wait status or -1
+int launcher_wait(pid_t pid, int* status) {
+    if (pthread_mutex_lock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    int ret = -1;
+    struct launcher_child* c = NULL;
+    while(((c = launcher_find(pid)) != NULL) && !c->reaped) {
+        if (!launcher_running) {
+            // no reaper, do it ourselves without blocking the others
+            if (pthread_mutex_unlock(&launcher_mutex)) {
+                slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+            }
+            int s = 0;
+            pid_t r = -1;
+            while(((r = waitpid(pid, &s, 0)) < 0) && (errno == EINTR)) {
+                // restart
+            }
+            if (r < 0) {
+                slog(SLOG_ERROR, "waitpid for child %d: %s", pid, strerror(errno));
+            }
+            if (pthread_mutex_lock(&launcher_mutex)) {
+                slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            }
+            if ((c = launcher_find(pid)) != NULL) {
+                c->status = s;
+                c->failed = (r < 0);
+                c->reaped = true;
+            }
+            break;
+        }
+        if (pthread_cond_wait(&launcher_cv, &launcher_mutex)) {
+            slog(SLOG_ERROR, "pthread_cond_wait: %s", strerror(errno));
+        }
+    }
+    if (c == NULL) {
+        slog(SLOG_ERROR, "no such child: %d", pid);
+    }
+    else {
+        if (status) {
+            *status = c->status;
+        }
+        ret = c->failed ? -1 : 0;
+        // remove the entry
+        *c = launcher_children[num_launcher_children - 1];
+        num_launcher_children -= 1;
+    }
+    if (pthread_mutex_unlock(&launcher_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return ret;
+}
+
+// starts the script and waits for its termination
+// returns the wait status or -1
+int launcher_run(const char* path, char* const* env) {
+    pid_t pid = launcher_spawn(path, env);
+    if (pid < 0) {
+        return -1;
+    }
+    slog(SLOG_INFO, "waiting for child: %s", path);
+    int status = 0;
+    if (launcher_wait(pid, &status) < 0) {
+        return -1;
+    }
+    if (WIFEXITED(status)) {
+        slog(SLOG_INFO, "child %s exited with status: %d",
+             path, WEXITSTATUS(status));
+    }
+    if (WIFSIGNALED(status)) {
+        slog(SLOG_INFO, "child %s signaled with signal: %d",
+             path, WTERMSIG(status));
+    }
+    return status;
+}
+
+// the snapshot of the static variables of the script environment
+static pthread_mutex_t launcher_env_mutex = PTHREAD_MUTEX_INITIALIZER;
+static launcher_env_t launcher_static_env = {NULL, 0, 0, 0, NULL};
+static bool launcher_static_env_valid = false;
+
+void launcher_env_init(launcher_env_t* le) {
+    assert(le);
+    le->arena = NULL;
+    le->size = 0;
+    le->capacity = 0;
+    le->num_envs = 0;
+    le->env = NULL;
+}
+
+// removes all strings, the arena is kept for the next environment
+void launcher_env_reset(launcher_env_t* le) {
+    assert(le);
+    le->size = 0;
+    le->num_envs = 0;
+    le->env = NULL;
+}
+
+void launcher_env_free(launcher_env_t* le) {
+    assert(le);
+    free(le->arena);
+    launcher_env_init(le);
+}
+
+static void launcher_env_reserve(launcher_env_t* le, size_t size) {
+    if (size <= le->capacity) {
+        return;
+    }
+    size_t capacity = (le->capacity > 0) ? le->capacity : 512;
+    while(capacity < size) {
+        capacity *= 2;
+    }
+    le->arena = realloc(le->arena, capacity);
+    assert(le->arena);
+    le->capacity = capacity;
+}
+
+// appends name=value, the value is formatted like printf() and isn't
+// truncated
+void launcher_env_add(launcher_env_t* le, const char* name, const char* format, ...) {
+    assert(le);
+    assert(name);
+    assert(format);
+    le->env = NULL;
+
+    size_t name_len = strlen(name);
+    va_list ap;
+    va_start(ap, format);
+    int value_len = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (value_len < 0) {
+        slog(SLOG_ERROR, "Can't format the value of env-var %s", name);
+        return;
+    }
+    launcher_env_reserve(le, le->size + name_len + 1 + value_len + 1);
+
+    char* var = le->arena + le->size;
+    memcpy(var, name, name_len);
+    var[name_len] = '=';
+    va_start(ap, format);
+    vsnprintf(var + name_len + 1, value_len + 1, format, ap);
+    va_end(ap);
+    le->size += name_len + 1 + value_len + 1;
+    le->num_envs += 1;
+    slog(SLOG_DEBUG, "setting env: %s", var);
+}
+
+// the variables every script gets: PATH, PWD, USER, HOME
+// (taken from our environment, or the defaults if not set)
+static void launcher_env_add_static(launcher_env_t* le) {
+    const char* ev = "PATH";
+    if (getenv(ev) != NULL) {
+        launcher_env_add(le, ev, "%s", getenv(ev));
+    }
+    else {
+        slog(SLOG_DEBUG, "No PATH, using the default");
+        launcher_env_add(le, ev, "%s", "/usr/sbin:/usr/bin:/sbin:/bin");
+    }
+    ev = "PWD";
+    if (getenv(ev) != NULL) {
+        launcher_env_add(le, ev, "%s", getenv(ev));
+    }
+    else {
+        char buf[PATH_MAX];
+        char* ptr = getcwd(buf, PATH_MAX - 1);
+        if (!ptr) {
+            slog(SLOG_ERROR, "can't get pwd");
+        }
+        else {
+            slog(SLOG_DEBUG, "No PWD, using the working directory");
+            launcher_env_add(le, ev, "%s", ptr);
+        }
+    }
+    struct passwd* pwd = NULL;
+    ev = "USER";
+    if (getenv(ev) != NULL) {
+        launcher_env_add(le, ev, "%s", getenv(ev));
+    }
+    else {
+        pwd = getpwuid(geteuid());
+        assert(pwd);
+        slog(SLOG_DEBUG, "No USER, using the effective user");
+        launcher_env_add(le, ev, "%s", pwd->pw_name);
+    }
+    ev = "HOME";
+    if (getenv(ev) != NULL) {
+        launcher_env_add(le, ev, "%s", getenv(ev));
+    }
+    else {
+        if (pwd == NULL) {
+            pwd = getpwuid(geteuid());
+        }
+        assert(pwd);
+        slog(SLOG_DEBUG, "No HOME, using the home of the effective user");
+        launcher_env_add(le, ev, "%s", pwd->pw_dir);
+    }
+}
+
+// takes the snapshot of the static variables (see
+// launcher_env_add_static()), this must be repeated if our environment,
+// working directory or effective uid changes
+void launcher_env_snapshot(void) {
+    slog(SLOG_DEBUG, "snapshot of the script environment");
+    launcher_env_t le;
+    launcher_env_init(&le);
+    // the lookups (getpwuid() may block) are done outside the mutex
+    launcher_env_add_static(&le);
+
+    if (pthread_mutex_lock(&launcher_env_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    launcher_env_t old = launcher_static_env;
+    launcher_static_env = le;
+    launcher_static_env_valid = true;
+    if (pthread_mutex_unlock(&launcher_env_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    launcher_env_free(&old);
+}
+
+// appends the static variables from the snapshot, no lookups are done
+// on the way from the trigger to the script
+void launcher_env_add_defaults(launcher_env_t* le) {
+    assert(le);
+    if (pthread_mutex_lock(&launcher_env_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (!launcher_static_env_valid) {
+        // no snapshot yet
+        launcher_env_add_static(&launcher_static_env);
+        launcher_static_env_valid = true;
+    }
+    le->env = NULL;
+    launcher_env_reserve(le, le->size + launcher_static_env.size);
+    memcpy(le->arena + le->size, launcher_static_env.arena, launcher_static_env.size);
+    le->size += launcher_static_env.size;
+    le->num_envs += launcher_static_env.num_envs;
+    if (pthread_mutex_unlock(&launcher_env_mutex)) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// appends the pointer array (with the sentinel) to the arena and
+// returns it, no more strings may be added while it is used
+char** launcher_env_finish(launcher_env_t* le) {
+    assert(le);
+    // the pointers are aligned behind the strings
+    size_t offset = (le->size + sizeof(char*) - 1) / sizeof(char*) * sizeof(char*);
+    launcher_env_reserve(le, offset + (le->num_envs + 1) * sizeof(char*));
+
+    char** env = (char**) (le->arena + offset);
+    char* var = le->arena;
+    for(int e = 0; e < le->num_envs; e += 1) {
+        env[e] = var;
+        var += strlen(var) + 1;
+    }
+    env[le->num_envs] = NULL;
+    le->env = env;
+    return env;
+}
@@ -0,0 +1,68 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include "common.h"
+
+// the launcher starts the action and hook scripts with posix_spawn()
+// and reaps them asynchronously: SIGCHLD wakes the reaper thread via
+// a self-pipe, the waiting threads are signalled by a condition variable
+
+// completion callback: pid, wait status (-1 on errors), argument
+typedef void (*launcher_done_t)(pid_t, int, void*);
+
+// the completion callbacks called per wakeup of the reaper thread
+#define LAUNCHER_MAX_DONE 16
+
+extern void launcher_start(void);
+extern void launcher_stop(void);
+
+extern pid_t launcher_spawn(const char*, char* const*);
+extern pid_t launcher_spawn_async(const char*, char* const*, launcher_done_t, void*);
+extern void launcher_adopt(pid_t, launcher_done_t, void*);
+extern int launcher_wait(pid_t, int*);
+extern int launcher_run(const char*, char* const*);
+
+// the environment of a script: all "NAME=value" strings are stored in
+// one growing arena, the NULL-terminated array of pointers is appended
+// to the arena by launcher_env_finish()
+struct launcher_env {
+    char* arena;
+    size_t size;      // used bytes of the arena
+    size_t capacity;  // allocated bytes of the arena
+    int num_envs;     // number of strings (without the sentinel)
+    char** env;       // the environment, only valid after
+    // launcher_env_finish() and until the next launcher_env_add()
+};
+typedef struct launcher_env launcher_env_t;
+
+extern void launcher_env_init(launcher_env_t*);
+extern void launcher_env_reset(launcher_env_t*);
+extern void launcher_env_free(launcher_env_t*);
+extern void launcher_env_add(launcher_env_t*, const char*, const char*, ...);
+extern void launcher_env_snapshot(void);
+extern void launcher_env_add_defaults(launcher_env_t*);
+extern char** launcher_env_finish(launcher_env_t*);
+
+#endif // LAUNCHER_H
@@ -0,0 +1,131 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pattern.h"
+
+// the characters with a special meaning in an extended regex
+static const char pattern_special[] = ".[]()*+?{}|^$\\";
+
+// is the character at pos of s escaped by a backslash?
+static bool pattern_escaped(const char* s, size_t pos) {
+    size_t n = 0;
+    while((n < pos) && (s[pos - n - 1] == '\\')) {
+        n += 1;
+    }
+    return (n % 2) == 1;
+}
+
+// copies the literal s (len bytes) to out (len + 1 bytes) without the
+// escaping backslashes ("foo\.bar" -> "foo.bar")
+// returns the length of the literal or -1 if s isn't a literal
+static int pattern_unescape(const char* s, size_t len, char* out) {
+    size_t n = 0;
+    for(size_t i = 0; i < len; i += 1) {
+        if (s[i] == '\\') {
+            i += 1;
+            // only the special characters are literals if escaped
+            if ((i == len) || (strchr(pattern_special, s[i]) == NULL)) {
+                return -1;
+            }
+        }
+        else if (strchr(pattern_special, s[i]) != NULL) {
+            return -1;
+        }
+        out[n] = s[i];
+        n += 1;
+    }
+    out[n] = '\0';
+    return (int) n;
+}
+
+// classifies the pattern source (compiled to reg)
+void pattern_compile(pattern_t* pat, const char* source, const regex_t* reg) {
+    pat->source = source;
+    pat->reg = reg;
+    pat->literal = NULL;
+    pat->len = 0;
+
+    size_t len = strlen(source);
+    bool anchored = (len > 0) && (source[0] == '^');
+    const char* lit = anchored ? source + 1 : source;
+    size_t lit_len = anchored ? len - 1 : len;
+    bool anchored_end = false;
+    if ((lit_len >= 2) && (strcmp(lit + lit_len - 2, ".*") == 0) &&
+            !pattern_escaped(lit, lit_len - 2)) {
+        lit_len -= 2;
+    }
+    else if ((lit_len >= 1) && (lit[lit_len - 1] == '$') &&
+             !pattern_escaped(lit, lit_len - 1)) {
+        anchored_end = true;
+        lit_len -= 1;
+    }
+    if (anchored_end && !anchored) {
+        pat->kind = PATTERN_REGEX;
+        return;
+    }
+    char* literal = malloc(lit_len + 1);
+    assert(literal != NULL);
+    int n = pattern_unescape(lit, lit_len, literal);
+    if (n < 0) {
+        free(literal);
+        pat->kind = PATTERN_REGEX;
+        return;
+    }
+    if (anchored && anchored_end) {
+        pat->kind = PATTERN_EXACT;
+    }
+    else if (n == 0) {
+        free(literal);
+        pat->kind = PATTERN_ANY;
+        return;
+    }
+    else if (anchored) {
+        pat->kind = PATTERN_PREFIX;
+    }
+    else {
+        pat->kind = PATTERN_SUBSTRING;
+    }
+    pat->literal = literal;
+    pat->len = (size_t) n;
+}
+
+void pattern_free(pattern_t* pat) {
+    free(pat->literal);
+    pat->literal = NULL;
+}
+
+// matches the string str of length len
+bool pattern_match(const pattern_t* pat, const char* str, size_t len) {
+    switch(pat->kind) {
+    case PATTERN_ANY:
+        return true;
+    case PATTERN_EXACT:
+        return (len == pat->len) && (memcmp(str, pat->literal, pat->len) == 0);
+    case PATTERN_PREFIX:
+        return (len >= pat->len) && (memcmp(str, pat->literal, pat->len) == 0);
+    case PATTERN_SUBSTRING:
+        return strstr(str, pat->literal) != NULL;
+    case PATTERN_REGEX:
+        return regexec(pat->reg, str, 0, NULL, 0) == 0;
+    }
+    return false;
+}
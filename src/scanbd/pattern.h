@@ -0,0 +1,53 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "common.h"
+
+// the kinds of trigger patterns (POSIX extended regexes), the common
+// ones (like "^$" or "^email.*") are matched without the regex engine
+enum pattern_kind {
+    PATTERN_ANY,                 // "", ".*": matches every value
+    PATTERN_EXACT,               // "^literal$"
+    PATTERN_PREFIX,              // "^literal", "^literal.*"
+    PATTERN_SUBSTRING,           // "literal", "literal.*"
+    PATTERN_REGEX                // all other patterns
+};
+
+// a classified pattern, the literal is unescaped ("^foo\.bar$" is the
+// exact literal "foo.bar")
+struct pattern {
+    enum pattern_kind kind;
+    const char* source;          // the pattern (not copied)
+    char* literal;               // the literal part of the pattern
+    size_t len;                  // the length of the literal
+    const regex_t* reg;          // the compiled pattern (not copied)
+};
+typedef struct pattern pattern_t;
+
+extern void pattern_compile(pattern_t*, const char*, const regex_t*);
+extern void pattern_free(pattern_t*);
+extern bool pattern_match(const pattern_t*, const char*, size_t);
+
+#endif
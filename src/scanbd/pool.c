@@ -0,0 +1,276 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// setgroups(), NSIG
+#define _DEFAULT_SOURCE
+
+#include "pool.h"
+#include "control.h"
+#include "launcher.h"
+#include "slog.h"
+
+// the descriptors closed by a helper, the daemon doesn't use more
+#define POOL_MAX_FD 4096
+
+// an idle helper
+struct pool_helper {
+    pid_t pid;
+    int fd;      // the daemon end of the socket pair
+};
+
+static struct pool_helper* pool_helpers = NULL;
+static int num_pool_helpers = 0;
+static int pool_size = 0;
+
+// prepared before the fork: the helpers only use async-signal-safe
+// calls, the daemon is multi-threaded
+static char* pool_saned = NULL;
+static char** pool_env = NULL;
+static uid_t pool_uid = 0;
+static gid_t pool_gid = 0;
+static int pool_max_fd = 0;
+
+extern char** environ;
+
+// called by the reaper thread of the launcher
+static void pool_helper_done(pid_t pid, int status, void* arg) {
+    (void)arg;
+    if (status < 0) {
+        return;
+    }
+    if (WIFEXITED(status)) {
+        slog(SLOG_INFO, "saned helper %d exited with status: %d", pid, WEXITSTATUS(status));
+    }
+    if (WIFSIGNALED(status)) {
+        slog(SLOG_INFO, "saned helper %d exited due to signal: %d", pid, WTERMSIG(status));
+    }
+}
+
+// the forked helper: waits for the connection and executes saned
+static void pool_helper_run(int fd) {
+    // the handlers of the daemon write into its pipes
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    for(int s = 1; s < NSIG; s += 1) {
+        sigaction(s, &sa, NULL);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    // don't keep the devices and the sockets of the daemon open
+    if (fd <= STDERR_FILENO) {
+        fd = fcntl(fd, F_DUPFD, STDERR_FILENO + 1);
+        if (fd < 0) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+    for(int i = 0; i < pool_max_fd; i += 1) {
+        if (i != fd) {
+            close(i);
+        }
+    }
+    // saned inherits the pair
+    if (fcntl(fd, F_SETFD, 0) < 0) {
+        _exit(EXIT_FAILURE);
+    }
+
+    // saned runs as the user and group of the daemon, the daemon only
+    // changed its effective ids
+    if (seteuid(0) == 0) {
+        setgroups(1, &pool_gid);
+    }
+    if ((setgid(pool_gid) < 0) || (setuid(pool_uid) < 0)) {
+        if (getuid() == 0) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    int conn = -1;
+    while(conn < 0) {
+        char c = 0;
+        struct iovec iov;
+        iov.iov_base = &c;
+        iov.iov_len = 1;
+        union {
+            struct cmsghdr h;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } u;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = u.buf;
+        msg.msg_controllen = sizeof(u.buf);
+        ssize_t n = recvmsg(fd, &msg, 0);
+        if ((n < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            // the pool was stopped
+            _exit(EXIT_SUCCESS);
+        }
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        if ((cm != NULL) && (cm->cmsg_level == SOL_SOCKET) &&
+                (cm->cmsg_type == SCM_RIGHTS)) {
+            memcpy(&conn, CMSG_DATA(cm), sizeof(int));
+        }
+    }
+    // like inetd
+    if ((dup2(conn, STDIN_FILENO) < 0) || (dup2(conn, STDOUT_FILENO) < 0) ||
+            (dup2(conn, STDERR_FILENO) < 0)) {
+        _exit(EXIT_FAILURE);
+    }
+    if (conn > STDERR_FILENO) {
+        close(conn);
+    }
+    setsid();
+    char* const argv[] = {(char*)"saned", NULL};
+    execve(pool_saned, argv, pool_env);
+    _exit(EXIT_FAILURE);
+}
+
+static void pool_free_env(void) {
+    for(int i = 0; (pool_env != NULL) && (pool_env[i] != NULL); i += 1) {
+        free(pool_env[i]);
+    }
+    free(pool_env);
+    pool_env = NULL;
+}
+
+// prepares the pool of size helpers for saned, the strings of envs
+// ("NAME=value") are added to the environment of saned
+void pool_start(int size, const char* saned, char* const* envs, uid_t uid, gid_t gid) {
+    assert(saned);
+    slog(SLOG_DEBUG, "pool_start: %d helpers for %s", size, saned);
+    pool_size = size;
+    pool_uid = uid;
+    pool_gid = gid;
+    free(pool_saned);
+    pool_saned = strdup(saned);
+    assert(pool_saned);
+
+    // the added environment comes first (getenv() finds it)
+    int num_envs = 0;
+    int num_environ = 0;
+    while((envs != NULL) && (envs[num_envs] != NULL)) {
+        num_envs += 1;
+    }
+    while(environ[num_environ] != NULL) {
+        num_environ += 1;
+    }
+    pool_free_env();
+    // copies, the config may be reloaded
+    pool_env = (char**) calloc(num_envs + num_environ + 1, sizeof(char*));
+    assert(pool_env);
+    for(int i = 0; i < num_envs; i += 1) {
+        pool_env[i] = strdup(envs[i]);
+        assert(pool_env[i]);
+    }
+    for(int i = 0; i < num_environ; i += 1) {
+        pool_env[num_envs + i] = strdup(environ[i]);
+        assert(pool_env[num_envs + i]);
+    }
+
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    if ((max_fd < 0) || (max_fd > POOL_MAX_FD)) {
+        max_fd = POOL_MAX_FD;
+    }
+    pool_max_fd = (int) max_fd;
+}
+
+// forks the missing helpers
+void pool_fill(void) {
+    while(num_pool_helpers < pool_size) {
+        int sv[2];
+        int type = SOCK_STREAM;
+#ifdef SOCK_CLOEXEC
+        // the scripts spawned meanwhile don't get the pair
+        type |= SOCK_CLOEXEC;
+#endif
+        if (socketpair(AF_UNIX, type, 0, sv) < 0) {
+            slog(SLOG_WARN, "Can't create socket pair for saned helper: %s", strerror(errno));
+            return;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            slog(SLOG_WARN, "Can't fork saned helper: %s", strerror(errno));
+            close(sv[0]);
+            close(sv[1]);
+            return;
+        }
+        if (pid == 0) {
+            pool_helper_run(sv[1]);
+        }
+        close(sv[1]);
+        if (fcntl(sv[0], F_SETFD, FD_CLOEXEC) < 0) {
+            slog(SLOG_WARN, "Can't set close-on-exec: %s", strerror(errno));
+        }
+        launcher_adopt(pid, pool_helper_done, NULL);
+
+        pool_helpers = (struct pool_helper*) realloc(pool_helpers,
+                                                     pool_size * sizeof(struct pool_helper));
+        assert(pool_helpers);
+        pool_helpers[num_pool_helpers].pid = pid;
+        pool_helpers[num_pool_helpers].fd = sv[0];
+        num_pool_helpers += 1;
+        slog(SLOG_DEBUG, "saned helper %d ready", pid);
+    }
+}
+
+// takes an idle helper out of the pool
+// returns the daemon end of its socket pair or -1 if there is none
+int pool_take(void) {
+    if (num_pool_helpers == 0) {
+        return -1;
+    }
+    num_pool_helpers -= 1;
+    slog(SLOG_DEBUG, "taking saned helper %d", pool_helpers[num_pool_helpers].pid);
+    return pool_helpers[num_pool_helpers].fd;
+}
+
+// passes the client connection to the helper taken by pool_take(), the
+// helper executes saned
+bool pool_handoff(int fd, int conn) {
+    if (!control_send_fd(fd, "s", 1, conn)) {
+        slog(SLOG_WARN, "Can't pass the connection to the saned helper");
+        return false;
+    }
+    return true;
+}
+
+// stops the idle helpers, they exit on the hangup of their pair
+void pool_stop(void) {
+    slog(SLOG_DEBUG, "pool_stop");
+    for(int i = 0; i < num_pool_helpers; i += 1) {
+        close(pool_helpers[i].fd);
+    }
+    free(pool_helpers);
+    pool_helpers = NULL;
+    num_pool_helpers = 0;
+    pool_size = 0;
+    pool_free_env();
+    free(pool_saned);
+    pool_saned = NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "common.h"
+
+// the pool of pre-forked saned helpers: a helper is forked in advance
+// (without the devices and sockets of the daemon) and waits on a
+// socket pair for a client connection passed by scanbm, then it
+// executes saned with the connection as stdin/stdout/stderr. saned
+// inherits the helper end of the pair, so the daemon sees the end of
+// saned as the hangup of its end.
+// All functions are only used by the main thread.
+
+extern void pool_start(int, const char*, char* const*, uid_t, gid_t);
+extern void pool_stop(void);
+extern void pool_fill(void);
+extern int pool_take(void);
+extern bool pool_handoff(int, int);
+
+#endif
@@ -22,6 +22,8 @@
 
 #include "scanbd.h"
 #include "scanbd_dbus.h"
+#include "control.h"
+#include "pattern.h"
 
 // all programm-global sane functions use this mutex to avoid races
 #ifdef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
@@ -36,8 +38,9 @@ static pthread_cond_t  sane_cv    = PTHREAD_COND_INITIALIZER;
 // the following locking strategie must be obeyed:
 // 1) lock the sane_mutex
 // 2) lock the device specific mutex
+// 3) lock the sched_mutex
 // in this order to avoid deadlocks
-// holding more than these two locks is not intended
+// holding more than these locks is not intended
 
 #ifndef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
 void sane_init_mutex()
@@ -62,7 +65,8 @@ void sane_init_mutex()
 struct sane_opt_value {    
     unsigned long num_value; // before-value or after-value or actual-value (BOOL|INT|FIXED)
     struct {                 // (STRING)
-        char*     str;       // actual-value
+        char*     str;       // actual-value (the buffer of a plan option)
+        size_t    len;       // the length of the actual-value
         regex_t*  reg;       // before-regex or after-regex
     } str_value;
 };
@@ -73,36 +77,134 @@ struct sane_dev_option {
     sane_opt_value_t from_value; // the before-value of the option
     sane_opt_value_t to_value;   // the after-value of the option (to
     // fire the trigger)
-    sane_opt_value_t value;      // the option value (from the last
-    // polling cycle)
-    const char* script;          // the found (matched) script to be called if
-    // the option-valued changes
-    const char* action_name;	 // the name of this action as
-    // specified in the config file
+    char* script;                // the found (matched) script to be called if
+    // the option-valued changes (copy)
+    char* action_name;	         // the name of this action as
+    // specified in the config file (copy)
 };
 typedef struct sane_dev_option sane_dev_option_t;
 
 struct sane_dev_function {
     int number;			 // the option-number of the
     // device-option
-    const char* env;		 // the name of the environment-var to
-    // pass to option value in
+    char* env;		         // the name of the environment-var to
+    // pass to option value in (copy)
 };
 typedef struct sane_dev_function sane_dev_function_t;
 
-// each polling thread is represented by struct sane_thread
-// there is no locking, since this is "thread private data"
+// an option of the poll plan, read once per poll cycle
+struct sane_poll_option {
+    int number;                  // the option-number of the device-option
+    SANE_Value_Type type;        // the type of the option
+    SANE_Int size;               // the size of the option value
+    char* name;                  // the name of the option (copy)
+    int first_trigger;           // the triggers of this option:
+    int num_triggers;            // plan.triggers[first_trigger ...]
+    int first_pattern;           // the distinct patterns of the string
+    int num_patterns;            // triggers: plan.patterns[first_pattern ...]
+};
+typedef struct sane_poll_option sane_poll_option_t;
+
+// the poll plan of a device is compiled once from the matched actions
+// and functions and isn't modified until the device is released
+struct sane_poll_plan {
+    sane_poll_option_t* options; // the options to read, the watched
+    int num_options;             // options (with triggers) come first
+    int num_watched;
+    int* triggers;               // the fan-out lists of the options
+    // (indices into the opts-array)
+    int* trigger_option;         // the plan option of each action
+    int* function_option;        // the plan option of each function
+    pattern_t* patterns;         // the patterns of the string triggers
+    int num_patterns;
+    int* trigger_from;           // the pattern of the before-value and
+    int* trigger_to;             // of the after-value of each action
+    bool* prev_matches;          // the patterns matching the previous
+    bool* value_matches;         // and the actual value (of the last
+    // evaluated option)
+};
+typedef struct sane_poll_plan sane_poll_plan_t;
+
+// an option of the option layout of a device model
+struct sane_layout_option {
+    int number;                  // the option-number of the device-option
+    SANE_Value_Type type;        // the type of the option
+    SANE_Int size;               // the size of the option value
+    char* name;                  // the name of the option (copy)
+};
+typedef struct sane_layout_option sane_layout_option_t;
+
+// the option layout of a device model: its active options with a name
+// and a supported type, the actions and functions are matched against
+// it. The devices of the same model, backend and backend version share
+// the layout, so a device opened again doesn't walk all its option
+// descriptors. A layout isn't modified after it was built.
+struct sane_layout {
+    char* backend;               // the key of the layout (copies)
+    char* vendor;
+    char* model;
+    SANE_Int version;            // the version code of the backends
+    int num_of_options;          // the value of option 0
+    sane_layout_option_t* options; // ordered by option-number
+    int num_options;
+    int* index;                  // option-number -> options-index or -1
+    int refs;                    // the devices using the layout
+    bool cached;                 // in the layout cache
+    // (refs and cached are guarded by sane_layout_mutex)
+};
+typedef struct sane_layout sane_layout_t;
+
+// the states of an action job
+enum sane_job_state {
+    SANE_JOB_NONE,               // no job
+    SANE_JOB_SETTLE,             // the device is closed, the script is
+    // started after the settle timeout
+    SANE_JOB_RUNNING,            // the script runs, the device isn't polled
+    SANE_JOB_DONE                // the script terminated, the device is
+    // reopened after the settle timeout
+};
+
+// an action of a device run by its script, the poll workers don't wait
+// for the script: the reaper of the launcher reports the termination
+struct sane_action_job {
+    enum sane_job_state state;   // (guarded by sched_mutex)
+    struct sane_thread* st;      // the device, NULL if the device was
+    // released while the script ran (guarded by sched_mutex)
+    char* dev_name;              // the name of the device (copy)
+    char* script;                // the absolute path of the script
+    launcher_env_t env;          // the environment of the script, freed
+    // when the script is started
+    pid_t pid;                   // the script process
+    int status;                  // the wait status of the script
+    // (guarded by sched_mutex)
+    bool listed;                 // in the job table, i.e. holds a job
+    // slot (guarded by sched_mutex)
+};
+typedef struct sane_action_job sane_action_job_t;
+
+// each polled device is represented by struct sane_thread
+// a poll cycle of a device is run by one of the poll workers, the
+// scheduler guarantees that at most one worker handles a device at a time
 struct sane_thread {
-    pthread_t tid;                   // the thread-id of the polling
-    // thread
     pthread_mutex_t mutex;	     // mutex for this data-structure
     pthread_cond_t cv;		     // cv for this data-structure
     bool triggered;		     // a rule for this device has fired (triggered == true)
     int  triggered_option;           // the action number which triggered
-    const SANE_Device* dev;          // the device
+    sane_action_job_t* job;          // the running action or NULL (only
+    // changed by the worker running the cycle, guarded by sched_mutex)
+    int* pending;                    // the backlog: the actions triggered
+    int num_pending;                 // while a job was active or all job
+    int pending_capacity;            // slots were used, run in FIFO order
+    bool job_granted;                // a free job slot was handed to the
+    // waiting device (guarded by sched_mutex)
+    const SANE_Device* dev;          // the device (points to device)
+    SANE_Device device;              // copy of the device description,
+    // the sane device list is only valid until the next sane_get_devices()
     int num_of_options;	             // the number of all options for
     // this device
     SANE_Handle h;                   // the handle of the opened device
+    sane_layout_t* layout;           // the option layout of the device
+    // (shared, see sane_layout_get())
     sane_dev_option_t *opts;         // the list of matched actions
     // for this device
     int num_of_options_with_scripts; // the number of elements in the
@@ -111,71 +213,774 @@ struct sane_thread {
     // for this device
     int num_of_options_with_functions;// the number of elements in the
     // above list
+    sane_poll_plan_t plan;           // the compiled options to poll
+    sane_opt_value_t* values;        // the snapshot: the values of the
+    // plan options (from the last polling cycle)
+    sane_opt_value_t* prev_values;   // the values of the watched options
+    // before the last polling cycle
+    bool abandoned;                  // the device can't be polled, don't
+    // schedule it again
+    bool reconfigure;                // the config changed, match the
+    // actions and functions again without closing the device
+    struct timespec next_poll;       // deadline of the next poll cycle
+    // (CLOCK_MONOTONIC)
+    int sched_index;                 // position in the scheduler heap, -1
+    // if not queued (guarded by sched_mutex)
+    bool sched_wakeup;               // requeue without delay after the
+    // running cycle (guarded by sched_mutex)
+    bool sched_busy;                 // a worker runs a cycle of this
+    // device (guarded by sched_mutex)
+    bool sched_removed;              // the device vanished, don't requeue
+    // it (guarded by sched_mutex)
+    bool sched_polled;               // the first cycle (opening the
+    // device) ended (guarded by sched_mutex)
+    bool sched_acquired;             // the device is closed and handed
+    // over to saned, don't requeue it (guarded by sched_mutex)
+    poll_interval_t interval;        // the adaptive poll interval (only
+    // used by the worker running the cycle)
 };
 typedef struct sane_thread sane_thread_t;
 
-// the list of all polling threads
-static sane_thread_t* sane_poll_threads = NULL;
+// the list of all polled devices (in the order of the sane device list)
+static sane_thread_t** sane_poll_threads = NULL;
+static int num_poll_threads = 0;
+
+// the scheduler: a min-heap of the polled devices ordered by their
+// next_poll deadline, served by a small fixed pool of worker threads.
+// One worker (the leader) sleeps until the earliest deadline, all other
+// idle workers wait on sched_cv until the leader hands over.
+static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sched_cv;        // idle followers wait here
+static pthread_cond_t  sched_leader_cv; // the leader waits here (timed)
+static pthread_cond_t  sched_done_cv = PTHREAD_COND_INITIALIZER; // a cycle ended
+static bool            sched_cv_initialized = false;
+static sane_thread_t** sched_heap = NULL;
+static int             sched_heap_size = 0;
+static int             sched_heap_capacity = 0;
+static bool            sched_has_leader = false;
+static bool            sched_stop = false;
+static pthread_t*      sched_workers = NULL;
+static int             num_sched_workers = 0;
+static int             max_sched_workers = 0;
+// SANE doesn't allow sane_get_devices() while other calls use the
+// backends: the device probe pauses the poll cycles and the other calls
+// into the backends of the polled devices, see sched_probe_begin()
+static bool            sched_probing = false;       // a probe waits for
+// or uses the backends
+static int             sched_backend_users = 0;     // the running poll
+// cycles and sched_backend_enter() calls
+
+// the job table: all running action jobs, including those of released
+// devices (guarded by sched_mutex)
+static sane_action_job_t** sane_jobs = NULL;
+static int num_sane_jobs = 0;
+static int sane_jobs_capacity = 0;
+// the global limit of the action jobs (0: no limit) and the job slots
+// reserved for devices about to start a job (guarded by sched_mutex)
+static int max_sane_jobs = C_ACTION_JOBS_DEF;
+static int num_sane_jobs_reserved = 0;
+// the devices waiting for a free job slot, in FIFO order (guarded by
+// sched_mutex)
+static sane_thread_t** sane_job_waiters = NULL;
+static int num_sane_job_waiters = 0;
+static int sane_job_waiters_capacity = 0;
+// the backlog policy of the devices (only changed by sched_start())
+static int sane_backlog_size = C_ACTION_BACKLOG_DEF;
+static bool sane_backlog_coalesce = false;
+
+// simple hash function for C-strings
+static unsigned long hash(const char *str) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+    return hash;
+}
 
-// the list of all devices locally connected to our system
-static const SANE_Device** sane_device_list = NULL;
+// the list of all devices locally connected to our system: a copy of
+// the last device probe or of the device cache (guarded by sane_mutex)
+static SANE_Device** sane_device_list = NULL;
 
-// the number of devices = the number of polling threads
+// the number of devices in the above list
 static int num_devices = 0;
 
-void get_sane_devices(void) {
-    // detect all the scanners we have
-    slog(SLOG_INFO, "Scanning for local-only devices" );
+// the above list is the result of a probe or of the device cache (even
+// if it is empty)
+static bool sane_device_list_known = false;
+
+// the usb topology stored in the device cache file
+static unsigned long sane_cache_topology = 0;
+
+// the names of the devices acquired by sane_acquire_device(), once per
+// acquire: they stay closed across restarts of the polling until
+// released (guarded by sane_mutex)
+static char** sane_acquired_devices = NULL;
+static int num_sane_acquired_devices = 0;
+static int sane_acquired_devices_capacity = 0;
+
+// the device probe: sane_get_devices() takes seconds with some backends
+// (net, escl, pixma look for network scanners), so it runs in the
+// background and the last known devices are polled meanwhile. The probe
+// posts CONTROL_DISCOVERED, the main thread reconciles the polled
+// devices with the fresh list then (see sane_discovered()).
+static pthread_mutex_t sane_probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sane_probe_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t       sane_probe_tid;
+static bool            sane_probe_joinable = false; // sane_probe_tid ended
+// or runs, it must be joined
+static bool            sane_probe_running = false;
+static bool            sane_probe_again = false;    // the devices changed
+// during the running probe, probe again
+static SANE_Device**   sane_probe_result = NULL;    // the fresh devices,
+static int             num_sane_probe_result = 0;   // not yet taken by
+static bool            sane_probe_ready = false;    // sane_probe_take()
+
+// the usb devices whose attributes are hashed for the device cache
+#define SANE_USB_SYSFS "/sys/bus/usb/devices"
+
+// the length of a line of the device cache
+#define SANE_CACHE_LINE_MAX 1024
+
+static void sane_device_free(SANE_Device* dev) {
+    free((void*)dev->name);
+    free((void*)dev->vendor);
+    free((void*)dev->model);
+    free((void*)dev->type);
+    free(dev);
+}
 
-    if (pthread_mutex_lock(&sane_mutex) < 0) {
-        // if we can't get the mutex, something is heavily wrong!
-        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+// frees a device list of sane_devices_add()
+static void sane_devices_free(SANE_Device** list) {
+    for(int i = 0; (list != NULL) && (list[i] != NULL); i += 1) {
+        sane_device_free(list[i]);
+    }
+    free(list);
+}
+
+// appends a copy of the device description to the NULL terminated list
+static void sane_devices_add(SANE_Device*** list, int* num, const char* name,
+                             const char* vendor, const char* model, const char* type) {
+    SANE_Device** l = (SANE_Device**) realloc(*list, (*num + 2) * sizeof(SANE_Device*));
+    assert(l != NULL);
+    SANE_Device* dev = (SANE_Device*) calloc(1, sizeof(SANE_Device));
+    assert(dev != NULL);
+    dev->name = strdup(name ? name : "");
+    dev->vendor = strdup(vendor ? vendor : "");
+    dev->model = strdup(model ? model : "");
+    dev->type = strdup(type ? type : "");
+    assert(dev->name && dev->vendor && dev->model && dev->type);
+    l[*num] = dev;
+    l[*num + 1] = NULL;
+    *num += 1;
+    *list = l;
+}
+
+// the device numbers are the positions in the list, so the order counts
+static bool sane_devices_equal(SANE_Device** a, int num_a, SANE_Device** b, int num_b) {
+    if (num_a != num_b) {
+        return false;
+    }
+    for(int i = 0; i < num_a; i += 1) {
+        if (strcmp(a[i]->name, b[i]->name) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// removes a device from the device list without probing
+// this function can only be used in the critical region of sane_mutex
+static void sane_devices_remove(const char* name) {
+    int n = 0;
+    for(int i = 0; i < num_devices; i += 1) {
+        SANE_Device* dev = sane_device_list[i];
+        if (strcmp(dev->name, name) == 0) {
+            sane_device_free(dev);
+            continue;
+        }
+        sane_device_list[n] = dev;
+        n += 1;
+    }
+    num_devices = n;
+    if (sane_device_list != NULL) {
+        sane_device_list[n] = NULL;
+    }
+}
+
+// the backend of a device is the prefix of its name (e.g. "genesys" of
+// "genesys:libusb:001:005")
+static bool sane_same_backend(const char* a, const char* b) {
+    const char* colon_a = strchr(a, ':');
+    const char* colon_b = strchr(b, ':');
+    size_t len_a = colon_a ? (size_t)(colon_a - a) : strlen(a);
+    size_t len_b = colon_b ? (size_t)(colon_b - b) : strlen(b);
+    return (len_a == len_b) && (strncmp(a, b, len_a) == 0);
+}
+
+// reads the first line of a sysfs attribute
+static bool sane_read_attr(const char* dir, const char* attr, char* value, size_t len) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s/%s", SANE_USB_SYSFS, dir, attr);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = (fgets(value, len, f) != NULL);
+    fclose(f);
+    if (ok) {
+        value[strcspn(value, "\n")] = '\0';
+    }
+    return ok;
+}
+
+static int sane_topology_key_cmp(const void* a, const void* b) {
+    return strcmp((const char*)a, (const char*)b);
+}
+
+// a hash of the attached usb devices (port, vendor and product), 0 if
+// unknown (no sysfs). The usb address isn't part of it, the kernel
+// assigns a new one on each replug.
+static unsigned long sane_usb_topology(void) {
+    DIR* dir = opendir(SANE_USB_SYSFS);
+    if (dir == NULL) {
+        return 0;
+    }
+    // the keys of the devices, sorted to be independent of the order of
+    // the directory
+    char (*keys)[80] = NULL;
+    int num_keys = 0;
+    int keys_capacity = 0;
+    struct dirent* entry = NULL;
+    while((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char vendor[16], product[16];
+        if (!sane_read_attr(entry->d_name, "idVendor", vendor, sizeof(vendor)) ||
+                !sane_read_attr(entry->d_name, "idProduct", product, sizeof(product))) {
+            // an interface, not a device
+            continue;
+        }
+        if (num_keys == keys_capacity) {
+            keys_capacity = (keys_capacity > 0) ? 2 * keys_capacity : 16;
+            keys = realloc(keys, keys_capacity * sizeof(*keys));
+            assert(keys != NULL);
+        }
+        // the name of the sysfs entry is the port (like "1-1.2"), a usb
+        // port path has at most 7 hubs
+        snprintf(keys[num_keys], sizeof(*keys), "%.32s:%s:%s\n",
+                 entry->d_name, vendor, product);
+        num_keys += 1;
+    }
+    closedir(dir);
+    qsort(keys, num_keys, sizeof(*keys), sane_topology_key_cmp);
+
+    // the hash of the concatenated keys
+    char* all = malloc(num_keys * sizeof(*keys) + 1);
+    assert(all != NULL);
+    size_t len = 0;
+    for(int i = 0; i < num_keys; i += 1) {
+        size_t key_len = strlen(keys[i]);
+        memcpy(all + len, keys[i], key_len);
+        len += key_len;
+    }
+    all[len] = '\0';
+    unsigned long topology = hash(all);
+    free(all);
+    free(keys);
+    return topology;
+}
+
+// finds the usb address in the name of a libusb device (like
+// "genesys:libusb:001:005"), the address is name[*start, *end)
+// returns false if the name has no usb address
+static bool sane_libusb_address(const char* name, int* bus, int* dev,
+                                size_t* start, size_t* end) {
+    const char* p = strstr(name, "libusb:");
+    if (p == NULL) {
+        return false;
+    }
+    p += strlen("libusb:");
+    int len = 0;
+    if ((sscanf(p, "%d:%d%n", bus, dev, &len) != 2) || (len == 0)) {
+        return false;
+    }
+    *start = p - name;
+    *end = *start + len;
+    return true;
+}
+
+// copies the usb port (the sysfs name, like "1-1.2") of the device at
+// the usb address bus:dev to port
+// returns false if there is no such device
+static bool sane_usb_port(int bus, int dev, char* port, size_t len) {
+    DIR* dir = opendir(SANE_USB_SYSFS);
+    if (dir == NULL) {
+        return false;
+    }
+    bool found = false;
+    struct dirent* entry = NULL;
+    while(!found && ((entry = readdir(dir)) != NULL)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char busnum[16], devnum[16];
+        if (!sane_read_attr(entry->d_name, "busnum", busnum, sizeof(busnum)) ||
+                !sane_read_attr(entry->d_name, "devnum", devnum, sizeof(devnum))) {
+            continue;
+        }
+        if ((atoi(busnum) == bus) && (atoi(devnum) == dev) &&
+                (strlen(entry->d_name) < len)) {
+            strcpy(port, entry->d_name);
+            found = true;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+
+// reads the usb address of the device at the usb port
+// returns false if no device is attached to the port
+static bool sane_usb_address(const char* port, int* bus, int* dev) {
+    char busnum[16], devnum[16];
+    if ((strchr(port, '/') != NULL) || (port[0] == '.') ||
+            !sane_read_attr(port, "busnum", busnum, sizeof(busnum)) ||
+            !sane_read_attr(port, "devnum", devnum, sizeof(devnum))) {
+        return false;
+    }
+    *bus = atoi(busnum);
+    *dev = atoi(devnum);
+    return true;
+}
+
+// splits a line of a cache at the tabs into at most max fields, the
+// last field keeps the rest of the line
+// returns the number of fields
+static int sane_split_fields(char* line, char** fields, int max) {
+    int num_fields = 0;
+    char* p = line;
+    while(num_fields < max) {
+        fields[num_fields] = p;
+        num_fields += 1;
+        p = strchr(p, '\t');
+        if (p == NULL) {
+            break;
+        }
+        *p = '\0';
+        p += 1;
+    }
+    return num_fields;
+}
+
+// copies the path of the device cache to path (PATH_MAX bytes)
+// returns false if it is disabled
+static bool sane_cache_path(char* path) {
+    cfg_t* c = cfg_acquire();
+    cfg_t* cfg_sec_global = cfg_getsec(c, C_GLOBAL);
+    assert(cfg_sec_global);
+    const char* p = cfg_getstr(cfg_sec_global, C_DEVICE_CACHE);
+    bool enabled = (p != NULL) && (strlen(p) > 0);
+    if (enabled) {
+        snprintf(path, PATH_MAX, "%s", p);
+    }
+    cfg_release(c);
+    return enabled;
+}
+
+// reads the device cache into the device list. The devices with usb
+// addresses in their names (like "libusb:001:005") are cached with
+// their usb port: the name gets the current address of the device at
+// that port (a replug changes it), a device gone from its port is
+// dropped. The cache is keyed by the usb topology: if another set of
+// usb devices is attached, the devices of the backends with usb
+// addresses but without a known port are dropped, the addresses may be
+// reused. The devices of the other backends (net, escl, ...) are kept.
+// returns false if there is no cache
+// this function can only be used in the critical region of sane_mutex
+static bool sane_cache_load(void) {
+    char path[PATH_MAX];
+    if (!sane_cache_path(path)) {
+        return false;
+    }
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            slog(SLOG_WARN, "Can't open device cache %s: %s", path, strerror(errno));
+        }
+        return false;
+    }
+    SANE_Device** list = (SANE_Device**) calloc(1, sizeof(SANE_Device*));
+    assert(list != NULL);
+    int num = 0;
+    // per device: 0 no usb port known, 1 readdressed by its port, 2 gone
+    // from its port
+    int* usb_state = NULL;
+    bool topology_known = false;
+    unsigned long topology = 0;
+    bool ok = true;
+    char line[SANE_CACHE_LINE_MAX];
+    while(ok && (fgets(line, sizeof(line), f) != NULL)) {
+        if (strchr(line, '\n') == NULL) {
+            // truncated
+            ok = false;
+            break;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if ((line[0] == '#') || (line[0] == '\0')) {
+            continue;
+        }
+        if (strncmp(line, "usb ", 4) == 0) {
+            topology = strtoul(line + 4, NULL, 16);
+            topology_known = true;
+            continue;
+        }
+        // device<TAB>name<TAB>vendor<TAB>model<TAB>type[<TAB>usb port]
+        char* fields[6];
+        int num_fields = sane_split_fields(line, fields, 6);
+        if ((num_fields < 5) || (strcmp(fields[0], "device") != 0) ||
+                (strlen(fields[1]) == 0)) {
+            ok = false;
+            break;
+        }
+        usb_state = (int*) realloc(usb_state, (num + 1) * sizeof(int));
+        assert(usb_state != NULL);
+        usb_state[num] = 0;
+        int bus = 0;
+        int dev = 0;
+        size_t start = 0;
+        size_t end = 0;
+        char name[SANE_CACHE_LINE_MAX];
+        if ((num_fields == 6) &&
+                sane_libusb_address(fields[1], &bus, &dev, &start, &end)) {
+            usb_state[num] = 2;
+            if (sane_usb_address(fields[5], &bus, &dev)) {
+                snprintf(name, sizeof(name), "%.*s%03d:%03d%s",
+                         (int)start, fields[1], bus, dev, fields[1] + end);
+                fields[1] = name;
+                usb_state[num] = 1;
+            }
+        }
+        sane_devices_add(&list, &num, fields[1], fields[2], fields[3], fields[4]);
+    }
+    fclose(f);
+    if (!ok || !topology_known) {
+        slog(SLOG_WARN, "Ignoring invalid device cache %s", path);
+        sane_devices_free(list);
+        free(usb_state);
+        return false;
+    }
+
+    sane_cache_topology = topology;
+    const bool changed = (topology != sane_usb_topology());
+    bool* stale = (bool*) calloc(num + 1, sizeof(bool));
+    assert(stale != NULL);
+    bool any_stale = false;
+    for(int i = 0; i < num; i += 1) {
+        if (usb_state[i] == 2) {
+            slog(SLOG_INFO, "cached usb device %s is gone", list[i]->name);
+            stale[i] = true;
+            any_stale = true;
+        }
+        if ((usb_state[i] != 0) || !changed ||
+                (strstr(list[i]->name, "libusb:") == NULL)) {
+            continue;
+        }
+        slog(SLOG_INFO, "usb devices changed, ignoring the cached usb devices of %s",
+             list[i]->name);
+        for(int k = 0; k < num; k += 1) {
+            if (usb_state[k] == 0) {
+                stale[k] |= sane_same_backend(list[i]->name, list[k]->name);
+            }
+        }
+        any_stale = true;
+    }
+    if (any_stale) {
+        int n = 0;
+        for(int i = 0; i < num; i += 1) {
+            if (stale[i]) {
+                sane_device_free(list[i]);
+                continue;
+            }
+            list[n] = list[i];
+            n += 1;
+        }
+        list[n] = NULL;
+        num = n;
+    }
+    free(stale);
+    free(usb_state);
+
+    sane_devices_free(sane_device_list);
+    sane_device_list = list;
+    num_devices = num;
+    sane_device_list_known = true;
+    slog(SLOG_INFO, "using %d devices of the device cache %s", num_devices, path);
+    return true;
+}
+
+// writes the device list to the device cache, with the usb topology
+// this function can only be used in the critical region of sane_mutex
+static void sane_cache_save(void) {
+    char path[PATH_MAX];
+    if (!sane_cache_path(path)) {
+        return;
+    }
+    // replaced at once, a crash leaves the old cache
+    char tmp[PATH_MAX + sizeof(".tmp")];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (f == NULL) {
+        slog(SLOG_WARN, "Can't write device cache %s: %s", tmp, strerror(errno));
+        return;
+    }
+    fprintf(f, "# scanbd device cache, rewritten after each device probe\n");
+    const unsigned long topology = sane_usb_topology();
+    fprintf(f, "usb %lx\n", topology);
+    for(int i = 0; i < num_devices; i += 1) {
+        const SANE_Device* dev = sane_device_list[i];
+        if (strpbrk(dev->name, "\t\n") || strpbrk(dev->vendor, "\t\n") ||
+                strpbrk(dev->model, "\t\n") || strpbrk(dev->type, "\t\n")) {
+            slog(SLOG_DEBUG, "device %s not cached", dev->name);
+            continue;
+        }
+        fprintf(f, "device\t%s\t%s\t%s\t%s", dev->name, dev->vendor, dev->model, dev->type);
+        // the usb port finds the device again after a replug
+        int bus = 0;
+        int devnum = 0;
+        size_t start = 0;
+        size_t end = 0;
+        char port[64];
+        if (sane_libusb_address(dev->name, &bus, &devnum, &start, &end) &&
+                sane_usb_port(bus, devnum, port, sizeof(port))) {
+            fprintf(f, "\t%s", port);
+        }
+        fprintf(f, "\n");
+    }
+    if (fclose(f) != 0) {
+        slog(SLOG_WARN, "Can't write device cache %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, path) < 0) {
+        slog(SLOG_WARN, "Can't replace device cache %s: %s", path, strerror(errno));
+        unlink(tmp);
         return;
     }
+    sane_cache_topology = topology;
+}
+
+// asks the backends for their devices and copies the list
+// returns false if the backends can't be asked
+static bool sane_probe_devices(SANE_Device*** list, int* num) {
+    // detect all the scanners we have
+    slog(SLOG_INFO, "Scanning for local-only devices" );
+
+    const SANE_Device** devs = NULL;
     SANE_Status sane_status = 0;
-    sane_device_list = NULL;
-    num_devices = 0;
-    if ((sane_status = sane_get_devices(&sane_device_list, SANE_TRUE)) != SANE_STATUS_GOOD) {
+    if ((sane_status = sane_get_devices(&devs, SANE_TRUE)) != SANE_STATUS_GOOD) {
         slog(SLOG_WARN, "Can't get the sane device list");
+        return false;
     }
-    const SANE_Device** dev = sane_device_list;
-    if (dev == NULL || *dev == NULL) {
+    *list = (SANE_Device**) calloc(1, sizeof(SANE_Device*));
+    assert(*list != NULL);
+    *num = 0;
+    if (devs == NULL || *devs == NULL) {
         slog(SLOG_WARN, "device list null");
-        goto cleanup;
-    } else {
-	slog(SLOG_DEBUG, "got some devices");
+        return true;
     }
-    while(*dev != NULL) {
+    for(const SANE_Device** dev = devs; *dev != NULL; dev++) {
         slog(SLOG_DEBUG, "found device: %s %s %s %s",
              (*dev)->name, (*dev)->vendor, (*dev)->model, (*dev)->type);
-        num_devices += 1;
-        dev++;
+        sane_devices_add(list, num, (*dev)->name, (*dev)->vendor, (*dev)->model, (*dev)->type);
+    }
+    slog(SLOG_DEBUG, "probe found %i devices", *num);
+    return true;
+}
+
+static void sched_probe_begin(void);
+static void sched_probe_end(void);
+
+// the background probe, only one runs at a time
+static void* sane_probe_thread(void* arg) {
+    (void)arg;
+    // we only expect the main thread to handle signals
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    if (pthread_mutex_lock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    do {
+        sane_probe_again = false;
+        if (pthread_mutex_unlock(&sane_probe_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+        SANE_Device** list = NULL;
+        int num = 0;
+        sched_probe_begin();
+        bool ok = sane_probe_devices(&list, &num);
+        sched_probe_end();
+        if (pthread_mutex_lock(&sane_probe_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        }
+        if (ok) {
+            sane_devices_free(sane_probe_result);
+            sane_probe_result = list;
+            num_sane_probe_result = num;
+            sane_probe_ready = true;
+        }
+    } while(sane_probe_again);
+    bool ready = sane_probe_ready;
+    sane_probe_running = false;
+    if (pthread_cond_broadcast(&sane_probe_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (ready) {
+        // the result may have been taken meanwhile, then this is a no-op
+        control_notify(CONTROL_DISCOVERED);
+    }
+    return NULL;
+}
+
+// starts a background probe, a running probe is repeated after it
+// ended (the devices may have changed meanwhile)
+static void sane_probe_start(void) {
+    if (pthread_mutex_lock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    if (sane_probe_running) {
+        sane_probe_again = true;
+        goto cleanup;
+    }
+    if (sane_probe_joinable) {
+        // ended already
+        pthread_join(sane_probe_tid, NULL);
+        sane_probe_joinable = false;
+    }
+    sane_probe_running = true;
+    if (pthread_create(&sane_probe_tid, NULL, sane_probe_thread, NULL)) {
+        slog(SLOG_ERROR, "Can't start the device probe: %s", strerror(errno));
+        sane_probe_running = false;
+        goto cleanup;
+    }
+    sane_probe_joinable = true;
+cleanup:
+    if (pthread_mutex_unlock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// waits for the running device probe, the backends must not be
+// restarted (sane_exit()) meanwhile
+void sane_wait_discovery(void) {
+    if (pthread_mutex_lock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    while(sane_probe_running) {
+        pthread_cond_wait(&sane_probe_cv, &sane_probe_mutex);
+    }
+    if (sane_probe_joinable) {
+        pthread_join(sane_probe_tid, NULL);
+        sane_probe_joinable = false;
+    }
+    if (pthread_mutex_unlock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// replaces the device list by the result of a finished probe and
+// updates the device cache, an unchanged result keeps both
+// returns false if there is no new result
+// this function can only be used in the critical region of sane_mutex
+static bool sane_probe_take(void) {
+    if (pthread_mutex_lock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    bool ready = sane_probe_ready;
+    SANE_Device** list = sane_probe_result;
+    int num = num_sane_probe_result;
+    sane_probe_result = NULL;
+    num_sane_probe_result = 0;
+    sane_probe_ready = false;
+    if (pthread_mutex_unlock(&sane_probe_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (!ready) {
+        return false;
+    }
+    if (sane_device_list_known &&
+            sane_devices_equal(sane_device_list, num_devices, list, num)) {
+        slog(SLOG_DEBUG, "device probe: no changes");
+        sane_devices_free(list);
+        // the cache is only rewritten if other usb devices (without a
+        // sane device) were attached meanwhile
+        char path[PATH_MAX];
+        if (sane_cache_path(path) && (sane_cache_topology != sane_usb_topology())) {
+            sane_cache_save();
+        }
+        return true;
+    }
+    sane_devices_free(sane_device_list);
+    sane_device_list = list;
+    num_devices = num;
+    sane_device_list_known = true;
+    sane_cache_save();
+    return true;
+}
+
+// makes the device list available: the last known devices (of the
+// previous probe or of the device cache) are used at once and a
+// background probe is started, the polled devices are reconciled with
+// its result by sane_discovered(). Only without known devices the probe
+// is waited for.
+void get_sane_devices(void) {
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sane_probe_take();
+    if (!sane_device_list_known) {
+        sane_cache_load();
+    }
+    sane_probe_start();
+    if (!sane_device_list_known) {
+        // the probe takes seconds, the other users of sane_mutex
+        // (acquire, release, hotplug) aren't blocked meanwhile
+        slog(SLOG_DEBUG, "no known devices, waiting for the device probe");
+        if (pthread_mutex_unlock(&sane_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+        sane_wait_discovery();
+        if (pthread_mutex_lock(&sane_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            return;
+        }
+        sane_probe_take();
     }
     slog(SLOG_DEBUG, "got %i devices", num_devices);
     if (pthread_cond_broadcast(&sane_cv)) {
         slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
     }
-cleanup:
     if (pthread_mutex_unlock(&sane_mutex) < 0) {
         // if we can't unlock the mutex, something is heavily wrong!
         slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
         return;
     }
-}	
-
-// simple hash function for C-strings
-static unsigned long hash(const char *str) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    }
-    return hash;
 }
 
 static void sane_option_value_init(sane_opt_value_t* v) {
     v->num_value = 0;
     v->str_value.str = NULL;
+    v->str_value.len = 0;
     v->str_value.reg = NULL;
 }
 
@@ -191,108 +996,487 @@ static void sane_option_value_free(sane_opt_value_t* v) {
     }
 }
 
-static sane_opt_value_t get_sane_option_value(SANE_Handle* h, int index) {
-    slog(SLOG_DEBUG, "get_sane_option_value");
-    // get the value of option with index of the device (opened) with
-    // handle h
-    // if option can't be found or other catastrophy happens, the
-    // value 0 gets returned
-    sane_opt_value_t res;
-    sane_option_value_init(&res);
+// allocates the value buffer of the plan option po, the values are
+// read into it in place
+static void sane_option_value_alloc(sane_opt_value_t* v, const sane_poll_option_t* po) {
+    sane_option_value_init(v);
+    if (po->type == SANE_TYPE_STRING) {
+        v->str_value.str = calloc(po->size + 1, sizeof(char));
+        assert(v->str_value.str != NULL);
+    }
+}
 
-    const SANE_Option_Descriptor* odesc = NULL;
-    if ((odesc = sane_get_option_descriptor(h, index)) == NULL) {
-        return res;
+// checks if the values a and b of the plan option po are the same
+static bool sane_option_value_equal(const sane_poll_option_t* po,
+                                    const sane_opt_value_t* a, const sane_opt_value_t* b) {
+    if (po->type == SANE_TYPE_STRING) {
+        return (a->str_value.len == b->str_value.len) &&
+               (memcmp(a->str_value.str, b->str_value.str, a->str_value.len) == 0);
     }
-    if ((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
-            (odesc->type == SANE_TYPE_FIXED) || (odesc->type == SANE_TYPE_BUTTON)) {
+    return a->num_value == b->num_value;
+}
+
+static void get_sane_option_value(SANE_Handle* h, const sane_poll_option_t* po,
+                                  sane_opt_value_t* res) {
+    slog(SLOG_DEBUG, "get_sane_option_value");
+    // get the value of the plan option po of the device (opened) with
+    // handle h into the buffer res (see sane_option_value_alloc())
+    // if the value can't be read or other catastrophy happens, the
+    // value 0 (or the empty string) is stored
+    res->num_value = 0;
+
+    if ((po->type == SANE_TYPE_BOOL) || (po->type == SANE_TYPE_INT) ||
+            (po->type == SANE_TYPE_FIXED) || (po->type == SANE_TYPE_BUTTON)) {
         unsigned long int value = 0;
-        if ((unsigned int)odesc->size <= sizeof(long int)) {
+        if ((unsigned int)po->size <= sizeof(long int)) {
             //if we can store it in an long int
             SANE_Status status;
-            if ((status = sane_control_option(h, index, SANE_ACTION_GET_VALUE,
+            if ((status = sane_control_option(h, po->number, SANE_ACTION_GET_VALUE,
                                               &value, NULL)) != SANE_STATUS_GOOD) {
                 slog(SLOG_WARN, "Can't read value of %s: %s",
-                     odesc->name, sane_strstatus(status));
-                return res;
+                     po->name, sane_strstatus(status));
+                return;
             }
-            res.num_value = value;
-            return res;
+            res->num_value = value;
+            return;
         }
         else {
             // shouldn't happen
-            slog(SLOG_WARN, "Value of %s, sane-type %d too big", odesc->name, odesc->type);
-            return res;
+            slog(SLOG_WARN, "Value of %s, sane-type %d too big", po->name, po->type);
+            return;
         }
     }
-    else if (odesc->type == SANE_TYPE_STRING) {
-        res.str_value.str = calloc(odesc->size + 1, sizeof(char));
-        assert(res.str_value.str != NULL);
+    else if (po->type == SANE_TYPE_STRING) {
+        assert(res->str_value.str != NULL);
         SANE_Status status;
-        if ((status = sane_control_option(h, index, SANE_ACTION_GET_VALUE,
-                                          res.str_value.str, NULL)) != SANE_STATUS_GOOD) {
-            slog(SLOG_WARN, "Can't read value of %s: %s", odesc->name, sane_strstatus(status));
-            return res;
+        if ((status = sane_control_option(h, po->number, SANE_ACTION_GET_VALUE,
+                                          res->str_value.str, NULL)) != SANE_STATUS_GOOD) {
+            slog(SLOG_WARN, "Can't read value of %s: %s", po->name, sane_strstatus(status));
+            res->str_value.str[0] = '\0';
+            res->str_value.len = 0;
+            return;
         }
-        res.str_value.str[odesc->size] = '\0';
-        size_t slen = strlen(res.str_value.str);
-        res.num_value = hash(res.str_value.str);
+        res->str_value.str[po->size] = '\0';
+        res->str_value.len = strlen(res->str_value.str);
 
-        slog(SLOG_INFO, "Value of %s as string (len %d, hash %d): %s",
-             odesc->name, slen, res.num_value, res.str_value.str);
-        return res;
+        slog(SLOG_INFO, "Value of %s as string (len %d): %s",
+             po->name, (int) res->str_value.len, res->str_value.str);
+        return;
     }
     else {
-        slog(SLOG_WARN, "Can't read option %s of type %d", odesc->name, odesc->type);
+        slog(SLOG_WARN, "Can't read option %s of type %d", po->name, po->type);
     }
-    return res;
 }
 
 
-// cleanup handler for sane_poll
-static void sane_thread_cleanup_mutex(void* arg) {
-    assert(arg != NULL);
-    slog(SLOG_DEBUG, "sane_thread_cleanup_mutex");
-    pthread_mutex_t* mutex = (pthread_mutex_t*)arg;
-    if (pthread_mutex_unlock(mutex) < 0) {
-        // if we can't unlock the mutex, something is heavily wrong!
-        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+// the layout cache (guarded by sane_layout_mutex): the layouts of the
+// device models, of the running backends (sane_layouts_reset())
+static pthread_mutex_t sane_layout_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sane_layout_t** sane_layouts = NULL;
+static int num_sane_layouts = 0;
+static SANE_Int sane_layout_version = 0;
+static bool sane_layouts_loaded = false; // the option cache was read
+
+static void sane_layout_free(sane_layout_t* l) {
+    for(int i = 0; i < l->num_options; i += 1) {
+        free(l->options[i].name);
     }
+    free(l->options);
+    free(l->index);
+    free(l->backend);
+    free(l->vendor);
+    free(l->model);
+    free(l);
 }
 
-// cleanup handler for sane_poll
-static void sane_thread_cleanup_value(void* arg) {
-    assert(arg != NULL);
-    slog(SLOG_DEBUG, "sane_thread_cleanup_value");
-    sane_opt_value_t* v = (sane_opt_value_t*)arg;
-    sane_option_value_free(v);
+static sane_layout_t* sane_layout_new(const char* backend, size_t backend_len,
+                                      const char* vendor, const char* model,
+                                      SANE_Int version, int num_of_options) {
+    sane_layout_t* l = (sane_layout_t*) calloc(1, sizeof(sane_layout_t));
+    assert(l != NULL);
+    l->backend = strndup(backend, backend_len);
+    l->vendor = strdup(vendor);
+    l->model = strdup(model);
+    assert(l->backend && l->vendor && l->model);
+    l->version = version;
+    l->num_of_options = num_of_options;
+    l->options = (sane_layout_option_t*) calloc(num_of_options + 1,
+                                                sizeof(sane_layout_option_t));
+    l->index = (int*) malloc((num_of_options + 1) * sizeof(int));
+    assert(l->options && l->index);
+    for(int i = 0; i <= num_of_options; i += 1) {
+        l->index[i] = -1;
+    }
+    return l;
+}
+
+// appends an option, the options are added in the order of their numbers
+static bool sane_layout_add(sane_layout_t* l, int number, SANE_Value_Type type,
+                            SANE_Int size, const char* name) {
+    if ((number <= 0) || (number >= l->num_of_options) || (l->index[number] >= 0) ||
+            ((l->num_options > 0) && (l->options[l->num_options - 1].number > number))) {
+        return false;
+    }
+    sane_layout_option_t* lo = &l->options[l->num_options];
+    lo->number = number;
+    lo->type = type;
+    lo->size = size;
+    lo->name = strdup(name);
+    assert(lo->name != NULL);
+    l->index[number] = l->num_options;
+    l->num_options += 1;
+    return true;
 }
 
+// the backend of a device is the prefix of its name (e.g. "genesys" of
+// "genesys:libusb:001:005")
+static size_t sane_backend_len(const char* name) {
+    const char* colon = strchr(name, ':');
+    return colon ? (size_t)(colon - name) : strlen(name);
+}
+
+static bool sane_layout_matches(const sane_layout_t* l, const sane_thread_t* st) {
+    size_t len = sane_backend_len(st->dev->name);
+    return (l->version == sane_layout_version) &&
+           (l->num_of_options == st->num_of_options) &&
+           (strlen(l->backend) == len) && (strncmp(l->backend, st->dev->name, len) == 0) &&
+           (strcmp(l->vendor, st->dev->vendor) == 0) &&
+           (strcmp(l->model, st->dev->model) == 0);
+}
 
+// walks all option descriptors of the opened device
 // this function can only be used in the critical region of *st
-static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
-    // TODO: use of recursive mutex???
-    slog(SLOG_DEBUG, "sane_find_matching_functions");
-    const char* title = cfg_title(sec);
-    if (title == NULL) {
-        title = SCANBD_NULL_STRING;
-    }
-    int functions = cfg_size(sec, C_FUNCTION);
-    if (functions <= 0) {
-        slog(SLOG_INFO, "no matching functions in section %s", title);
-        return;
+static sane_layout_t* sane_layout_walk(sane_thread_t* st) {
+    slog(SLOG_DEBUG, "sane_layout_walk %s", st->dev->name);
+    sane_layout_t* l = sane_layout_new(st->dev->name, sane_backend_len(st->dev->name),
+                                       st->dev->vendor, st->dev->model,
+                                       sane_layout_version, st->num_of_options);
+    for(int opt = 1; opt < st->num_of_options; opt += 1) {
+        const SANE_Option_Descriptor* odesc = NULL;
+        if ((odesc = sane_get_option_descriptor(st->h, opt)) == NULL) {
+            // no valid option-descriptor available
+            // skip it
+            slog(SLOG_INFO, "option[%d] has no valid descriptor", opt);
+            continue;
+        }
+        if (!SANE_OPTION_IS_ACTIVE(odesc->cap)) {
+            slog(SLOG_INFO, "option[%d] is not active", opt);
+            continue;
+        }
+        // option is active
+        // only use active (user controllable) options
+        if (odesc->name == NULL) {
+            // we need a valid option-name
+            slog(SLOG_INFO, "option[%d] has no name", opt);
+            continue;
+        }
+        if (!((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
+              (odesc->type == SANE_TYPE_FIXED)|| (odesc->type == SANE_TYPE_STRING) ||
+              (odesc->type == SANE_TYPE_BUTTON))) {
+            slog(SLOG_WARN, "option[%d] %s for device %s not of "
+                 "type BOOL|INT|FIXED|STRING|BUTTON. Skipping",
+                 opt, odesc->name, st->dev->name);
+            continue;
+        }
+        slog(SLOG_INFO, "found active option[%d] %s (type: %d) for device %s",
+             opt, odesc->name, odesc->type, st->dev->name);
+        sane_layout_add(l, opt, odesc->type, odesc->size, odesc->name);
     }
-    
-    slog(SLOG_INFO, "found %d functions in section %s", functions, title);
-    // iterate over all global functions
-    for(int i = 0; i < functions; i += 1) {
-        // get the function from the config file
-        cfg_t* function_i = cfg_getnsec(sec, C_FUNCTION, i);
-        assert(function_i != NULL);
+    return l;
+}
 
-        // get the filter-regex from the config-file
-        const char* opt_regex = cfg_getstr(function_i, C_FILTER);
-        assert(opt_regex != NULL);
+// copies the path of the option cache to path (PATH_MAX bytes)
+// returns false if it is disabled
+static bool sane_layout_cache_path(char* path) {
+    cfg_t* c = cfg_acquire();
+    cfg_t* cfg_sec_global = cfg_getsec(c, C_GLOBAL);
+    assert(cfg_sec_global);
+    const char* p = cfg_getstr(cfg_sec_global, C_OPTION_CACHE);
+    bool enabled = (p != NULL) && (strlen(p) > 0);
+    if (enabled) {
+        snprintf(path, PATH_MAX, "%s", p);
+    }
+    cfg_release(c);
+    return enabled;
+}
+
+// adds a layout to the cache, a layout with the same key is replaced
+// this function can only be used in the critical region of
+// sane_layout_mutex
+static void sane_layout_insert(sane_layout_t* l) {
+    int n = 0;
+    for(int i = 0; i < num_sane_layouts; i += 1) {
+        sane_layout_t* old = sane_layouts[i];
+        if ((strcmp(old->backend, l->backend) == 0) &&
+                (strcmp(old->vendor, l->vendor) == 0) &&
+                (strcmp(old->model, l->model) == 0)) {
+            old->cached = false;
+            if (old->refs == 0) {
+                sane_layout_free(old);
+            }
+            continue;
+        }
+        sane_layouts[n] = old;
+        n += 1;
+    }
+    num_sane_layouts = n;
+    sane_layouts = (sane_layout_t**) realloc(sane_layouts,
+                                             (num_sane_layouts + 1) * sizeof(sane_layout_t*));
+    assert(sane_layouts != NULL);
+    sane_layouts[num_sane_layouts] = l;
+    num_sane_layouts += 1;
+    l->cached = true;
+}
+
+// reads the layouts of the running backends from the option cache:
+//   layout<TAB>version<TAB>backend<TAB>vendor<TAB>model<TAB>options
+//   option<TAB>number<TAB>type<TAB>size<TAB>name
+// this function can only be used in the critical region of
+// sane_layout_mutex
+static void sane_layout_cache_load(void) {
+    char path[PATH_MAX];
+    if (!sane_layout_cache_path(path)) {
+        return;
+    }
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        if (errno != ENOENT) {
+            slog(SLOG_WARN, "Can't open option cache %s: %s", path, strerror(errno));
+        }
+        return;
+    }
+    int loaded = 0;
+    sane_layout_t* l = NULL;  // the layout read at the moment
+    bool ok = true;
+    char line[SANE_CACHE_LINE_MAX];
+    while(ok && (fgets(line, sizeof(line), f) != NULL)) {
+        if (strchr(line, '\n') == NULL) {
+            ok = false;
+            break;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if ((line[0] == '#') || (line[0] == '\0')) {
+            continue;
+        }
+        char* fields[6];
+        int num_fields = sane_split_fields(line, fields, 6);
+        if ((num_fields == 6) && (strcmp(fields[0], "layout") == 0)) {
+            if (l != NULL) {
+                sane_layout_insert(l);
+                loaded += 1;
+                l = NULL;
+            }
+            SANE_Int version = (SANE_Int) strtoul(fields[1], NULL, 16);
+            int num_of_options = atoi(fields[5]);
+            if ((version != sane_layout_version) || (num_of_options <= 0)) {
+                // of other backends, skip its options
+                continue;
+            }
+            l = sane_layout_new(fields[2], strlen(fields[2]), fields[3], fields[4],
+                                version, num_of_options);
+        }
+        else if ((num_fields == 5) && (strcmp(fields[0], "option") == 0)) {
+            if ((l != NULL) &&
+                    !sane_layout_add(l, atoi(fields[1]), (SANE_Value_Type) atoi(fields[2]),
+                                     (SANE_Int) atoi(fields[3]), fields[4])) {
+                ok = false;
+            }
+        }
+        else {
+            ok = false;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        slog(SLOG_WARN, "Ignoring the rest of the invalid option cache %s", path);
+        if (l != NULL) {
+            sane_layout_free(l);
+            l = NULL;
+        }
+    }
+    if (l != NULL) {
+        sane_layout_insert(l);
+        loaded += 1;
+    }
+    slog(SLOG_DEBUG, "read %d layouts of the option cache %s", loaded, path);
+}
+
+// writes the cached layouts to the option cache
+// this function can only be used in the critical region of
+// sane_layout_mutex
+static void sane_layout_cache_save(void) {
+    char path[PATH_MAX];
+    if (!sane_layout_cache_path(path)) {
+        return;
+    }
+    // replaced at once, a crash leaves the old cache
+    char tmp[PATH_MAX + sizeof(".tmp")];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (f == NULL) {
+        slog(SLOG_WARN, "Can't write option cache %s: %s", tmp, strerror(errno));
+        return;
+    }
+    fprintf(f, "# scanbd option cache, the option layouts of the device models\n");
+    for(int i = 0; i < num_sane_layouts; i += 1) {
+        const sane_layout_t* l = sane_layouts[i];
+        if (strpbrk(l->backend, "\t\n") || strpbrk(l->vendor, "\t\n") ||
+                strpbrk(l->model, "\t\n")) {
+            continue;
+        }
+        fprintf(f, "layout\t%x\t%s\t%s\t%s\t%d\n", (unsigned int) l->version,
+                l->backend, l->vendor, l->model, l->num_of_options);
+        for(int k = 0; k < l->num_options; k += 1) {
+            const sane_layout_option_t* lo = &l->options[k];
+            if (strpbrk(lo->name, "\t\n")) {
+                continue;
+            }
+            fprintf(f, "option\t%d\t%d\t%d\t%s\n", lo->number, (int) lo->type,
+                    (int) lo->size, lo->name);
+        }
+    }
+    if (fclose(f) != 0) {
+        slog(SLOG_WARN, "Can't write option cache %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    if (rename(tmp, path) < 0) {
+        slog(SLOG_WARN, "Can't replace option cache %s: %s", path, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+// returns the option layout of the opened device: the cached layout of
+// its model if it has the same number of options, otherwise the option
+// descriptors are walked and the layout is cached
+// this function can only be used in the critical region of *st
+static sane_layout_t* sane_layout_get(sane_thread_t* st) {
+    if (pthread_mutex_lock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (!sane_layouts_loaded) {
+        sane_layouts_loaded = true;
+        sane_layout_cache_load();
+    }
+    for(int i = 0; i < num_sane_layouts; i += 1) {
+        sane_layout_t* l = sane_layouts[i];
+        if (sane_layout_matches(l, st)) {
+            l->refs += 1;
+            if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+                slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+            }
+            slog(SLOG_INFO, "using the cached option layout of %s %s for device %s",
+                 l->vendor, l->model, st->dev->name);
+            return l;
+        }
+    }
+    if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+
+    // the other devices aren't blocked meanwhile
+    sane_layout_t* l = sane_layout_walk(st);
+
+    if (pthread_mutex_lock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    l->refs = 1;
+    if (l->version == sane_layout_version) {
+        sane_layout_insert(l);
+        sane_layout_cache_save();
+    }
+    if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return l;
+}
+
+// the device doesn't use the layout anymore
+static void sane_layout_release(sane_layout_t* l) {
+    if (l == NULL) {
+        return;
+    }
+    if (pthread_mutex_lock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    l->refs -= 1;
+    if ((l->refs == 0) && !l->cached) {
+        sane_layout_free(l);
+    }
+    if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// removes a layout which doesn't fit the device from the cache
+static void sane_layout_forget(sane_layout_t* l) {
+    if (pthread_mutex_lock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (l->cached) {
+        int n = 0;
+        for(int i = 0; i < num_sane_layouts; i += 1) {
+            if (sane_layouts[i] != l) {
+                sane_layouts[n] = sane_layouts[i];
+                n += 1;
+            }
+        }
+        num_sane_layouts = n;
+        l->cached = false;
+        sane_layout_cache_save();
+    }
+    if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// the backends were (re)initialized with the given version code: the
+// cached layouts of other versions are dropped
+void sane_layouts_reset(SANE_Int version) {
+    if (pthread_mutex_lock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (version != sane_layout_version) {
+        slog(SLOG_DEBUG, "sane_layouts_reset: backend version %x", (unsigned int) version);
+        for(int i = 0; i < num_sane_layouts; i += 1) {
+            sane_layouts[i]->cached = false;
+            if (sane_layouts[i]->refs == 0) {
+                sane_layout_free(sane_layouts[i]);
+            }
+        }
+        num_sane_layouts = 0;
+        sane_layout_version = version;
+        sane_layouts_loaded = false;
+    }
+    if (pthread_mutex_unlock(&sane_layout_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// this function can only be used in the critical region of *st
+static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
+    // TODO: use of recursive mutex???
+    slog(SLOG_DEBUG, "sane_find_matching_functions");
+    const char* title = cfg_title(sec);
+    if (title == NULL) {
+        title = SCANBD_NULL_STRING;
+    }
+    int functions = cfg_size(sec, C_FUNCTION);
+    if (functions <= 0) {
+        slog(SLOG_INFO, "no matching functions in section %s", title);
+        return;
+    }
+    
+    slog(SLOG_INFO, "found %d functions in section %s", functions, title);
+    // iterate over all global functions
+    for(int i = 0; i < functions; i += 1) {
+        // get the function from the config file
+        cfg_t* function_i = cfg_getnsec(sec, C_FUNCTION, i);
+        assert(function_i != NULL);
+
+        // get the filter-regex from the config-file
+        const char* opt_regex = cfg_getstr(function_i, C_FILTER);
+        assert(opt_regex != NULL);
 
         const char* title = cfg_title(function_i);
         if (title == NULL) {
@@ -310,39 +1494,12 @@ static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
             continue;
         }
         // look for matching option-names
-        for(int opt = 1; opt < st->num_of_options; opt += 1) {
-            const SANE_Option_Descriptor* odesc = NULL;
-            if ((odesc = sane_get_option_descriptor(st->h, opt)) == NULL) {
-                // no valid option-descriptor available
-                // skip it
-                slog(SLOG_INFO, "option[%d] has no valid descriptor", opt);
-                continue;
-            }
-            assert(odesc);
-            if (!SANE_OPTION_IS_ACTIVE(odesc->cap)) {
-                slog(SLOG_INFO, "option[%d] is not active", opt);
-                continue;
-            }
-            // option is active
-            // only use active (user controllable) options
-            if (odesc->name == NULL) {
-                // we need a valid option-name
-                slog(SLOG_INFO, "option[%d] has no name", opt);
-                continue;
-            }
-            assert(odesc->name);
-            if (!((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
-                  (odesc->type == SANE_TYPE_FIXED)|| (odesc->type == SANE_TYPE_STRING) ||
-                  (odesc->type == SANE_TYPE_BUTTON))) {
-                slog(SLOG_WARN, "option[%d] %s for device %s not of "
-                     "type BOOL|INT|FIXED|STRING|BUTTON. Skipping",
-                     opt, odesc->name, st->dev->name);
-                continue;
-            }
-            slog(SLOG_INFO, "found active option[%d] %s (type: %d) for device %s",
-                 opt, odesc->name, odesc->type, st->dev->name);
+        // (the active options of the layout, see sane_layout_walk())
+        for(int k = 0; k < st->layout->num_options; k += 1) {
+            const sane_layout_option_t* lo = &st->layout->options[k];
+            int opt = lo->number;
             // regex compare with the filter
-            if (regexec(&creg, odesc->name, 0, NULL, 0) != 0) {
+            if (regexec(&creg, lo->name, 0, NULL, 0) != 0) {
                 // no match
                 continue;
             }
@@ -352,7 +1509,7 @@ static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
             const char* env = cfg_getstr(function_i, C_ENV);
             assert(env != NULL);
             slog(SLOG_INFO, "installing function %s for %s, option[%d]: %s as env: %s",
-                 title, st->dev->name, opt, odesc->name, env);
+                 title, st->dev->name, opt, lo->name, env);
 
             // looking for option already present in the
             // array
@@ -371,7 +1528,9 @@ static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
             // not found => new
 
             st->functions[n].number = opt;
-            st->functions[n].env = env;
+            free(st->functions[n].env);
+            st->functions[n].env = strdup(env);
+            assert(st->functions[n].env != NULL);
 
             if (n == st->num_of_options_with_functions) {
                 // not found in the list
@@ -385,7 +1544,7 @@ static void sane_find_matching_functions(sane_thread_t* st, cfg_t* sec) {
 }
 
 // this function can only be used in the critical region of *st
-static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
+static void sane_find_matching_options(sane_thread_t* st, cfg_t* cfg_sec_global, cfg_t* sec) {
     slog(SLOG_DEBUG, "sane_find_matching_options");
     const char* title = cfg_title(sec);
     if (title == NULL) {
@@ -426,36 +1585,12 @@ static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
             continue;
         }
         // look for matching option-names
-        for(int opt = 1; opt < st->num_of_options; opt += 1) {
-            const SANE_Option_Descriptor* odesc = NULL;
-            if ((odesc = sane_get_option_descriptor(st->h, opt)) == NULL) {
-                // no valid option-descriptor available
-                // skip it
-                continue;
-            }
-            assert(odesc);
-            if (!SANE_OPTION_IS_ACTIVE(odesc->cap)) {
-                continue;
-            }
-            // option is active
-            // only use active (user controllable) options
-            if (odesc->name == NULL) {
-                // we need a valid option-name
-                continue;
-            }
-            assert(odesc->name);
-            if (!((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
-                  (odesc->type == SANE_TYPE_FIXED)|| (odesc->type == SANE_TYPE_STRING) ||
-                  (odesc->type == SANE_TYPE_BUTTON))) {
-                slog(SLOG_WARN, "option[%d] %s for device %s not of "
-                     "type BOOL|INT|FIXED|STRING|BUTTON. Skipping",
-                     opt, odesc->name, st->dev->name);
-                continue;
-            }
-            slog(SLOG_INFO, "found active option[%d] %s (type: %d) for device %s",
-                 opt, odesc->name, odesc->type, st->dev->name);
+        // (the active options of the layout, see sane_layout_walk())
+        for(int k = 0; k < st->layout->num_options; k += 1) {
+            const sane_layout_option_t* lo = &st->layout->options[k];
+            int opt = lo->number;
             // regex compare with the filter
-            if (regexec(&creg, odesc->name, 0, NULL, 0) != 0) {
+            if (regexec(&creg, lo->name, 0, NULL, 0) != 0) {
                 // no match
                 continue;
             }
@@ -471,13 +1606,7 @@ static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
 
             assert(script != NULL);
             slog(SLOG_INFO, "installing action %s (%d) for %s, option[%d]: %s as: %s",
-                 title, st->num_of_options_with_scripts, st->dev->name, opt, odesc->name, script);
-
-            // get pointer to global section of config
-
-            cfg_t* cfg_sec_global = NULL;
-            cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
-            assert(cfg_sec_global);
+                 title, st->num_of_options_with_scripts, st->dev->name, opt, lo->name, script);
 
             bool multiple_actions = cfg_getbool(cfg_sec_global, C_MULTIPLE_ACTIONS);
             slog(SLOG_INFO, "multiple actions allowed");
@@ -517,27 +1646,24 @@ static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
                 continue; // no space left in array
             }
             st->opts[n].number = opt;
-            st->opts[n].action_name = title;
-            st->opts[n].script = script;
+            free(st->opts[n].action_name);
+            st->opts[n].action_name = strdup(title);
+            free(st->opts[n].script);
+            st->opts[n].script = strdup(script);
+            assert(st->opts[n].action_name && st->opts[n].script);
             sane_option_value_free(&st->opts[n].from_value);
             sane_option_value_free(&st->opts[n].to_value);
-            sane_option_value_free(&st->opts[n].value);
 
-            if ((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
-                    (odesc->type == SANE_TYPE_FIXED) || (odesc->type == SANE_TYPE_BUTTON)) {
+            if ((lo->type == SANE_TYPE_BOOL) || (lo->type == SANE_TYPE_INT) ||
+                    (lo->type == SANE_TYPE_FIXED) || (lo->type == SANE_TYPE_BUTTON)) {
                 // numerical option
                 cfg_t* num_trigger = cfg_getsec(action_i, C_NUMERICAL_TRIGGER);
                 assert(num_trigger);
                 st->opts[n].from_value.num_value = cfg_getint(num_trigger,
                                                               C_FROM_VALUE);
                 st->opts[n].to_value.num_value = cfg_getint(num_trigger, C_TO_VALUE);
-
-                st->opts[n].value = get_sane_option_value(st->h, opt);
-
-                slog(SLOG_INFO, "Initial value of option %s is %d", odesc->name,
-                     st->opts[n].value);
             } // type BOOL | INT || FIXED
-            else if (odesc->type == SANE_TYPE_STRING) {
+            else if (lo->type == SANE_TYPE_STRING) {
                 bool valid = true;
                 // string option
                 cfg_t* str_trigger = cfg_getsec(action_i, C_STRING_TRIGGER);
@@ -573,12 +1699,9 @@ static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
                     valid = false;;
                 }
 
-                st->opts[n].value = get_sane_option_value(st->h, opt);
-
                 if (!valid) {
                     sane_option_value_free(&st->opts[n].from_value);
                     sane_option_value_free(&st->opts[n].to_value);
-                    sane_option_value_free(&st->opts[n].value);
                     continue;
                 }
             } // type STRING
@@ -596,36 +1719,271 @@ static void sane_find_matching_options(sane_thread_t* st, cfg_t* sec) {
     } // foreach action
 }
 
+// returns the pattern of the plan option po with the source of the
+// trigger value tv, the same patterns of several actions are matched
+// only once
+// this function can only be used in the critical region of *st
+static int sane_plan_add_pattern(sane_poll_plan_t* plan, sane_poll_option_t* po,
+                                 const sane_opt_value_t* tv) {
+    for(int i = po->first_pattern; i < plan->num_patterns; i += 1) {
+        if (strcmp(plan->patterns[i].source, tv->str_value.str) == 0) {
+            return i;
+        }
+    }
+    int i = plan->num_patterns;
+    pattern_compile(&plan->patterns[i], tv->str_value.str, tv->str_value.reg);
+    plan->num_patterns += 1;
+    po->num_patterns += 1;
+    return i;
+}
 
-// thread start funktion
-// TODO: refactor, this is awfull long!
+// appends the option number of the device to the poll plan
+// returns the plan option or -1 if the option of the layout doesn't fit
+// the descriptor of the device (the layout was cached for another
+// firmware of the model)
+// this function can only be used in the critical region of *st
+static int sane_plan_add_option(sane_thread_t* st, int number) {
+    assert(st->layout->index[number] >= 0); // only options of the layout are matched
+    const sane_layout_option_t* lo = &st->layout->options[st->layout->index[number]];
 
-static void* sane_poll(void* arg) {
-    sane_thread_t* st = (sane_thread_t*)arg;
-    assert(st != NULL);
-    slog(SLOG_DEBUG, "sane_poll");
-    // we only expect the main thread to handle signals
-    sigset_t mask;
-    sigfillset(&mask);
-    pthread_sigmask(SIG_BLOCK, &mask, NULL);
-    
-    static int si = 0;
+    const SANE_Option_Descriptor* odesc = NULL;
+    odesc = sane_get_option_descriptor(st->h, number);
+    if ((odesc == NULL) || !SANE_OPTION_IS_ACTIVE(odesc->cap) || (odesc->name == NULL) ||
+            (strcmp(odesc->name, lo->name) != 0) || (odesc->type != lo->type) ||
+            (odesc->size != lo->size)) {
+        slog(SLOG_INFO, "option[%d] %s doesn't fit the layout for device %s",
+             number, lo->name, st->dev->name);
+        return -1;
+    }
 
-    // this thread uses the device and the san_thread_t datastructure
-    // lock it
-    pthread_cleanup_push(sane_thread_cleanup_mutex, ((void*)&st->mutex));
-    if (pthread_mutex_lock(&st->mutex) < 0) {
-        // if we can't get the mutex, something is heavily wrong!
-        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-        pthread_exit(NULL);
+    int p = st->plan.num_options;
+    st->plan.options[p].number = number;
+    st->plan.options[p].type = lo->type;
+    st->plan.options[p].size = lo->size;
+    st->plan.options[p].name = strdup(lo->name);
+    assert(st->plan.options[p].name != NULL);
+    st->plan.options[p].first_trigger = 0;
+    st->plan.options[p].num_triggers = 0;
+    st->plan.options[p].first_pattern = 0;
+    st->plan.options[p].num_patterns = 0;
+    st->plan.num_options += 1;
+    return p;
+}
+
+// compiles the matched actions and functions into the poll plan of the
+// device and reads the initial values of the watched options
+// returns false if the layout doesn't fit the device, the partial plan
+// must be freed (sane_free_poll_plan())
+// this function can only be used in the critical region of *st
+static bool sane_build_poll_plan(sane_thread_t* st) {
+    slog(SLOG_DEBUG, "sane_build_poll_plan");
+    sane_poll_plan_t* plan = &st->plan;
+
+    int max_options = st->num_of_options_with_scripts + st->num_of_options_with_functions;
+    plan->options = calloc(max_options + 1, sizeof(sane_poll_option_t));
+    assert(plan->options != NULL);
+    plan->triggers = calloc(st->num_of_options_with_scripts + 1, sizeof(int));
+    assert(plan->triggers != NULL);
+    plan->trigger_option = calloc(st->num_of_options_with_scripts + 1, sizeof(int));
+    assert(plan->trigger_option != NULL);
+    plan->function_option = calloc(st->num_of_options_with_functions + 1, sizeof(int));
+    assert(plan->function_option != NULL);
+    plan->num_options = 0;
+    // at most two patterns per action
+    int max_patterns = 2 * st->num_of_options_with_scripts;
+    plan->patterns = calloc(max_patterns + 1, sizeof(pattern_t));
+    assert(plan->patterns != NULL);
+    plan->prev_matches = calloc(max_patterns + 1, sizeof(bool));
+    assert(plan->prev_matches != NULL);
+    plan->value_matches = calloc(max_patterns + 1, sizeof(bool));
+    assert(plan->value_matches != NULL);
+    plan->trigger_from = calloc(st->num_of_options_with_scripts + 1, sizeof(int));
+    assert(plan->trigger_from != NULL);
+    plan->trigger_to = calloc(st->num_of_options_with_scripts + 1, sizeof(int));
+    assert(plan->trigger_to != NULL);
+    plan->num_patterns = 0;
+
+    // option-number -> plan option
+    int* plan_index = malloc(st->num_of_options * sizeof(int));
+    assert(plan_index != NULL);
+    for(int i = 0; i < st->num_of_options; i += 1) {
+        plan_index[i] = -1;
     }
-    
+
+    // the options with actions (watched options)
+    for(int si = 0; si < st->num_of_options_with_scripts; si += 1) {
+        int number = st->opts[si].number;
+        assert((number > 0) && (number < st->num_of_options));
+        if (plan_index[number] < 0) {
+            plan_index[number] = sane_plan_add_option(st, number);
+            if (plan_index[number] < 0) {
+                free(plan_index);
+                return false;
+            }
+        }
+        plan->trigger_option[si] = plan_index[number];
+        plan->options[plan_index[number]].num_triggers += 1;
+    }
+    plan->num_watched = plan->num_options;
+
+    // the options only used as functions are read if an action runs
+    for(int f = 0; f < st->num_of_options_with_functions; f += 1) {
+        int number = st->functions[f].number;
+        assert((number > 0) && (number < st->num_of_options));
+        if (plan_index[number] < 0) {
+            plan_index[number] = sane_plan_add_option(st, number);
+            if (plan_index[number] < 0) {
+                free(plan_index);
+                return false;
+            }
+        }
+        plan->function_option[f] = plan_index[number];
+    }
+    free(plan_index);
+
+    // the fan-out lists: the triggers of an option are stored
+    // consecutively in the order of the actions
+    int first = 0;
+    for(int p = 0; p < plan->num_options; p += 1) {
+        plan->options[p].first_trigger = first;
+        first += plan->options[p].num_triggers;
+        plan->options[p].num_triggers = 0;
+    }
+    for(int si = 0; si < st->num_of_options_with_scripts; si += 1) {
+        sane_poll_option_t* po = &plan->options[plan->trigger_option[si]];
+        plan->triggers[po->first_trigger + po->num_triggers] = si;
+        po->num_triggers += 1;
+    }
+
+    // the distinct patterns of the string triggers of an option are
+    // stored consecutively
+    for(int p = 0; p < plan->num_watched; p += 1) {
+        sane_poll_option_t* po = &plan->options[p];
+        po->first_pattern = plan->num_patterns;
+        if (po->type != SANE_TYPE_STRING) {
+            continue;
+        }
+        for(int t = po->first_trigger; t < po->first_trigger + po->num_triggers; t += 1) {
+            int si = plan->triggers[t];
+            plan->trigger_from[si] = sane_plan_add_pattern(plan, po, &st->opts[si].from_value);
+            plan->trigger_to[si] = sane_plan_add_pattern(plan, po, &st->opts[si].to_value);
+        }
+    }
+
+    slog(SLOG_INFO, "polling %d options with %d actions for device %s",
+         plan->num_watched, st->num_of_options_with_scripts, st->dev->name);
+
+    // the value buffers are allocated once, a poll cycle swaps them
+    st->values = calloc(plan->num_options + 1, sizeof(sane_opt_value_t));
+    assert(st->values != NULL);
+    for(int p = 0; p < plan->num_options; p += 1) {
+        sane_option_value_alloc(&st->values[p], &plan->options[p]);
+    }
+    st->prev_values = calloc(plan->num_watched + 1, sizeof(sane_opt_value_t));
+    assert(st->prev_values != NULL);
+    for(int p = 0; p < plan->num_watched; p += 1) {
+        sane_option_value_alloc(&st->prev_values[p], &plan->options[p]);
+    }
+    for(int p = 0; p < plan->num_watched; p += 1) {
+        get_sane_option_value(st->h, &plan->options[p], &st->values[p]);
+        slog(SLOG_INFO, "Initial value of option %s is %d", plan->options[p].name,
+             st->values[p].num_value);
+    }
+    return true;
+}
+
+// this function can only be used in the critical region of *st
+static void sane_free_poll_plan(sane_thread_t* st) {
+    if (st->values != NULL) {
+        for(int p = 0; p < st->plan.num_options; p += 1) {
+            sane_option_value_free(&st->values[p]);
+        }
+        free(st->values);
+        st->values = NULL;
+    }
+    if (st->prev_values != NULL) {
+        for(int p = 0; p < st->plan.num_watched; p += 1) {
+            sane_option_value_free(&st->prev_values[p]);
+        }
+        free(st->prev_values);
+        st->prev_values = NULL;
+    }
+    for(int p = 0; p < st->plan.num_options; p += 1) {
+        free(st->plan.options[p].name);
+    }
+    for(int i = 0; i < st->plan.num_patterns; i += 1) {
+        pattern_free(&st->plan.patterns[i]);
+    }
+    free(st->plan.options);
+    free(st->plan.triggers);
+    free(st->plan.trigger_option);
+    free(st->plan.function_option);
+    free(st->plan.patterns);
+    free(st->plan.prev_matches);
+    free(st->plan.value_matches);
+    free(st->plan.trigger_from);
+    free(st->plan.trigger_to);
+    st->plan.options = NULL;
+    st->plan.triggers = NULL;
+    st->plan.trigger_option = NULL;
+    st->plan.function_option = NULL;
+    st->plan.patterns = NULL;
+    st->plan.prev_matches = NULL;
+    st->plan.value_matches = NULL;
+    st->plan.trigger_from = NULL;
+    st->plan.trigger_to = NULL;
+    st->plan.num_patterns = 0;
+    st->plan.num_options = 0;
+    st->plan.num_watched = 0;
+}
+
+// reads each watched option of the poll plan once into the snapshot,
+// the values of the last cycle are kept in prev_values (the buffers are
+// swapped, nothing is allocated)
+// returns true if a value changed
+// this function can only be used in the critical region of *st
+static bool sane_read_snapshot(sane_thread_t* st) {
+    bool changed = false;
+    for(int p = 0; p < st->plan.num_watched; p += 1) {
+        const sane_poll_option_t* po = &st->plan.options[p];
+        sane_opt_value_t prev = st->prev_values[p];
+        st->prev_values[p] = st->values[p];
+        st->values[p] = prev;
+        get_sane_option_value(st->h, po, &st->values[p]);
+
+        slog(SLOG_INFO, "checking option %s number %d for device %s: value: %d",
+             po->name, po->number, st->dev->name, st->values[p].num_value);
+        if (!sane_option_value_equal(po, &st->prev_values[p], &st->values[p])) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// reads the options only used by functions (not polled) into the
+// snapshot
+// this function can only be used in the critical region of *st
+static void sane_read_function_options(sane_thread_t* st) {
+    for(int p = st->plan.num_watched; p < st->plan.num_options; p += 1) {
+        get_sane_option_value(st->h, &st->plan.options[p], &st->values[p]);
+    }
+}
+
+static bool sane_match_device(sane_thread_t* st);
+
+// opens the device and figures out the matching actions and functions
+// returns false if the device can't be polled at all
+// this function can only be used in the critical region of *st
+static bool sane_setup_device(sane_thread_t* st) {
+    slog(SLOG_DEBUG, "sane_setup_device");
+
     // open the device this thread should poll
     SANE_Status status = 0;
     if ((status = sane_open(st->dev->name, &st->h)) != SANE_STATUS_GOOD) {
         slog(SLOG_ERROR, "Can't open device %s: %s", st->dev->name, sane_strstatus(status));
         slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
-        pthread_exit(NULL);
+        st->h = NULL;
+        return false;
     }
     // figure out the number of options this device has
     // option 0 (zero) is guaranteed to exist with the total number of
@@ -634,15 +1992,55 @@ static void* sane_poll(void* arg) {
     if ((status = sane_control_option(st->h, 0, SANE_ACTION_GET_VALUE,
                                       &st->num_of_options, 0)) != SANE_STATUS_GOOD) {
         slog(SLOG_ERROR, "Can't get the number of scanner options");
-        pthread_exit(NULL);
+        return false;
     }
     if (st->num_of_options == 0) {
         // no options -> nothing to poll
         slog(SLOG_INFO, "No options for device %s", st->dev->name);
-        pthread_exit(NULL);
+        return false;
     }
     slog(SLOG_INFO, "found %d options for device %s", st->num_of_options, st->dev->name);
 
+    if (!sane_match_device(st)) {
+        return false;
+    }
+    st->reconfigure = false;
+    return true;
+}
+
+// frees the matched actions and functions of the device
+// this function can only be used in the critical region of *st
+static void sane_free_matches(sane_thread_t* st) {
+    if (st->opts) {
+        slog(SLOG_DEBUG, "freeing opt resources for device %s thread",
+             st->dev->name);
+        // free the matching options list of that device / threads
+        for (int k = 0; k < st->num_of_options; k += 1) {
+            sane_option_value_free(&st->opts[k].from_value);
+            sane_option_value_free(&st->opts[k].to_value);
+            free(st->opts[k].script);
+            free(st->opts[k].action_name);
+        }
+        free(st->opts);
+        st->opts = NULL;
+    }
+    if (st->functions) {
+        slog(SLOG_DEBUG, "freeing function resources for device %s thread",
+             st->dev->name);
+        for (int k = 0; k < st->num_of_options; k += 1) {
+            free(st->functions[k].env);
+        }
+        free(st->functions);
+        st->functions = NULL;
+    }
+    st->num_of_options_with_scripts = 0;
+    st->num_of_options_with_functions = 0;
+}
+
+// figures out the matching actions and functions of the layout of the
+// device with the running config
+// this function can only be used in the critical region of *st
+static void sane_match_sections(sane_thread_t* st) {
     // allocate an array of options for the  matching actions
     //
     // only one script is possible per option, later matching
@@ -659,7 +2057,6 @@ static void* sane_poll(void* arg) {
     for(int i = 0; i < st->num_of_options; i += 1) {
         sane_option_value_init(&st->opts[i].from_value);
         sane_option_value_init(&st->opts[i].to_value);
-        sane_option_value_init(&st->opts[i].value);
     }
 
     // the number of valid entries in the above list
@@ -682,23 +2079,24 @@ static void* sane_poll(void* arg) {
 
     // find out the functions and actions
     // get the global sconfig section
+    cfg_t* c = cfg_acquire();
     cfg_t* cfg_sec_global = NULL;
-    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    cfg_sec_global = cfg_getsec(c, C_GLOBAL);
     assert(cfg_sec_global);
 
     // find the global actions
-    sane_find_matching_options(st, cfg_sec_global);
+    sane_find_matching_options(st, cfg_sec_global, cfg_sec_global);
 
     // find the global functions
     sane_find_matching_functions(st, cfg_sec_global);
     
     // find (if any) device specifc sections
     // these override global definitions, if any
-    int local_sections = cfg_size(cfg, C_DEVICE);
+    int local_sections = cfg_size(c, C_DEVICE);
     slog(SLOG_DEBUG, "found %d local device sections", local_sections);
     
     for(int loc = 0; loc < local_sections; loc += 1) {
-        cfg_t* loc_i = cfg_getnsec(cfg, C_DEVICE, loc);
+        cfg_t* loc_i = cfg_getnsec(c, C_DEVICE, loc);
         assert(loc_i != NULL);
 
         // get the filter-regex from the config-file
@@ -727,414 +2125,1258 @@ static void* sane_poll(void* arg) {
             slog(SLOG_INFO, "found %d local action for device %s [%s]",
                  loc_actions, st->dev->name, title);
             // get the local actions for this device
-            sane_find_matching_options(st, loc_i);
+            sane_find_matching_options(st, cfg_sec_global, loc_i);
             // get the local functions for this device
             sane_find_matching_functions(st, loc_i);
         }
         regfree(&creg);
     } // foreach local section
-    
-    int timeout = cfg_getint(cfg_sec_global, C_TIMEOUT);
-    if (timeout <= 0) {
-        timeout = C_TIMEOUT_DEF;
+    cfg_release(c);
+}
+
+// figures out the matching actions and functions of the opened device
+// with the running config and compiles the poll plan
+// returns false if the device can't be polled
+// this function can only be used in the critical region of *st
+static bool sane_match_device(sane_thread_t* st) {
+    if (st->layout == NULL) {
+        st->layout = sane_layout_get(st);
     }
-    slog(SLOG_DEBUG, "timeout: %d ms", timeout);
-    
-    slog(SLOG_DEBUG, "Start the polling for device %s", st->dev->name);
-    while(true) {
+    sane_match_sections(st);
+    if (sane_build_poll_plan(st)) {
+        return true;
+    }
+    // the cached layout is outdated, walk the descriptors once more
+    slog(SLOG_WARN, "option layout of %s %s changed, matching device %s again",
+         st->layout->vendor, st->layout->model, st->dev->name);
+    sane_free_poll_plan(st);
+    sane_free_matches(st);
+    sane_layout_forget(st->layout);
+    sane_layout_release(st->layout);
+    st->layout = sane_layout_get(st);
+    sane_match_sections(st);
+    if (sane_build_poll_plan(st)) {
+        return true;
+    }
+    // the device changed its options meanwhile
+    slog(SLOG_ERROR, "Can't match the options of device %s", st->dev->name);
+    sane_free_poll_plan(st);
+    sane_free_matches(st);
+    return false;
+}
 
-        slog(SLOG_DEBUG, "polling thread for %s cancellation point", st->dev->name);
-        // special cancellation point
-        pthread_testcancel();
-        slog(SLOG_DEBUG, "polling device %s", st->dev->name);
+// requeues the device without delay
+static void sched_wakeup_locked(sane_thread_t* st);
 
-        for(si = 0; si < st->num_of_options_with_scripts; si += 1) {
-            const SANE_Option_Descriptor* odesc = NULL;
-            odesc = sane_get_option_descriptor(st->h, st->opts[si].number);
-            assert(odesc);
+// the sane_job_* functions can only be used in the critical region
+// of sched_mutex
 
-            if (st->opts[si].script != NULL) {
-                if (strlen(st->opts[si].script) <= 0) {
-                    slog(SLOG_WARN, "No valid script for option %s for device %s",
-                         odesc->name, st->dev->name);
-                    continue;
-                }
-            }
-            else {
-                slog(SLOG_WARN, "No script for option %s for device %s",
-                     odesc->name, st->dev->name);
-                continue;
-            }
-            assert(st->opts[si].script != NULL);
-            assert(strlen(st->opts[si].script) > 0);
-
-            sane_opt_value_t value;
-            sane_option_value_init(&value);
-            // push the cleanup-handle to free the value storage
-            pthread_cleanup_push(sane_thread_cleanup_value, &value);
-
-            // get the actual value
-            // but don't query an option twice or more (see config multiple_actions)
-            // because this may reset the values and no other value changes can be
-            // detected
-            int o = 0;
-            bool gotAlready = false;
-            for(o = 0; o < si; o += 1) {
-                if (st->opts[o].number == st->opts[si].number) {
-                    gotAlready = true;
-                    break;
-                }
-            }
-            if (!gotAlready) {
-                // first query of option with this number
-                value = get_sane_option_value(st->h, st->opts[si].number);
-            }
-            else {
-                // additional query, so copy the value
-                slog(SLOG_INFO, "got the value already -> copy");
-                // found: copy the value
-                slog(SLOG_DEBUG, "copy the value of option %d", st->opts[o].number);
-                value.num_value = st->opts[o].value.num_value;
-                if (st->opts[o].value.str_value.str != NULL) {
-                    value.str_value.str = strdup(st->opts[o].value.str_value.str);
-                    assert(value.str_value.str != NULL);
-                }
-            }
+static bool sane_job_slot_free(void) {
+    return (max_sane_jobs <= 0) ||
+           (num_sane_jobs + num_sane_jobs_reserved < max_sane_jobs);
+}
 
-            slog(SLOG_INFO, "checking option %s number %d (%d) for device %s: value: %d",
-                 odesc->name, st->opts[si].number, si,
-                 st->dev->name, value);
-
-            if ((odesc->type == SANE_TYPE_BOOL) || (odesc->type == SANE_TYPE_INT) ||
-                    (odesc->type == SANE_TYPE_FIXED) || (odesc->type == SANE_TYPE_BUTTON)) {
-                if ((st->opts[si].from_value.num_value == st->opts[si].value.num_value) &&
-                        (st->opts[si].to_value.num_value == value.num_value)) {
-                    slog(SLOG_DEBUG, "value trigger: numerical");
-                    st->triggered = true;
-                    st->triggered_option = si;
-                    // we need to trigger all waiting threads
-                    if (pthread_cond_broadcast(&st->cv) < 0) {
-                        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
-                    }
-                }
-            }
-            else if (odesc->type == SANE_TYPE_STRING) {
-                if ((regexec(st->opts[si].from_value.str_value.reg,
-                             st->opts[si].value.str_value.str, 0, NULL, 0) == 0) &&
-                        (regexec(st->opts[si].to_value.str_value.reg,
-                                 value.str_value.str, 0, NULL, 0) == 0)) {
-                    slog(SLOG_DEBUG, "value trigger: string");
-                    st->triggered = true;
-                    st->triggered_option = si;
-                    // we need to trigger all waiting threads
-                    if (pthread_cond_broadcast(&st->cv) < 0) {
-                        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
-                    }
-                }
-            }
-            else {
-                assert(false);
-            }
-            // free the previous allocated value
-            sane_option_value_free(&st->opts[si].value);
+// hands the free job slots to the waiting devices
+static void sane_job_grant(void) {
+    while((num_sane_job_waiters > 0) && sane_job_slot_free()) {
+        sane_thread_t* st = sane_job_waiters[0];
+        num_sane_job_waiters -= 1;
+        memmove(sane_job_waiters, sane_job_waiters + 1,
+                num_sane_job_waiters * sizeof(sane_thread_t*));
+        slog(SLOG_DEBUG, "job slot granted to device %s", st->dev->name);
+        st->job_granted = true;
+        num_sane_jobs_reserved += 1;
+        sched_wakeup_locked(st);
+    }
+}
 
-            // pass the responsibility to free the value to the main
-            // thread, if this thread gets canceled
-            if (pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL) < 0) {
-                slog(SLOG_ERROR, "pthread_setcancelstate: %s", strerror(errno));
-            }
-            st->opts[si].value = value;
-            pthread_cleanup_pop(0);
-            if (pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) < 0) {
-                slog(SLOG_ERROR, "pthread_setcancelstate: %s", strerror(errno));
-            }
+static void sane_job_wait(sane_thread_t* st) {
+    for(int i = 0; i < num_sane_job_waiters; i += 1) {
+        if (sane_job_waiters[i] == st) {
+            return;
+        }
+    }
+    if (num_sane_job_waiters == sane_job_waiters_capacity) {
+        sane_job_waiters_capacity = (sane_job_waiters_capacity > 0) ? 2 * sane_job_waiters_capacity : 4;
+        sane_job_waiters = (sane_thread_t**) realloc(sane_job_waiters,
+                                                     sane_job_waiters_capacity * sizeof(sane_thread_t*));
+        assert(sane_job_waiters != NULL);
+    }
+    slog(SLOG_INFO, "all %d action jobs busy, device %s waits",
+         max_sane_jobs, st->dev->name);
+    sane_job_waiters[num_sane_job_waiters] = st;
+    num_sane_job_waiters += 1;
+}
 
-            // was there a value change?
-            if (st->triggered && (st->triggered_option >= 0)) {
-                assert(st->triggered_option >= 0); // index into the opts-array
-                assert(st->triggered_option < st->num_of_options_with_scripts);
-
-                slog(SLOG_ERROR, "trigger action for %s for device %s with script %s",
-                     odesc->name, st->dev->name, st->opts[st->triggered_option].script);
-
-                // prepare the environment for the script to be called
-
-                // number of env-vars =
-                // number of found function-options
-                // plus the values in the environment-section (2):
-                // device, action
-                // plus those 4:
-                // PATH, PWD, USER, HOME
-                // plus the sentinel
-                cfg_t* global_envs = cfg_getsec(cfg_sec_global, C_ENVIRONMENT);
-
-                int number_of_envs = st->num_of_options_with_functions + 4 + 2 + 1;
-                char** env = calloc(number_of_envs, sizeof(char*));
-                for(int e = 0; e < number_of_envs; e += 1) {
-                    env[e] = calloc(NAME_MAX + 1, sizeof(char));
-                }
-                int e = 0;
-                for(e = 0; e < st->num_of_options_with_functions; e += 1) {
-                    const SANE_Option_Descriptor* fdesc = NULL;
-                    fdesc = sane_get_option_descriptor(st->h,
-                                                       st->functions[e].number);
-                    assert(fdesc);
-
-                    // check if the function-option is the same
-                    // as a action-option. If so, use the
-                    // action-option value instead of re-get the same
-                    // option value, because it is (may be) reset
-                    // after the query by the backend
-
-                    sane_opt_value_t v;
-                    sane_option_value_init(&v);
-                    int o = 0;
-                    for(o = 0; o < st->num_of_options_with_scripts; o += 1) {
-                        if (st->opts[o].number == st->functions[e].number) {
-                            break;
-                        }
-                    }
-                    if (o == st->num_of_options_with_scripts) {
-                        // not found: query the value
-                        v = get_sane_option_value(st->h, st->functions[e].number);
-                    }
-                    else {
-                    }
-                    if ((fdesc->type == SANE_TYPE_BOOL) || (fdesc->type == SANE_TYPE_INT) ||
-                            (fdesc->type == SANE_TYPE_FIXED) || (odesc->type == SANE_TYPE_BUTTON)) {
-                        snprintf(env[e], NAME_MAX, "%s=%lu", st->functions[e].env,
-                                 v.num_value);
-                        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    }
-                    else if (fdesc->type == SANE_TYPE_STRING) {
-                        snprintf(env[e], NAME_MAX, "%s=%s", st->functions[e].env,
-                                 v.str_value.str);
-                        slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    }
-                    else {
-                        assert(false);
-                    }
-                    sane_option_value_free(&v);
-                }
-                const char* ev = "PATH";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, "/usr/sbin:/usr/bin:/sbin:/bin");
-                    slog(SLOG_DEBUG, "No PATH, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = "PWD";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    char buf[PATH_MAX];
-                    char* ptr = getcwd(buf, PATH_MAX - 1);
-                    if (!ptr) {
-                        slog(SLOG_ERROR, "can't get pwd");
-                    }
-                    else {
-                        assert(ptr);
-                        snprintf(env[e], NAME_MAX, "%s=%s", ev, ptr);
-                        slog(SLOG_DEBUG, "No PWD, setting env: %s", env[e]);
-                        e += 1;
-                    }
-                }
-                ev = "USER";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    struct passwd* pwd = NULL;
-                    pwd = getpwuid(geteuid());
-                    assert(pwd);
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_name);
-                    slog(SLOG_DEBUG, "No USER, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = "HOME";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    struct passwd* pwd = 0;
-                    pwd = getpwuid(geteuid());
-                    assert(pwd);
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_dir);
-                    slog(SLOG_DEBUG, "No HOME, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = cfg_getstr(global_envs, C_DEVICE);
-                if (ev != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, st->dev->name);
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = cfg_getstr(global_envs, C_ACTION);
-                if (ev != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev,
-                             st->opts[st->triggered_option].action_name);
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                env[e] = NULL;
-                assert(e == number_of_envs-1);
-
-                // sendout an dbus-signal with all the values as
-                // arguments
-                dbus_send_signal(SCANBD_DBUS_SIGNAL_SCAN_BEGIN, st->dev->name);
-
-                //dbus_send_signal_argv_async(SCANBD_DBUS_SIGNAL_TRIGGER, env);
-                dbus_send_signal_argv(SCANBD_DBUS_SIGNAL_TRIGGER, env);
-                // the action-script will use the device,
-                // so we have to release the device
-                sane_close(st->h);
-                st->h = NULL;
-
-                assert(st->triggered_option >= 0);
-                assert(st->opts[st->triggered_option].script);
-                assert(strlen(st->opts[st->triggered_option].script) > 0);
-
-                // need to copy the values because we leave the
-                // critical section
-                // While doing so, convert the script to an absolute path
-                // int triggered_option = st->triggered_option;
-          
-                char *script_abs = 
-                     make_script_path_abs(st->opts[st->triggered_option].script);
-                
-                assert(script_abs);
-
-                // leave the critical section
-                if (pthread_mutex_unlock(&st->mutex) < 0) {
-                    // if we can't unlock the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
+// gives up the waiting or the granted job slot of a released device
+static void sane_job_cancel_wait(sane_thread_t* st) {
+    for(int i = 0; i < num_sane_job_waiters; i += 1) {
+        if (sane_job_waiters[i] == st) {
+            num_sane_job_waiters -= 1;
+            memmove(sane_job_waiters + i, sane_job_waiters + i + 1,
+                    (num_sane_job_waiters - i) * sizeof(sane_thread_t*));
+            break;
+        }
+    }
+    if (st->job_granted) {
+        st->job_granted = false;
+        num_sane_jobs_reserved -= 1;
+        sane_job_grant();
+    }
+}
 
-                if (strcmp(script_abs, SCANBD_NULL_STRING) != 0) {
+// reserves a job slot for the next action of the device, if all slots
+// are used the device waits for a slot
+static bool sane_job_reserve(sane_thread_t* st) {
+    if (st->job_granted) {
+        // the slot is already reserved
+        st->job_granted = false;
+        return true;
+    }
+    if ((num_sane_job_waiters == 0) && sane_job_slot_free()) {
+        num_sane_jobs_reserved += 1;
+        return true;
+    }
+    sane_job_wait(st);
+    return false;
+}
 
-                    assert(timeout > 0);
-                    usleep(timeout * 1000); //ms
+static void sane_job_add(sane_action_job_t* job) {
+    assert(num_sane_jobs_reserved > 0);
+    num_sane_jobs_reserved -= 1;
+    if (num_sane_jobs == sane_jobs_capacity) {
+        sane_jobs_capacity = (sane_jobs_capacity > 0) ? 2 * sane_jobs_capacity : 4;
+        sane_jobs = (sane_action_job_t**) realloc(sane_jobs,
+                                                  sane_jobs_capacity * sizeof(sane_action_job_t*));
+        assert(sane_jobs != NULL);
+    }
+    sane_jobs[num_sane_jobs] = job;
+    num_sane_jobs += 1;
+    job->listed = true;
+}
 
-                    pid_t cpid;
-                    if ((cpid = fork()) < 0) {
-                        slog(SLOG_ERROR, "Can't fork: %s", strerror(errno));
-                    }
-                    else if (cpid > 0) { // parent
-                        slog(SLOG_INFO, "waiting for child: %s", script_abs);
-                        int status;
-                        if (waitpid(cpid, &status, 0) < 0) {
-                            slog(SLOG_ERROR, "waitpid: %s", strerror(errno));
-                        }
-                        if (WIFEXITED(status)) {
-                            slog(SLOG_INFO, "child %s exited with status: %d",
-                                 script_abs, WEXITSTATUS(status));
-                        }
-                        if (WIFSIGNALED(status)) {
-                            slog(SLOG_INFO, "child %s signaled with signal: %d",
-                                 script_abs, WTERMSIG(status));
-                        }
-                    }
-                    else { // child
-                        slog(SLOG_DEBUG, "exec for %s", script_abs);
-                        if (execle(script_abs, script_abs, NULL, env) < 0) {
-                            slog(SLOG_ERROR, "execlp: %s", strerror(errno));
-                        }
-                        exit(EXIT_FAILURE); // not reached
-                    }
-                } // script_abs == SCANBD_NULL_STRING
+// gives up the job slot of the job, if it still holds one
+static void sane_job_remove(sane_action_job_t* job) {
+    if (!job->listed) {
+        return;
+    }
+    for(int i = 0; i < num_sane_jobs; i += 1) {
+        if (sane_jobs[i] == job) {
+            num_sane_jobs -= 1;
+            sane_jobs[i] = sane_jobs[num_sane_jobs];
+            job->listed = false;
+            sane_job_grant();
+            return;
+        }
+    }
+    assert(false);
+}
 
-                assert(script_abs != NULL);
-                free(script_abs);
+// is the device still used by the script of a released device?
+static bool sane_job_device_busy(const char* dev_name) {
+    for(int i = 0; i < num_sane_jobs; i += 1) {
+        if ((sane_jobs[i]->st == NULL) && (sane_jobs[i]->state == SANE_JOB_RUNNING) &&
+                (strcmp(sane_jobs[i]->dev_name, dev_name) == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-                // free (last element is the sentinel!)
-                assert(env != NULL);
-                for(int e = 0; e < number_of_envs - 1; e += 1) {
-                    assert(env[e] != NULL);
-                    free(env[e]);
-                }
-                free(env);
+static void sane_job_free(sane_action_job_t* job) {
+    launcher_env_free(&job->env);
+    free(job->script);
+    free(job->dev_name);
+    free(job);
+}
 
-                // enter the critical section
-                if (pthread_mutex_lock(&st->mutex) < 0) {
-                    // if we can't get the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
+static void sane_job_log_status(const sane_action_job_t* job) {
+    if (job->status < 0) {
+        slog(SLOG_WARN, "lost child %s of device %s", job->script, job->dev_name);
+    }
+    else if (WIFEXITED(job->status)) {
+        slog(SLOG_INFO, "child %s exited with status: %d",
+             job->script, WEXITSTATUS(job->status));
+    }
+    else if (WIFSIGNALED(job->status)) {
+        slog(SLOG_INFO, "child %s signaled with signal: %d",
+             job->script, WTERMSIG(job->status));
+    }
+}
 
-                st->triggered = false;
-                st->triggered_option = -1; // invalid
-                // we need to trigger all waiting threads
-                if (pthread_cond_broadcast(&st->cv) < 0) {
-                    slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
-                }
+// reserves a job slot for the next action of the device (see
+// sane_job_reserve())
+static bool sane_job_acquire(sane_thread_t* st) {
+    bool reserved = false;
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    reserved = sane_job_reserve(st);
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return reserved;
+}
 
-                // leave the critical section
-                if (pthread_mutex_unlock(&st->mutex) < 0) {
-                    // if we can't release the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
-                // sleep the timeout to settle devices, necessary?
-                usleep(timeout * 1000); //ms
+// reserves a job slot again for the job of the device, if the job gave
+// up its slot while the device was acquired
+// returns false if the device waits for a slot
+static bool sane_job_relist(sane_thread_t* st) {
+    bool listed = false;
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    listed = st->job->listed;
+    if (!listed && sane_job_reserve(st)) {
+        sane_job_add(st->job);
+        listed = true;
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return listed;
+}
 
-                // send out the debus signal
-                dbus_send_signal(SCANBD_DBUS_SIGNAL_SCAN_END, st->dev->name);
+// the state of the action job of the device
+static enum sane_job_state sane_job_state(sane_thread_t* st) {
+    enum sane_job_state state = SANE_JOB_NONE;
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (st->job != NULL) {
+        state = st->job->state;
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return state;
+}
 
-                // enter the critical section
-                if (pthread_mutex_lock(&st->mutex) < 0) {
-                    // if we can't get the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
+// the sane_pending_* functions can only be used in the critical region
+// of *st
+
+// adds the action to the backlog of the device, returns false if the
+// action is dropped
+static bool sane_pending_push(sane_thread_t* st, int action) {
+    if (sane_backlog_coalesce) {
+        for(int i = 0; i < st->num_pending; i += 1) {
+            if (st->pending[i] == action) {
+                slog(SLOG_DEBUG, "action %s of device %s already queued",
+                     st->opts[action].action_name, st->dev->name);
+                return false;
+            }
+        }
+    }
+    if (st->num_pending >= sane_backlog_size) {
+        slog(SLOG_WARN, "backlog of device %s is full, action %s dropped",
+             st->dev->name, st->opts[action].action_name);
+        return false;
+    }
+    if (st->num_pending == st->pending_capacity) {
+        st->pending_capacity = (st->pending_capacity > 0) ? 2 * st->pending_capacity : 4;
+        st->pending = (int*) realloc(st->pending, st->pending_capacity * sizeof(int));
+        assert(st->pending != NULL);
+    }
+    slog(SLOG_DEBUG, "queue action %d of device %s", action, st->dev->name);
+    st->pending[st->num_pending] = action;
+    st->num_pending += 1;
+    return true;
+}
 
-                slog(SLOG_DEBUG, "reopen device %s", st->dev->name);
-                if ((status = sane_open(st->dev->name, &st->h)) != SANE_STATUS_GOOD) {
-                    slog(SLOG_ERROR, "Can't open device %s, %s",
-                         st->dev->name, sane_strstatus(status));
-                    if (status == SANE_STATUS_ACCESS_DENIED) {
-                        slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
-                        pthread_exit(NULL);
-                    }
-                }
-            } // if triggered
-        } // foreach option
+static int sane_pending_pop(sane_thread_t* st) {
+    assert(st->num_pending > 0);
+    int action = st->pending[0];
+    st->num_pending -= 1;
+    memmove(st->pending, st->pending + 1, st->num_pending * sizeof(int));
+    return action;
+}
+
+// called by the reaper thread of the launcher
+static void sane_action_done(pid_t pid, int status, void* arg);
+
+// starts the action of the device:
+// sends the signals, closes the device and creates the action job,
+// the script is started by sane_spawn_action() after the settle timeout
+// a job slot must be reserved by sane_job_acquire()
+// this function can only be used in the critical region of *st
+static void sane_start_action(sane_thread_t* st, int action) {
+    assert(action >= 0); // index into the opts-array
+    assert(action < st->num_of_options_with_scripts);
+    assert(st->job == NULL);
+
+    st->triggered = true;
+    st->triggered_option = action;
+
+    const sane_poll_option_t* topt =
+            &st->plan.options[st->plan.trigger_option[st->triggered_option]];
+
+    slog(SLOG_ERROR, "trigger action for %s for device %s with script %s",
+         topt->name, st->dev->name, st->opts[st->triggered_option].script);
+
+    // prepare the environment for the script to be called:
+    // the values of the function-options, PATH, PWD, USER, HOME and
+    // the values in the environment-section (device, action)
+    cfg_t* c = cfg_acquire();
+    cfg_t* cfg_sec_global = NULL;
+    cfg_sec_global = cfg_getsec(c, C_GLOBAL);
+    assert(cfg_sec_global);
+    cfg_t* global_envs = cfg_getsec(cfg_sec_global, C_ENVIRONMENT);
+
+    // the function-options which are also action-options have the
+    // value of the poll cycle in the snapshot (re-getting it may see a
+    // value reset by the backend after the query), the other ones are
+    // read once into the snapshot now
+    sane_read_function_options(st);
+
+    launcher_env_t le;
+    launcher_env_init(&le);
+    for(int e = 0; e < st->num_of_options_with_functions; e += 1) {
+        int p = st->plan.function_option[e];
+        const sane_poll_option_t* fopt = &st->plan.options[p];
+        const sane_opt_value_t* v = &st->values[p];
+
+        if ((fopt->type == SANE_TYPE_BOOL) || (fopt->type == SANE_TYPE_INT) ||
+                (fopt->type == SANE_TYPE_FIXED) || (fopt->type == SANE_TYPE_BUTTON)) {
+            launcher_env_add(&le, st->functions[e].env, "%lu", v->num_value);
+        }
+        else if (fopt->type == SANE_TYPE_STRING) {
+            launcher_env_add(&le, st->functions[e].env, "%s",
+                             v->str_value.str ? v->str_value.str : "");
+        }
+        else {
+            assert(false);
+        }
+    }
+    launcher_env_add_defaults(&le);
+    const char* ev = cfg_getstr(global_envs, C_DEVICE);
+    if (ev != NULL) {
+        launcher_env_add(&le, ev, "%s", st->dev->name);
+    }
+    ev = cfg_getstr(global_envs, C_ACTION);
+    if (ev != NULL) {
+        launcher_env_add(&le, ev, "%s", st->opts[st->triggered_option].action_name);
+    }
+    char** env = launcher_env_finish(&le);
+    cfg_release(c);
+
+    // sendout an dbus-signal with all the values as
+    // arguments
+    dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_BEGIN, st->dev->name);
+
+    dbus_send_signal_argv_async(SCANBD_DBUS_SIGNAL_TRIGGER, env);
+    // the action-script will use the device,
+    // so we have to release the device
+    sane_close(st->h);
+    st->h = NULL;
+
+    assert(st->triggered_option >= 0);
+    assert(st->opts[st->triggered_option].script);
+    assert(strlen(st->opts[st->triggered_option].script) > 0);
+
+    sane_action_job_t* job = (sane_action_job_t*) calloc(1, sizeof(sane_action_job_t));
+    assert(job != NULL);
+    job->state = SANE_JOB_SETTLE;
+    job->st = st;
+    job->dev_name = strdup(st->dev->name);
+    // convert the script to an absolute path
+    job->script = make_script_path_abs(st->opts[st->triggered_option].script);
+    assert(job->dev_name && job->script);
+    job->env = le;
+    job->pid = -1;
+    job->status = 0;
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    sane_job_add(job);
+    st->job = job;
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// starts the script of the action job, the device isn't polled until
+// the reaper reports the termination
+// this function can only be used in the critical region of *st
+static void sane_spawn_action(sane_thread_t* st) {
+    sane_action_job_t* job = st->job;
+    assert(job != NULL);
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    // before spawning, the reaper may report the termination at once
+    job->state = SANE_JOB_RUNNING;
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+
+    pid_t pid = -1;
+    if (strcmp(job->script, SCANBD_NULL_STRING) != 0) {
+        pid = launcher_spawn_async(job->script, job->env.env, sane_action_done, job);
+    }
+    launcher_env_free(&job->env);
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    if (pid < 0) {
+        job->state = SANE_JOB_DONE;
+        job->status = -1;
+    }
+    else {
+        slog(SLOG_INFO, "started child %d: %s", pid, job->script);
+        job->pid = pid;
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+static void sane_check_reopened_device(sane_thread_t* st);
+
+// finishes the terminated action job and reopens the device
+// this function can only be used in the critical region of *st
+static void sane_finish_action(sane_thread_t* st) {
+    sane_action_job_t* job = st->job;
+    assert(job != NULL);
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    assert(job->state == SANE_JOB_DONE);
+    sane_job_remove(job);
+    st->job = NULL;
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (job->pid >= 0) {
+        sane_job_log_status(job);
+    }
+    sane_job_free(job);
+
+    st->triggered = false;
+    st->triggered_option = -1; // invalid
+    // we need to trigger all waiting threads
+    if (pthread_cond_broadcast(&st->cv) < 0) {
+        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
+    }
+
+    // send out the debus signal
+    dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_END, st->dev->name);
+
+    slog(SLOG_DEBUG, "reopen device %s", st->dev->name);
+    SANE_Status status = 0;
+    if ((status = sane_open(st->dev->name, &st->h)) != SANE_STATUS_GOOD) {
+        slog(SLOG_ERROR, "Can't open device %s, %s",
+             st->dev->name, sane_strstatus(status));
+        st->h = NULL;
+        if (status == SANE_STATUS_ACCESS_DENIED) {
+            slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
+            st->abandoned = true;
+        }
+        return;
+    }
+    sane_check_reopened_device(st);
+}
+
+// matches the actions and functions of the device again with the
+// changed config or the changed number of options, the device isn't
+// closed: the new poll plan replaces the old one in the critical region
+// of *st, so a poll cycle sees either the old or the new plan
+// the actions queued for the old plan are dropped
+// this function can only be used in the critical region of *st
+static void sane_reconfigure_device(sane_thread_t* st, int num_of_options) {
+    slog(SLOG_INFO, "reconfigure device %s", st->dev->name);
+    assert(st->job == NULL);
+    if (st->num_pending > 0) {
+        slog(SLOG_WARN, "config changed, %d queued actions of device %s dropped",
+             st->num_pending, st->dev->name);
+        st->num_pending = 0;
+    }
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    sane_job_cancel_wait(st);
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    sane_free_poll_plan(st);
+    sane_free_matches(st);
+    if (num_of_options != st->num_of_options) {
+        // another layout
+        st->num_of_options = num_of_options;
+        sane_layout_release(st->layout);
+        st->layout = NULL;
+    }
+    if (!sane_match_device(st)) {
+        slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
+        st->abandoned = true;
+    }
+    st->reconfigure = false;
+}
+
+// checks the number of options of the reopened device, the poll plan
+// is only kept if it is unchanged (e.g. the backend wasn't updated
+// meanwhile)
+// this function can only be used in the critical region of *st
+static void sane_check_reopened_device(sane_thread_t* st) {
+    SANE_Int num_of_options = 0;
+    SANE_Status status = 0;
+    if ((status = sane_control_option(st->h, 0, SANE_ACTION_GET_VALUE,
+                                      &num_of_options, 0)) != SANE_STATUS_GOOD) {
+        slog(SLOG_WARN, "Can't get the number of scanner options: %s",
+             sane_strstatus(status));
+        return;
+    }
+    if (num_of_options == st->num_of_options) {
+        return;
+    }
+    slog(SLOG_INFO, "device %s has %d options instead of %d",
+         st->dev->name, num_of_options, st->num_of_options);
+    if (num_of_options <= 0) {
+        slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
+        st->abandoned = true;
+        return;
+    }
+    sane_reconfigure_device(st, num_of_options);
+}
+
+// matches the changed value of the string option po and its previous
+// value against the distinct patterns of its triggers, each pattern is
+// matched once for all actions of the option
+static void sane_match_patterns(const sane_poll_plan_t* plan, const sane_poll_option_t* po,
+                                const sane_opt_value_t* prev, const sane_opt_value_t* value) {
+    for(int i = po->first_pattern; i < po->first_pattern + po->num_patterns; i += 1) {
+        plan->prev_matches[i] = pattern_match(&plan->patterns[i], prev->str_value.str,
+                                              prev->str_value.len);
+        plan->value_matches[i] = pattern_match(&plan->patterns[i], value->str_value.str,
+                                               value->str_value.len);
+    }
+}
+
+// checks if the value change prev -> value of the option po fires the
+// action si (opt)
+// the string triggers are checked with the pattern matches of
+// sane_match_patterns()
+static bool sane_option_triggers(const sane_poll_plan_t* plan, const sane_poll_option_t* po,
+                                 int si, const sane_dev_option_t* opt,
+                                 const sane_opt_value_t* prev, const sane_opt_value_t* value) {
+    if ((po->type == SANE_TYPE_BOOL) || (po->type == SANE_TYPE_INT) ||
+            (po->type == SANE_TYPE_FIXED) || (po->type == SANE_TYPE_BUTTON)) {
+        if ((opt->from_value.num_value == prev->num_value) &&
+                (opt->to_value.num_value == value->num_value)) {
+            slog(SLOG_DEBUG, "value trigger: numerical");
+            return true;
+        }
+    }
+    else if (po->type == SANE_TYPE_STRING) {
+        if (plan->prev_matches[plan->trigger_from[si]] &&
+                plan->value_matches[plan->trigger_to[si]]) {
+            slog(SLOG_DEBUG, "value trigger: string");
+            return true;
+        }
+    }
+    else {
+        assert(false);
+    }
+    return false;
+}
+
+// starts or queues the actions of the plan option p fired by the value
+// change prev -> value
+// this function can only be used in the critical region of *st
+static void sane_fire_triggers(sane_thread_t* st, int p, const sane_opt_value_t* prev,
+                               const sane_opt_value_t* value) {
+    const sane_poll_plan_t* plan = &st->plan;
+    const sane_poll_option_t* po = &plan->options[p];
+
+    // all actions of this option see the same value change
+    for(int t = po->first_trigger; t < po->first_trigger + po->num_triggers; t += 1) {
+        int si = plan->triggers[t];
+        if (!sane_option_triggers(plan, po, si, &st->opts[si], prev, value)) {
+            continue;
+        }
+        if ((st->job == NULL) && (st->num_pending == 0) && sane_job_acquire(st)) {
+            // closes the device, the actions fired by the
+            // remaining options of the snapshot are queued
+            sane_start_action(st, si);
+        }
+        else {
+            // more than one action fired in this cycle, older
+            // actions are waiting or all job slots are used
+            sane_pending_push(st, si);
+        }
+    }
+}
+
+// one poll cycle of a device, run by a poll worker
+// returns true if an option value changed or an action was started or
+// finished
+static bool sane_poll_device(sane_thread_t* st) {
+    assert(st != NULL);
+    bool activity = false;
+
+    // this worker uses the device and the sane_thread_t datastructure
+    // lock it
+    if (pthread_mutex_lock(&st->mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+
+    switch(sane_job_state(st)) {
+    case SANE_JOB_SETTLE:
+        if (!sane_job_relist(st)) {
+            // the device was acquired meanwhile, all slots are used
+            goto cleanup;
+        }
+        // the device had time to settle, start the script
+        sane_spawn_action(st);
+        activity = true;
+        goto cleanup;
+    case SANE_JOB_RUNNING:
+        // the device is polled again after the script terminated
+        goto cleanup;
+    case SANE_JOB_DONE:
+        // the device had time to settle after the script, reopen it
+        sane_finish_action(st);
+        activity = true;
+        break;
+    case SANE_JOB_NONE:
+        break;
+    }
+    if (st->abandoned) {
+        goto cleanup;
+    }
+
+    if ((st->opts == NULL) || (st->h == NULL)) {
+        bool busy = false;
+        if (pthread_mutex_lock(&sched_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        }
+        busy = sane_job_device_busy(st->dev->name);
+        if (pthread_mutex_unlock(&sched_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+        if (busy) {
+            // the script of an action started before the last
+            // reconfiguration still uses the device
+            slog(SLOG_DEBUG, "device %s is still in use by a script", st->dev->name);
+            goto cleanup;
+        }
+    }
+
+    if (st->opts == NULL) {
+        // first cycle for this device
+        if (!sane_setup_device(st)) {
+            st->abandoned = true;
+            goto cleanup;
+        }
+        slog(SLOG_DEBUG, "Start the polling for device %s", st->dev->name);
+    }
+    else if (st->h == NULL) {
+        // the reopen after the last action failed, try again
+        slog(SLOG_DEBUG, "reopen device %s", st->dev->name);
+        SANE_Status status = 0;
+        if ((status = sane_open(st->dev->name, &st->h)) != SANE_STATUS_GOOD) {
+            slog(SLOG_ERROR, "Can't open device %s, %s",
+                 st->dev->name, sane_strstatus(status));
+            st->h = NULL;
+            if (status == SANE_STATUS_ACCESS_DENIED) {
+                slog(SLOG_WARN, "abandon polling of %s", st->dev->name);
+                st->abandoned = true;
+            }
+            goto cleanup;
+        }
+        sane_check_reopened_device(st);
+    }
+    else if (st->reconfigure) {
+        // no action is active and the device is open
+        sane_reconfigure_device(st, st->num_of_options);
+        activity = true;
+    }
+    if (st->abandoned) {
+        goto cleanup;
+    }
+    slog(SLOG_DEBUG, "polling device %s", st->dev->name);
+
+    // an action triggered from outside or while the last script was
+    // running
+    if ((st->num_pending > 0) && sane_job_acquire(st)) {
+        sane_start_action(st, sane_pending_pop(st));
+        activity = true;
+        goto cleanup;
+    }
+
+    // get the actual values
+    // each option is queried only once (see config multiple_actions)
+    // because this may reset the values and no other value changes can be
+    // detected. All options are read before an action closes the device.
+    if (sane_read_snapshot(st)) {
+        activity = true;
+    }
+
+    const sane_poll_plan_t* plan = &st->plan;
+    for(int p = 0; p < plan->num_watched; p += 1) {
+        const sane_poll_option_t* po = &plan->options[p];
+
+        if (po->type == SANE_TYPE_STRING) {
+            if (sane_option_value_equal(po, &st->prev_values[p], &st->values[p])) {
+                // the patterns only see changed strings
+                continue;
+            }
+            sane_match_patterns(plan, po, &st->prev_values[p], &st->values[p]);
+        }
+
+        sane_fire_triggers(st, p, &st->prev_values[p], &st->values[p]);
+    } // foreach option
+
+cleanup:
+    if (pthread_mutex_unlock(&st->mutex) < 0) {
+        // if we can't unlock the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return activity;
+}
+
+static bool timespec_before(const struct timespec* a, const struct timespec* b) {
+    if (a->tv_sec != b->tv_sec) {
+        return a->tv_sec < b->tv_sec;
+    }
+    return a->tv_nsec < b->tv_nsec;
+}
+
+static void timespec_add_ms(struct timespec* ts, long ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec += 1;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// the sched_* heap functions can only be used in the critical region
+// of sched_mutex
+static void sched_swap(int i, int j) {
+    sane_thread_t* t = sched_heap[i];
+    sched_heap[i] = sched_heap[j];
+    sched_heap[j] = t;
+    sched_heap[i]->sched_index = i;
+    sched_heap[j]->sched_index = j;
+}
+
+static void sched_sift_up(int i) {
+    while(i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timespec_before(&sched_heap[i]->next_poll, &sched_heap[parent]->next_poll)) {
+            break;
+        }
+        sched_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void sched_sift_down(int i) {
+    while(true) {
+        int smallest = i;
+        int l = 2 * i + 1;
+        int r = 2 * i + 2;
+        if ((l < sched_heap_size) &&
+                timespec_before(&sched_heap[l]->next_poll, &sched_heap[smallest]->next_poll)) {
+            smallest = l;
+        }
+        if ((r < sched_heap_size) &&
+                timespec_before(&sched_heap[r]->next_poll, &sched_heap[smallest]->next_poll)) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            break;
+        }
+        sched_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+// wakes up a worker if the earliest deadline changed
+static void sched_notify(void) {
+    if (sched_has_leader) {
+        if (pthread_cond_signal(&sched_leader_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_signal: %s", strerror(errno));
+        }
+    }
+    else {
+        if (pthread_cond_signal(&sched_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_signal: %s", strerror(errno));
+        }
+    }
+}
+
+static void sched_push(sane_thread_t* st) {
+    assert(st->sched_index < 0);
+    if (sched_heap_size == sched_heap_capacity) {
+        sched_heap_capacity = (sched_heap_capacity > 0) ? 2 * sched_heap_capacity : 4;
+        sched_heap = (sane_thread_t**) realloc(sched_heap,
+                                               sched_heap_capacity * sizeof(sane_thread_t*));
+        assert(sched_heap != NULL);
+    }
+    st->sched_index = sched_heap_size;
+    sched_heap[sched_heap_size] = st;
+    sched_heap_size += 1;
+    sched_sift_up(st->sched_index);
+    if (st->sched_index == 0) {
+        sched_notify();
+    }
+}
+
+static sane_thread_t* sched_pop(void) {
+    assert(sched_heap_size > 0);
+    sane_thread_t* st = sched_heap[0];
+    sched_heap_size -= 1;
+    if (sched_heap_size > 0) {
+        sched_heap[0] = sched_heap[sched_heap_size];
+        sched_heap[0]->sched_index = 0;
+        sched_sift_down(0);
+    }
+    st->sched_index = -1;
+    return st;
+}
+
+// removes a queued device from the heap
+static void sched_remove(sane_thread_t* st) {
+    int i = st->sched_index;
+    assert((i >= 0) && (i < sched_heap_size));
+    sched_heap_size -= 1;
+    if (i < sched_heap_size) {
+        sched_heap[i] = sched_heap[sched_heap_size];
+        sched_heap[i]->sched_index = i;
+        sched_sift_up(i);
+        sched_sift_down(sched_heap[i]->sched_index);
+    }
+    st->sched_index = -1;
+}
+
+// polls the device st as soon as possible
+// this function can only be used in the critical region of sched_mutex
+static void sched_wakeup_locked(sane_thread_t* st) {
+    if (st->sched_index >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &st->next_poll);
+        sched_sift_up(st->sched_index);
+        if (st->sched_index == 0) {
+            sched_notify();
+        }
+    }
+    else {
+        // a worker is busy with this device, it is requeued
+        // without delay
+        st->sched_wakeup = true;
+    }
+}
+
+static void sched_wakeup(sane_thread_t* st) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_wakeup_locked(st);
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// waits until the running poll cycles and backend calls ended, new
+// ones wait for sched_probe_end()
+static void sched_probe_begin(void) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_probing = true;
+    while(sched_backend_users > 0) {
+        pthread_cond_wait(&sched_done_cv, &sched_mutex);
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// resumes the poll cycles after the probe
+static void sched_probe_end(void) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_probing = false;
+    if (pthread_cond_broadcast(&sched_done_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (sched_cv_initialized && pthread_cond_broadcast(&sched_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// a call into the backend of a polled device outside of its poll cycle
+// (closing it), waits for a running probe
+// this function can't be used in the critical region of the device
+// (st->mutex) or of sched_mutex
+static void sched_backend_enter(void) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    while(sched_probing) {
+        pthread_cond_wait(&sched_done_cv, &sched_mutex);
+    }
+    sched_backend_users += 1;
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+static void sched_backend_leave(void) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_backend_users -= 1;
+    if (pthread_cond_broadcast(&sched_done_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// the timeout in ms to settle the device around an action, read from
+// the config when the workers are started
+static int sched_timeout = C_TIMEOUT_DEF;
+
+// thread start function of the poll workers
+static void* sane_poll_worker(void* arg) {
+    (void)arg;
+    slog(SLOG_DEBUG, "sane_poll_worker");
+    // we only expect the main thread to handle signals
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return NULL;
+    }
+    while(!sched_stop) {
+        if (sched_probing || sched_has_leader || (sched_heap_size == 0)) {
+            // the device probe uses the backends, another worker
+            // waits for the next deadline or there is nothing to poll
+            // at all
+            pthread_cond_wait(&sched_cv, &sched_mutex);
+            continue;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &sched_heap[0]->next_poll)) {
+            // become the leader and sleep until the earliest deadline
+            // (or until an earlier one is queued)
+            struct timespec deadline = sched_heap[0]->next_poll;
+            sched_has_leader = true;
+            pthread_cond_timedwait(&sched_leader_cv, &sched_mutex, &deadline);
+            sched_has_leader = false;
+            continue;
+        }
+        sane_thread_t* st = sched_pop();
+        st->sched_busy = true;
+        sched_backend_users += 1;
+        // let another idle worker wait for the next deadline
+        if (pthread_cond_signal(&sched_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_signal: %s", strerror(errno));
+        }
+        if (pthread_mutex_unlock(&sched_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+
+        bool activity = sane_poll_device(st);
+        int interval = poll_interval_next(&st->interval, activity);
+
+        if (pthread_mutex_lock(&sched_mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            return NULL;
+        }
+        if ((st->job != NULL) && (st->job->state == SANE_JOB_RUNNING)) {
+            // the script runs, sane_action_done() requeues the device
+        }
+        else if (!st->abandoned && !st->sched_removed && !st->sched_acquired) {
+            // requeue the device for the next cycle
+            clock_gettime(CLOCK_MONOTONIC, &st->next_poll);
+            if (st->job != NULL) {
+                // let the device settle before and after the script
+                timespec_add_ms(&st->next_poll, sched_timeout);
+            }
+            else if (!st->sched_wakeup) {
+                timespec_add_ms(&st->next_poll, interval);
+            }
+            st->sched_wakeup = false;
+            sched_push(st);
+        }
+        st->sched_busy = false;
+        st->sched_polled = true;
+        sched_backend_users -= 1;
+        if (pthread_cond_broadcast(&sched_done_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+        }
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return NULL;
+}
+
+// the completion callback of the action scripts, called by the reaper
+// thread of the launcher
+static void sane_action_done(pid_t pid, int status, void* arg) {
+    sane_action_job_t* job = (sane_action_job_t*) arg;
+    assert(job != NULL);
+    slog(SLOG_DEBUG, "child %d terminated", pid);
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    job->state = SANE_JOB_DONE;
+    job->status = status;
+    sane_thread_t* st = job->st;
+    if ((st == NULL) || st->sched_acquired) {
+        // the device was released or acquired while the script ran,
+        // the other devices may use the job slot
+        sane_job_remove(job);
+    }
+    if ((st != NULL) && !st->sched_busy && (st->sched_index < 0) &&
+            !st->sched_removed && !st->sched_acquired && !sched_stop) {
+        // reopen the device after the settle timeout
+        clock_gettime(CLOCK_MONOTONIC, &st->next_poll);
+        timespec_add_ms(&st->next_poll, sched_timeout);
+        st->sched_wakeup = false;
+        sched_push(st);
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (st == NULL) {
+        sane_job_log_status(job);
+        dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_END, job->dev_name);
+        sane_job_free(job);
+    }
+}
+
+// detaches the action job from the released device, a running script
+// isn't waited for
+// this function can only be used in the critical region of sched_mutex
+static void sched_detach_job(sane_thread_t* st) {
+    sane_action_job_t* job = st->job;
+    if (job == NULL) {
+        return;
+    }
+    st->job = NULL;
+    if (job->state == SANE_JOB_RUNNING) {
+        // sane_action_done() frees it
+        slog(SLOG_INFO, "script %s of device %s still running, not waiting",
+             job->script, job->dev_name);
+        job->st = NULL;
+        return;
+    }
+    sane_job_remove(job);
+    if (job->pid >= 0) {
+        sane_job_log_status(job);
+    }
+    dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_END, job->dev_name);
+    sane_job_free(job);
+}
+
+static bool sane_device_acquired(const char* name);
+
+// queues a new device, its first cycle is due immediately
+// an acquired device isn't queued until it is released
+// this function can only be used in the critical region of sane_mutex
+// and sched_mutex
+static void sched_add(sane_thread_t* st) {
+    poll_interval_init(&st->interval);
+    if (sane_device_acquired(st->dev->name)) {
+        slog(SLOG_INFO, "device %s is acquired, not polling", st->dev->name);
+        st->sched_acquired = true;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &st->next_poll);
+    sched_push(st);
+}
+
+// starts workers up to the configured number, but not more than
+// one per device
+// this function can only be used in the critical region of sane_mutex
+static void sched_add_workers(void) {
+    int workers = max_sched_workers;
+    if (workers > num_poll_threads) {
+        workers = num_poll_threads;
+    }
+    if (workers <= num_sched_workers) {
+        return;
+    }
+    slog(SLOG_DEBUG, "starting %d poll workers for %d devices",
+         workers - num_sched_workers, num_poll_threads);
+    sched_workers = (pthread_t*) realloc(sched_workers, workers * sizeof(pthread_t));
+    assert(sched_workers != NULL);
+    for(int i = num_sched_workers; i < workers; i += 1) {
+        if (pthread_create(&sched_workers[i], NULL, sane_poll_worker, NULL) < 0) {
+            slog(SLOG_ERROR, "Can't start sane_poll_worker: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        num_sched_workers += 1;
+    }
+}
+
+// takes a device out of the scheduler and waits until no worker uses
+// it anymore, its action job is detached
+// this function can only be used in the critical region of sane_mutex
+static void sched_release(sane_thread_t* st) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    st->sched_removed = true;
+    if (st->sched_index >= 0) {
+        sched_remove(st);
+    }
+    while(st->sched_busy) {
+        pthread_cond_wait(&sched_done_cv, &sched_mutex);
+    }
+    sane_job_cancel_wait(st);
+    sched_detach_job(st);
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// queues all devices and starts the worker pool
+// this function can only be used in the critical region of sane_mutex
+static void sched_start(void) {
+    if (!sched_cv_initialized) {
+        pthread_condattr_t condattr;
+        if (pthread_condattr_init(&condattr)) {
+            slog(SLOG_ERROR, "Can't initialize cond attr");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC)) {
+            slog(SLOG_ERROR, "Can't set cond clock");
+            exit(EXIT_FAILURE);
+        }
+        if (pthread_cond_init(&sched_cv, &condattr) ||
+                pthread_cond_init(&sched_leader_cv, &condattr)) {
+            slog(SLOG_ERROR, "Can't init cond");
+            exit(EXIT_FAILURE);
+        }
+        pthread_condattr_destroy(&condattr);
+        sched_cv_initialized = true;
+    }
+
+    cfg_t* cfg_sec_global = NULL;
+    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    assert(cfg_sec_global);
+
+    sched_timeout = cfg_getint(cfg_sec_global, C_TIMEOUT);
+    if (sched_timeout <= 0) {
+        sched_timeout = C_TIMEOUT_DEF;
+    }
+    slog(SLOG_DEBUG, "timeout: %d ms", sched_timeout);
+
+    max_sched_workers = cfg_getint(cfg_sec_global, C_POLL_WORKERS);
+    if (max_sched_workers <= 0) {
+        max_sched_workers = C_POLL_WORKERS_DEF;
+    }
 
-        // release the mutex
+    int max_jobs = cfg_getint(cfg_sec_global, C_ACTION_JOBS);
+    if (max_jobs < 0) {
+        max_jobs = C_ACTION_JOBS_DEF;
+    }
+    slog(SLOG_DEBUG, "action jobs: %d", max_jobs);
 
-        // because pthread_cleanup_pop is a macro we can't use it here
-        // pthread_cleanup_pop(1);
-        if (pthread_mutex_unlock(&st->mutex) < 0) {
-            // if we can't unlock the mutex, something is heavily wrong!
-            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
-            pthread_exit(NULL);
+    sane_backlog_size = cfg_getint(cfg_sec_global, C_ACTION_BACKLOG);
+    if (sane_backlog_size <= 0) {
+        sane_backlog_size = C_ACTION_BACKLOG_DEF;
+    }
+    const char* queue = cfg_getstr(cfg_sec_global, C_ACTION_QUEUE);
+    if ((queue != NULL) && (strcmp(queue, C_ACTION_QUEUE_COALESCE) == 0)) {
+        sane_backlog_coalesce = true;
+    }
+    else {
+        if ((queue != NULL) && (strcmp(queue, C_ACTION_QUEUE_FIFO) != 0)) {
+            slog(SLOG_WARN, "unknown action_queue %s, using %s",
+                 queue, C_ACTION_QUEUE_FIFO);
         }
+        sane_backlog_coalesce = false;
+    }
+    slog(SLOG_DEBUG, "action backlog: %d (%s)", sane_backlog_size,
+         sane_backlog_coalesce ? C_ACTION_QUEUE_COALESCE : C_ACTION_QUEUE_FIFO);
 
-        // sleep the polling timeout
-        usleep(timeout * 1000); //ms
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_stop = false;
+    sched_has_leader = false;
+    sched_heap_size = 0;
+    max_sane_jobs = max_jobs;
+    for(int i = 0; i < num_poll_threads; i += 1) {
+        sched_add(sane_poll_threads[i]);
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
 
-        // regain the mutex
-        // because pthread_cleanup_push is a macro we can't use it here
-        // pthread_cleanup_push(sane_thread_cleanup_mutex, ((void*)&st->mutex));
-        if (pthread_mutex_lock(&st->mutex) < 0) {
-            // if we can't get the mutex, something is heavily wrong!
-            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-            pthread_exit(NULL);
+    sched_add_workers();
+}
+
+// stops the worker pool, the workers finish their current poll cycle
+// this function can only be used in the critical region of sane_mutex
+static void sched_shutdown(void) {
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    sched_stop = true;
+    if (pthread_cond_broadcast(&sched_cv) || pthread_cond_broadcast(&sched_leader_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+
+    for(int i = 0; i < num_sched_workers; i += 1) {
+        slog(SLOG_DEBUG, "waiting for poll worker %d", i);
+        if (pthread_join(sched_workers[i], NULL) < 0) {
+            slog(SLOG_ERROR, "pthread_join: %s", strerror(errno));
         }
     }
-    pthread_cleanup_pop(1); // release the mutex
-    pthread_exit(NULL);
+    free(sched_workers);
+    sched_workers = NULL;
+    num_sched_workers = 0;
+
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    for(int i = 0; i < sched_heap_size; i += 1) {
+        sched_heap[i]->sched_index = -1;
+    }
+    free(sched_heap);
+    sched_heap = NULL;
+    sched_heap_size = 0;
+    sched_heap_capacity = 0;
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
 }
 
 // helper to trigger a specified action from another thread
@@ -1166,7 +3408,11 @@ void sane_trigger_action(int number_of_dev, int action) {
         }
     }
     assert(sane_poll_threads != NULL);
-    sane_thread_t* st = &sane_poll_threads[number_of_dev];
+    if (number_of_dev >= num_poll_threads) {
+        slog(SLOG_WARN, "No such device number %d", number_of_dev);
+        goto cleanup_sane;
+    }
+    sane_thread_t* st = sane_poll_threads[number_of_dev];
     assert(st != NULL);
     
     // this thread uses the device and the sane_thread_t datastructure
@@ -1181,22 +3427,18 @@ void sane_trigger_action(int number_of_dev, int action) {
         goto cleanup_dev;
     }
 
-    while(st->triggered == true) {
-        slog(SLOG_DEBUG, "sane_trigger_action: an action is active, waiting ...");
-        if (pthread_cond_wait(&st->cv, &st->mutex) < 0) {
-            slog(SLOG_ERROR, "pthread_cond_wait: %s", strerror(errno));
-            goto cleanup_dev;
-        }
+    if (st->abandoned) {
+        slog(SLOG_WARN, "Device number %d isn't polled", number_of_dev);
+        goto cleanup_dev;
     }
-    
-    slog(SLOG_DEBUG, "sane_trigger_action: an action is active, waiting ...");
 
-    st->triggered = true;
-    st->triggered_option = action;
-    // we need to trigger all waiting threads
-    if (pthread_cond_broadcast(&st->cv) < 0) {
-        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
+    // don't wait for a running action, the action is queued
+    if (st->triggered) {
+        slog(SLOG_DEBUG, "sane_trigger_action: an action is active, queueing");
     }
+    sane_pending_push(st, action);
+    // don't wait for the next regular poll cycle
+    sched_wakeup(st);
 
 cleanup_dev:
     if (pthread_mutex_unlock(&st->mutex) < 0) {
@@ -1209,6 +3451,115 @@ cleanup_sane:
     return;
 }
 
+// applies a changed config (actions, functions, scripts, environment)
+// to all polled devices without closing them: each device is matched
+// again by its next poll cycle after its running action (see
+// sane_reconfigure_device())
+void sane_reload_devices(void) {
+    slog(SLOG_DEBUG, "sane_reload_devices");
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return;
+    }
+    for(int i = 0; i < num_poll_threads; i += 1) {
+        sane_thread_t* st = sane_poll_threads[i];
+        if (pthread_mutex_lock(&st->mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            continue;
+        }
+        if (!st->abandoned) {
+            st->reconfigure = true;
+            sched_wakeup(st);
+        }
+        if (pthread_mutex_unlock(&st->mutex) < 0) {
+            slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        }
+    }
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// creates the polling data of a device, the device description is
+// copied
+static sane_thread_t* sane_thread_new(const SANE_Device* dev) {
+    sane_thread_t* st = (sane_thread_t*) calloc(1, sizeof(sane_thread_t));
+    if (st == NULL) {
+        slog(SLOG_ERROR, "Can't allocate memory for polling device %s", dev->name);
+        return NULL;
+    }
+    st->device.name = strdup(dev->name ? dev->name : "");
+    st->device.vendor = strdup(dev->vendor ? dev->vendor : "");
+    st->device.model = strdup(dev->model ? dev->model : "");
+    st->device.type = strdup(dev->type ? dev->type : "");
+    assert(st->device.name && st->device.vendor && st->device.model && st->device.type);
+    st->dev = &st->device;
+    st->h = 0;
+    st->layout = NULL;
+    st->opts = NULL;
+    st->functions = NULL;
+    st->values = NULL;
+    st->prev_values = NULL;
+    st->num_of_options = 0;
+    st->triggered = false;
+    st->triggered_option = -1;
+    st->job = NULL;
+    st->pending = NULL;
+    st->num_pending = 0;
+    st->pending_capacity = 0;
+    st->job_granted = false;
+    st->num_of_options_with_scripts = 0;
+    st->num_of_options_with_functions = 0;
+    st->abandoned = false;
+    st->reconfigure = false;
+    st->sched_index = -1;
+    st->sched_wakeup = false;
+    st->sched_busy = false;
+    st->sched_removed = false;
+    st->sched_polled = false;
+    st->sched_acquired = false;
+
+    if (pthread_mutex_init(&st->mutex, NULL) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_init: should not happen");
+    }
+    if (pthread_cond_init(&st->cv, NULL) < 0) {
+        slog(SLOG_ERROR, "pthread_cond_init: should not happen");
+    }
+    return st;
+}
+
+// closes the device and frees the polling data, no worker may use it
+static void sane_thread_free(sane_thread_t* st) {
+    // close the associated device
+    slog(SLOG_DEBUG, "closing device %s", st->dev->name);
+    if (st->h != NULL) {
+        sched_backend_enter();
+        sane_close(st->h);
+        sched_backend_leave();
+        st->h = NULL;
+    }
+    sane_free_matches(st);
+    sane_free_poll_plan(st);
+    sane_layout_release(st->layout);
+    st->layout = NULL;
+    assert(st->job == NULL);
+    free(st->pending);
+    st->pending = NULL;
+
+    if (pthread_cond_destroy(&st->cv) < 0) {
+        slog(SLOG_ERROR, "pthread_cond_destroy: %s", strerror(errno));
+    }
+    if (pthread_mutex_destroy(&st->mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_destroy: %s", strerror(errno));
+    }
+    free((void*)st->device.name);
+    free((void*)st->device.vendor);
+    free((void*)st->device.model);
+    free((void*)st->device.type);
+    free(st);
+}
+
 void start_sane_threads(void) {
     slog(SLOG_DEBUG, "start_sane_threads");
 
@@ -1222,40 +3573,26 @@ void start_sane_threads(void) {
         // if there are active threads kill them
         stop_sane_threads();
     }
-    // allocate the thread list
+    // allocate the device list
     assert(sane_poll_threads == NULL);
-    sane_poll_threads = (sane_thread_t*) calloc(num_devices, sizeof(sane_thread_t));
+    sane_poll_threads = (sane_thread_t**) calloc(num_devices + 1, sizeof(sane_thread_t*));
     if (sane_poll_threads == NULL) {
         slog(SLOG_ERROR, "Can't allocate memory for polling threads");
         goto cleanup;
     }
-    // starting for each device a seperate thread
+    num_poll_threads = 0;
     for(int i = 0; i < num_devices; i += 1) {
-        slog(SLOG_DEBUG, "Starting poll thread for %s", sane_device_list[i]->name);
-        sane_poll_threads[i].tid = 0;
-        sane_poll_threads[i].dev = sane_device_list[i];
-        sane_poll_threads[i].h = 0;
-        sane_poll_threads[i].opts = NULL;
-        sane_poll_threads[i].functions = NULL;
-        sane_poll_threads[i].num_of_options = 0;
-        sane_poll_threads[i].triggered = false;
-        sane_poll_threads[i].triggered_option = -1;
-        sane_poll_threads[i].num_of_options_with_scripts = 0;
-        sane_poll_threads[i].num_of_options_with_functions = 0;
-
-        if (pthread_mutex_init(&sane_poll_threads[i].mutex, NULL) < 0) {
-            slog(SLOG_ERROR, "pthread_mutex_init: should not happen");
-        }
-        if (pthread_cond_init(&sane_poll_threads[i].cv, NULL) < 0) {
-            slog(SLOG_ERROR, "pthread_cond_init: should not happen");
-        }
-        if (pthread_create(&sane_poll_threads[i].tid, NULL, sane_poll,
-                           (void*)&sane_poll_threads[i]) < 0) {
-            slog(SLOG_ERROR, "Can't start sane_poll_thread: %s", strerror(errno));
-            exit(EXIT_FAILURE);
+        slog(SLOG_DEBUG, "Scheduling polling for %s", sane_device_list[i]->name);
+        sane_thread_t* st = sane_thread_new(sane_device_list[i]);
+        if (st == NULL) {
+            continue;
         }
-        slog(SLOG_DEBUG, "Thread started for device %s", sane_device_list[i]->name);
+        sane_poll_threads[num_poll_threads] = st;
+        num_poll_threads += 1;
     }
+    // the poll workers start with all devices due
+    sched_start();
+
     if (pthread_cond_broadcast(&sane_cv)) {
         slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
     }
@@ -1267,7 +3604,237 @@ cleanup:
     }
 }
 
-// stops all sane polling threads
+// waits until the first poll cycle of all polled devices ended, i.e.
+// the devices are opened again (or can't be opened), but at most
+// timeout milliseconds
+// returns false on timeout
+bool sane_wait_polling(int timeout) {
+    slog(SLOG_DEBUG, "sane_wait_polling");
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    // sched_done_cv uses the default clock
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    timespec_add_ms(&deadline, timeout);
+
+    bool opened = true;
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    while(true) {
+        int waiting = 0;
+        for(int i = 0; i < num_poll_threads; i += 1) {
+            sane_thread_t* st = sane_poll_threads[i];
+            if (!st->sched_polled && !st->sched_removed && !st->sched_acquired) {
+                waiting += 1;
+            }
+        }
+        if (waiting == 0) {
+            break;
+        }
+        if (pthread_cond_timedwait(&sched_done_cv, &sched_mutex, &deadline) == ETIMEDOUT) {
+            slog(SLOG_WARN, "%d devices not opened after %d ms", waiting, timeout);
+            opened = false;
+            break;
+        }
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return opened;
+}
+
+static bool sane_device_acquired(const char* name) {
+    for(int i = 0; i < num_sane_acquired_devices; i += 1) {
+        if (strcmp(sane_acquired_devices[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the name of the device given by its name or its number (in the sane
+// device list)
+// returns NULL if there is no such device
+// this function can only be used in the critical region of sane_mutex
+static const char* sane_device_name(const char* device) {
+    if (isNumber(device)) {
+        int number_of_dev = atoi(device);
+        if (number_of_dev >= num_devices) {
+            slog(SLOG_WARN, "No such device number %d", number_of_dev);
+            return NULL;
+        }
+        return sane_device_list[number_of_dev]->name;
+    }
+    for(int i = 0; i < num_devices; i += 1) {
+        if (strcmp(sane_device_list[i]->name, device) == 0) {
+            return sane_device_list[i]->name;
+        }
+    }
+    slog(SLOG_WARN, "No such device %s", device);
+    return NULL;
+}
+
+static sane_thread_t* sane_find_thread(const char* name) {
+    for(int i = 0; i < num_poll_threads; i += 1) {
+        if (strcmp(sane_poll_threads[i]->dev->name, name) == 0) {
+            return sane_poll_threads[i];
+        }
+    }
+    return NULL;
+}
+
+// stops polling a single device (by name or number) and closes it, the
+// other devices keep polling. A running action isn't waited for, a
+// pending action is run after the release. The action doesn't hold a
+// job slot (max_sane_jobs) while the device is acquired.
+// returns false if there is no such device
+bool sane_acquire_device(const char* device) {
+    assert(device != NULL);
+    slog(SLOG_DEBUG, "sane_acquire_device %s", device);
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    bool found = false;
+    const char* name = sane_device_name(device);
+    if (name == NULL) {
+        goto cleanup;
+    }
+    found = true;
+    if (num_sane_acquired_devices == sane_acquired_devices_capacity) {
+        sane_acquired_devices_capacity = (sane_acquired_devices_capacity > 0) ?
+                                         2 * sane_acquired_devices_capacity : 4;
+        sane_acquired_devices = (char**) realloc(sane_acquired_devices,
+                                                 sane_acquired_devices_capacity * sizeof(char*));
+        assert(sane_acquired_devices != NULL);
+    }
+    sane_acquired_devices[num_sane_acquired_devices] = strdup(name);
+    assert(sane_acquired_devices[num_sane_acquired_devices] != NULL);
+    num_sane_acquired_devices += 1;
+
+    sane_thread_t* st = sane_find_thread(name);
+    if (st == NULL) {
+        // not polling at the moment
+        goto cleanup;
+    }
+    // take the device out of the scheduler and wait for its cycle
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    st->sched_acquired = true;
+    if (st->sched_index >= 0) {
+        sched_remove(st);
+    }
+    while(st->sched_busy) {
+        pthread_cond_wait(&sched_done_cv, &sched_mutex);
+    }
+    sane_job_cancel_wait(st);
+    if ((st->job != NULL) && (st->job->state != SANE_JOB_RUNNING)) {
+        // the script isn't started or reported before the release, the
+        // other devices may use the job slot meanwhile: a running script
+        // gives it up when it terminates
+        sane_job_remove(st->job);
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+
+    // the device probe doesn't run meanwhile
+    sched_backend_enter();
+    if (pthread_mutex_lock(&st->mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        sched_backend_leave();
+        goto cleanup;
+    }
+    if (st->h != NULL) {
+        // reopened by the next cycle after the release
+        slog(SLOG_INFO, "closing acquired device %s", st->dev->name);
+        sane_close(st->h);
+        st->h = NULL;
+    }
+    if (pthread_mutex_unlock(&st->mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    sched_backend_leave();
+cleanup:
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return found;
+}
+
+// resumes polling a device acquired by sane_acquire_device() after its
+// last acquire is released
+// returns false if the device isn't acquired
+bool sane_release_device(const char* device) {
+    assert(device != NULL);
+    slog(SLOG_DEBUG, "sane_release_device %s", device);
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return false;
+    }
+    bool found = false;
+    // a vanished device can still be released by its name
+    const char* name = isNumber(device) ? sane_device_name(device) : device;
+    if (name == NULL) {
+        goto cleanup;
+    }
+    for(int i = 0; i < num_sane_acquired_devices; i += 1) {
+        if (strcmp(sane_acquired_devices[i], name) == 0) {
+            free(sane_acquired_devices[i]);
+            num_sane_acquired_devices -= 1;
+            memmove(sane_acquired_devices + i, sane_acquired_devices + i + 1,
+                    (num_sane_acquired_devices - i) * sizeof(char*));
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        slog(SLOG_WARN, "device %s isn't acquired", name);
+        goto cleanup;
+    }
+    if (sane_device_acquired(name)) {
+        // still acquired by another one
+        goto cleanup;
+    }
+    sane_thread_t* st = sane_find_thread(name);
+    if (st == NULL) {
+        // not polling at the moment
+        goto cleanup;
+    }
+    if (pthread_mutex_lock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+    }
+    st->sched_acquired = false;
+    // a device with a running script is requeued by sane_action_done()
+    const bool running = (st->job != NULL) && (st->job->state == SANE_JOB_RUNNING);
+    if (!running && (st->sched_index < 0) && !st->abandoned && !sched_stop) {
+        // reopen the device immediately
+        st->sched_polled = false;
+        clock_gettime(CLOCK_MONOTONIC, &st->next_poll);
+        st->sched_wakeup = false;
+        sched_push(st);
+    }
+    if (pthread_mutex_unlock(&sched_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+cleanup:
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return found;
+}
+
+// stops polling all sane devices
 
 void stop_sane_threads(void) {
     slog(SLOG_DEBUG, "stop_sane_threads");
@@ -1283,85 +3850,210 @@ void stop_sane_threads(void) {
         slog(SLOG_DEBUG, "stop_sane_threads: nothing to stop");
         goto cleanup;
     }
-    // sending cancel request to all threads
-    for(int i = 0; i < num_devices; i += 1) {
-        if (pthread_mutex_lock(&sane_poll_threads[i].mutex) < 0) {
-            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-        }
-        while(sane_poll_threads[i].triggered == true) {
-            slog(SLOG_DEBUG, "stop_sane_threads: an action is active, waiting ...");
+    // waiting for all workers to finish their cycle
+    sched_shutdown();
 
-            if (pthread_cond_wait(&sane_poll_threads[i].cv,
-                                  &sane_poll_threads[i].mutex) < 0) {
-                slog(SLOG_ERROR, "pthread_cond_wait: %s", strerror(errno));
-            }
-        }
-        if (pthread_mutex_unlock(&sane_poll_threads[i].mutex) < 0) {
-            slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-        }
+    for(int i = 0; i < num_poll_threads; i += 1) {
+        // running scripts are not waited for
+        sched_release(sane_poll_threads[i]);
+        sane_thread_free(sane_poll_threads[i]);
+    }
+    // free the device list
+    free(sane_poll_threads);
+    sane_poll_threads = NULL;
+    num_poll_threads = 0;
+    // no threads active anymore
+    if (pthread_cond_broadcast(&sane_cv)) {
+        slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+    }
+cleanup:
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        // if we can't unlock the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        return;
+    }
+}
 
-        slog(SLOG_DEBUG, "stopping poll thread for device %s", (*(sane_device_list + i))->name);
-        if (pthread_cancel(sane_poll_threads[i].tid) < 0) {
-            if (errno == ESRCH) {
-                slog(SLOG_ERROR, "poll thread for device %s was already cancelled");
-            }
-            else {
-                slog(SLOG_ERROR, "unknown error from pthread_cancel: %s", strerror(errno));
-            }
-        }
+// reconciles the polled devices with the device list: only vanished
+// devices are stopped and only new devices are started, all other
+// devices keep polling. Devices which couldn't be opened (e.g. polled
+// from the device cache before the backend found them) are restarted.
+// returns the number of started and stopped devices
+// this function can only be used in the critical region of sane_mutex
+static int sane_reconcile_devices(void) {
+    int changes = 0;
+    if (sane_poll_threads == NULL) {
+        // not polling at the moment, start_sane_threads() will
+        // use the new list
+        slog(SLOG_DEBUG, "sane_reconcile_devices: not polling");
+        return 0;
+    }
+
+    sane_thread_t** threads = (sane_thread_t**) calloc(num_devices + 1,
+                                                       sizeof(sane_thread_t*));
+    if (threads == NULL) {
+        slog(SLOG_ERROR, "Can't allocate memory for polling threads");
+        return 0;
     }
-    // waiting for all threads to vanish
+    int num_threads = 0;
+
+    // keep the running devices still present, start the new ones
     for(int i = 0; i < num_devices; i += 1) {
-        slog(SLOG_DEBUG, "waiting for poll thread for device %s",
-             (*(sane_device_list + i))->name);
-        // joining all threads to prevent memory leaks
-        if (pthread_join(sane_poll_threads[i].tid, NULL) < 0) {
-            slog(SLOG_ERROR, "pthread_join: %s", strerror(errno));
-        }
-        sane_poll_threads[i].tid = 0;
-        // close the associated device of the thread
-        slog(SLOG_DEBUG, "closing device %s", sane_poll_threads[i].dev->name);
-        if (sane_poll_threads[i].h != NULL) {
-            sane_close(sane_poll_threads[i].h);
-            sane_poll_threads[i].h = NULL;
-        }
-        if (sane_poll_threads[i].opts) {
-            slog(SLOG_DEBUG, "freeing opt resources for device %s thread",
-                 sane_poll_threads[i].dev->name);
-            // free the matching options list of that device / threads
-            for (int k = 0; k < sane_poll_threads[i].num_of_options; k += 1) {
-                sane_option_value_free(&sane_poll_threads[i].opts[k].from_value);
-                sane_option_value_free(&sane_poll_threads[i].opts[k].to_value);
-                sane_option_value_free(&sane_poll_threads[i].opts[k].value);
+        sane_thread_t* st = NULL;
+        for(int k = 0; k < num_poll_threads; k += 1) {
+            if ((sane_poll_threads[k] != NULL) &&
+                    (strcmp(sane_poll_threads[k]->dev->name, sane_device_list[i]->name) == 0)) {
+                st = sane_poll_threads[k];
+                sane_poll_threads[k] = NULL;
+                break;
             }
-            free(sane_poll_threads[i].opts);
-            sane_poll_threads[i].opts = NULL;
         }
-        if (sane_poll_threads[i].functions) {
-            slog(SLOG_DEBUG, "freeing function resources for device %s thread",
-                 sane_poll_threads[i].dev->name);
-            free(sane_poll_threads[i].functions);
-            sane_poll_threads[i].functions = NULL;
+        if (st != NULL) {
+            if (pthread_mutex_lock(&st->mutex) < 0) {
+                slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            }
+            bool abandoned = st->abandoned;
+            if (pthread_mutex_unlock(&st->mutex) < 0) {
+                slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+            }
+            if (abandoned) {
+                slog(SLOG_INFO, "device %s found again, restart polling", st->dev->name);
+                sched_release(st);
+                sane_thread_free(st);
+                st = NULL;
+            }
         }
-
-        if (pthread_cond_destroy(&sane_poll_threads[i].cv) < 0) {
-            slog(SLOG_ERROR, "pthread_cond_destroy: %s", strerror(errno));
+        if (st == NULL) {
+            slog(SLOG_INFO, "new device %s, start polling", sane_device_list[i]->name);
+            if ((st = sane_thread_new(sane_device_list[i])) == NULL) {
+                continue;
+            }
+            if (pthread_mutex_lock(&sched_mutex) < 0) {
+                slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+            }
+            sched_add(st);
+            if (pthread_mutex_unlock(&sched_mutex) < 0) {
+                slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+            }
+            changes += 1;
         }
-        if (pthread_mutex_destroy(&sane_poll_threads[i].mutex) < 0) {
-            slog(SLOG_ERROR, "pthread_mutex_destroy: %s", strerror(errno));
+        threads[num_threads] = st;
+        num_threads += 1;
+    }
+    // stop the vanished devices
+    for(int k = 0; k < num_poll_threads; k += 1) {
+        sane_thread_t* st = sane_poll_threads[k];
+        if (st == NULL) {
+            continue;
         }
+        slog(SLOG_INFO, "device %s vanished, stop polling", st->dev->name);
+        sched_release(st);
+        sane_thread_free(st);
+        changes += 1;
     }
-    // free the thread list
     free(sane_poll_threads);
-    sane_poll_threads = NULL;
-    // no threads active anymore
+    sane_poll_threads = threads;
+    num_poll_threads = num_threads;
+
+    // new devices may need more workers
+    sched_add_workers();
+
     if (pthread_cond_broadcast(&sane_cv)) {
         slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
     }
-cleanup:
+    slog(SLOG_DEBUG, "sane_reconcile_devices: %d changes", changes);
+    return changes;
+}
+
+// reconciles the polled devices with the last known device list and
+// starts a new device probe, its result is reconciled by
+// sane_discovered().
+// returns the number of started and stopped devices
+int update_sane_devices(void) {
+    slog(SLOG_DEBUG, "update_sane_devices");
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return 0;
+    }
+    get_sane_devices();
+    int changes = sane_reconcile_devices();
     if (pthread_mutex_unlock(&sane_mutex) < 0) {
         // if we can't unlock the mutex, something is heavily wrong!
         slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return changes;
+}
+
+// reconciles the polled devices with the result of the background
+// device probe, run by the control loop of the main thread
+void sane_discovered(void) {
+    slog(SLOG_DEBUG, "sane_discovered");
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
         return;
     }
+    if (sane_probe_take()) {
+        sane_reconcile_devices();
+    }
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        // if we can't unlock the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+}
+
+// stops polling the devices at the given usb address without rescanning
+// the sane device list. This only finds devices whose sane name ends with
+// the usb address, like "genesys:libusb:001:005" of the sanei_usb based
+// backends.
+// returns the number of stopped devices, if 0 the caller has to fall back
+// to update_sane_devices()
+int remove_sane_device(int busnum, int devnum) {
+    slog(SLOG_DEBUG, "remove_sane_device %03d:%03d", busnum, devnum);
+
+    if ((busnum < 0) || (devnum < 0)) {
+        return 0;
+    }
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "libusb:%03d:%03d", busnum, devnum);
+    const size_t suffix_len = strlen(suffix);
+
+    if (pthread_mutex_lock(&sane_mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        return 0;
+    }
+    int removed = 0;
+    int num_threads = 0;
+    for(int k = 0; k < num_poll_threads; k += 1) {
+        sane_thread_t* st = sane_poll_threads[k];
+        const size_t len = strlen(st->dev->name);
+        if ((len >= suffix_len) &&
+                (strcmp(st->dev->name + len - suffix_len, suffix) == 0)) {
+            slog(SLOG_INFO, "device %s removed, stop polling", st->dev->name);
+            sched_release(st);
+            // the device list doesn't need a new probe
+            sane_devices_remove(st->dev->name);
+            sane_thread_free(st);
+            removed += 1;
+            continue;
+        }
+        sane_poll_threads[num_threads] = st;
+        num_threads += 1;
+    }
+    if (removed > 0) {
+        num_poll_threads = num_threads;
+        sane_poll_threads[num_threads] = NULL;
+        if (pthread_cond_broadcast(&sane_cv)) {
+            slog(SLOG_ERROR, "pthread_cond_broadcast: %s", strerror(errno));
+        }
+    }
+    if (pthread_mutex_unlock(&sane_mutex) < 0) {
+        // if we can't unlock the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+    }
+    return removed;
 }
@@ -21,6 +21,7 @@
  */
 
 #include "scanbd.h"
+#include "pool.h"
 
 #ifdef USE_SCANBUTTOND
 # include "scanbuttond_loader.h"
@@ -36,7 +37,8 @@ struct scanbdOptions scanbd_options = {
     /* managerMode */      false,
     /* foreground */       false,
     /* signal */	   false,
-    /* config_file_name */ SCANBD_CONF
+    /* config_file_name */ SCANBD_CONF,
+    /* device */           NULL
 };
 
 // the options for getopt_long()
@@ -48,15 +50,79 @@ static struct option options[] = {
     {"config",     1, NULL, 'c'},
     {"trigger",    1, NULL, 't'},
     {"action",     1, NULL, 'a'},
+    {"device",     1, NULL, 'D'},
     { 0,           0, NULL, 0}
 };
 
-void sig_hup_handler(int signal) {
-    slog(SLOG_DEBUG, "sig_hup_handler called");
+// applies the debug settings of the running config
+static void apply_debug_config(void) {
+    cfg_t* cfg_sec_global = NULL;
+    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    assert(cfg_sec_global);
+    debug = cfg_getbool(cfg_sec_global, C_DEBUG);
+    debug_level = cfg_getint(cfg_sec_global, C_DEBUG_LEVEL);
+}
+
+// rereads the config (SIGHUP) or restarts the backends (SIGALRM)
+static void scanbd_reconfigure(bool restart) {
+    slog(SLOG_DEBUG, "scanbd_reconfigure");
 
-    if (signal == SIGALRM) {
+    // the changed config is compared with the running one: the
+    // backends are only restarted if the changes need it
+    cfg_t* new_cfg = NULL;
+    enum cfg_reload reload = CFG_RELOAD_FULL;
+    if (restart) {
         slog(SLOG_INFO, "reconfiguration due to SIGALARM, device was busy?");
     }
+    else {
+        slog(SLOG_DEBUG, "reread the config");
+        new_cfg = cfg_parse_file(scanbd_options.config_file_name);
+        if (new_cfg == NULL) {
+            slog(SLOG_ERROR, "config not changed, keeping the running config");
+            return;
+        }
+#ifdef USE_SANE
+        reload = cfg_reload_needed(cfg, new_cfg);
+#endif
+    }
+
+#ifdef USE_SANE
+    if (reload == CFG_RELOAD_NONE) {
+        slog(SLOG_INFO, "config not changed, looking for new devices");
+        cfg_install(new_cfg);
+        // the background probe finds new devices, the backends and the
+        // polled devices aren't touched
+        update_sane_devices();
+        return;
+    }
+    if (reload == CFG_RELOAD_HOT) {
+        slog(SLOG_INFO, "reconfiguration without restarting the polling");
+        cfg_install(new_cfg);
+        apply_debug_config();
+        launcher_env_snapshot();
+#ifdef USE_LIBUDEV
+        udev_reload_config();
+#endif
+        sane_reload_devices();
+        // look for new devices, the polled devices aren't touched
+        update_sane_devices();
+        return;
+    }
+    if (reload == CFG_RELOAD_THREADS) {
+        slog(SLOG_INFO, "reconfiguration with restarting the polling");
+        stop_sane_threads();
+        cfg_install(new_cfg);
+        apply_debug_config();
+        launcher_env_snapshot();
+#ifdef USE_LIBUDEV
+        udev_reload_config();
+#endif
+        get_sane_devices();
+        start_sane_threads();
+        return;
+    }
+#endif
+    assert(reload == CFG_RELOAD_FULL);
 
     // stop all threads
 #ifdef USE_SANE
@@ -67,6 +133,8 @@ void sig_hup_handler(int signal) {
 
     slog(SLOG_DEBUG, "sane_exit");
 #ifdef USE_SANE
+    // the background device probe uses the backends
+    sane_wait_discovery();
     sane_exit();
 #else
     scbtn_shutdown();
@@ -76,18 +144,27 @@ void sig_hup_handler(int signal) {
     sleep(SANE_REINIT_TIMEOUT); // TODO: don't know if this is
     // really neccessary
 #endif
-    slog(SLOG_DEBUG, "reread the config");
-    cfg_do_parse(scanbd_options.config_file_name);
+    if (new_cfg != NULL) {
+        cfg_install(new_cfg);
+    }
+    else {
+        slog(SLOG_DEBUG, "reread the config");
+        cfg_do_parse(scanbd_options.config_file_name);
+    }
+    apply_debug_config();
 
-    cfg_t* cfg_sec_global = NULL;
-    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
-    assert(cfg_sec_global);
-    debug = cfg_getbool(cfg_sec_global, C_DEBUG);
-    debug_level = cfg_getint(cfg_sec_global, C_DEBUG_LEVEL);
+    // refresh the static part of the script environment
+    launcher_env_snapshot();
+#ifdef USE_LIBUDEV
+    udev_reload_config();
+#endif
 
     slog(SLOG_DEBUG, "sane_init");
 #ifdef USE_SANE
-    sane_init(NULL, NULL);
+    SANE_Int sane_version = 0;
+    sane_init(&sane_version, NULL);
+    // the cached option layouts are kept for the same backends
+    sane_layouts_reset(sane_version);
 #else
     if (scanbtnd_init() < 0) {
         slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
@@ -112,78 +189,203 @@ void sig_hup_handler(int signal) {
 
 }
 
-void sig_usr1_handler(int signal) {
-    slog(SLOG_DEBUG, "sig_usr1_handler called");
-    (void)signal;
+// the polling is stopped by acquire until the release, a
+// reconfiguration meanwhile is deferred until the release
+static bool scanbd_acquired = false;
+static bool scanbd_reconfigure_deferred = false;
+static bool scanbd_restart_deferred = false;
+
+// stops the polling, saned starts
+static void scanbd_acquire(void) {
+    slog(SLOG_DEBUG, "scanbd_acquire");
     // stop all threads
 #ifdef USE_SANE
     stop_sane_threads();
 #else
     stop_scbtn_threads();
 #endif
+    scanbd_acquired = true;
 }
 
-void sig_usr2_handler(int signal) {
-    slog(SLOG_DEBUG, "sig_usr2_handler called");
-    (void)signal;
+// resumes the polling, saned exited
+static void scanbd_release(void) {
+    slog(SLOG_DEBUG, "scanbd_release");
+    scanbd_acquired = false;
     // start all threads
 #ifdef USE_SANE
     start_sane_threads();
+    // the caller may scan again after the devices are reopened
+    sane_wait_polling(SANE_RELEASE_TIMEOUT);
 #else
     start_scbtn_threads();
 #endif
+    if (scanbd_reconfigure_deferred || scanbd_restart_deferred) {
+        slog(SLOG_INFO, "running the deferred reconfiguration");
+        bool restart = scanbd_restart_deferred;
+        scanbd_reconfigure_deferred = false;
+        scanbd_restart_deferred = false;
+        scanbd_reconfigure(restart);
+    }
 }
 
-void sig_term_handler(int signal) {
-    slog(SLOG_DEBUG, "sig_term/int_handler called with signal %d", signal);
+#ifndef USE_SANE
+// the devices acquired one by one: the scanbuttond backends can only be
+// stopped all together
+static int scanbd_devices_acquired = 0;
+#endif
 
-    if (scanbd_options.managerMode) {
-        // managerMode
-        slog(SLOG_INFO, "managerMode: do nothing");
+// stops polling a single device, the other devices keep polling
+static bool scanbd_acquire_device(const char* device) {
+    slog(SLOG_DEBUG, "scanbd_acquire_device %s", device);
+#ifdef USE_SANE
+    return sane_acquire_device(device);
+#else
+    scanbd_devices_acquired += 1;
+    if (scanbd_devices_acquired == 1) {
+        scanbd_acquire();
     }
-    else {
-        // not in manager-mode
-        // stop all threads
+    return true;
+#endif
+}
+
+// resumes polling a single device
+static bool scanbd_release_device(const char* device) {
+    slog(SLOG_DEBUG, "scanbd_release_device %s", device);
 #ifdef USE_SANE
-        stop_sane_threads();
+    if (!sane_release_device(device)) {
+        return false;
+    }
+    sane_wait_polling(SANE_RELEASE_TIMEOUT);
+    return true;
 #else
-        stop_scbtn_threads();
+    if (scanbd_devices_acquired == 0) {
+        return false;
+    }
+    scanbd_devices_acquired -= 1;
+    if (scanbd_devices_acquired == 0) {
+        scanbd_release();
+    }
+    return true;
 #endif
-        dbus_stop_dbus_thread();
+}
 
-#ifdef USE_LIBUDEV
-        udev_stop_udev_thread();
+// hands the client connection of scanbm to a saned helper, the devices
+// are acquired by the helper until saned exits
+static bool scanbd_saned(const control_request_t* r) {
+    int helper = pool_take();
+    if (helper < 0) {
+        slog(SLOG_INFO, "no saned helper available");
+        return false;
+    }
+    bool ok = control_adopt(helper, r->device);
+    if (!ok) {
+        close(helper);
+    }
+    else if (!pool_handoff(helper, r->fd)) {
+        // the hangup releases the devices
+        shutdown(helper, SHUT_RDWR);
+        ok = false;
+    }
+    // replace the helper
+    pool_fill();
+    return ok;
+}
+
+// stops all threads, removes the pidfile and exits
+static void scanbd_terminate(void) {
+    slog(SLOG_DEBUG, "scanbd_terminate");
+
+    // stop all threads
+#ifdef USE_SANE
+    stop_sane_threads();
+#else
+    stop_scbtn_threads();
 #endif
-        // get the name of the pidfile
-        const char* pidfile = NULL;
-        cfg_t* cfg_sec_global = NULL;
-        cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
-        assert(cfg_sec_global);
-        pidfile = cfg_getstr(cfg_sec_global, C_PIDFILE);
-        assert(pidfile);
+    dbus_stop_dbus_thread();
 
-        if (!scanbd_options.foreground) {
-            // reclaim the old uid (root) to unlink the pidfile
-            // mostly neccessary if the pidfile lives in /var/run
-            if (seteuid((pid_t)0) < 0) {
-                slog(SLOG_WARN, "Can't acquire uid root to unlink pidfile %s : %s",
-                     pidfile, strerror(errno));
-                slog(SLOG_DEBUG, "euid: %d, egid: %d",
-                     geteuid(), getegid());
-                // not an hard error, since sometimes this isn't neccessary
-            }
-            if (unlink(pidfile) < 0) {
-                slog(SLOG_ERROR, "Can't unlink pidfile: %s", strerror(errno));
-                slog(SLOG_DEBUG, "euid: %d, egid: %d",
-                     geteuid(), getegid());
-                exit(EXIT_FAILURE);
-            }
+#ifdef USE_LIBUDEV
+    udev_stop_udev_thread();
+#endif
+    launcher_stop();
+    pool_stop();
+    // get the name of the pidfile
+    const char* pidfile = NULL;
+    cfg_t* cfg_sec_global = NULL;
+    cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    assert(cfg_sec_global);
+    pidfile = cfg_getstr(cfg_sec_global, C_PIDFILE);
+    assert(pidfile);
+
+    if (!scanbd_options.foreground) {
+        // reclaim the old uid (root) to unlink the pidfile
+        // mostly neccessary if the pidfile lives in /var/run
+        if (seteuid((pid_t)0) < 0) {
+            slog(SLOG_WARN, "Can't acquire uid root to unlink pidfile %s : %s",
+                 pidfile, strerror(errno));
+            slog(SLOG_DEBUG, "euid: %d, egid: %d",
+                 geteuid(), getegid());
+            // not an hard error, since sometimes this isn't neccessary
+        }
+        if (unlink(pidfile) < 0) {
+            slog(SLOG_ERROR, "Can't unlink pidfile: %s", strerror(errno));
+            slog(SLOG_DEBUG, "euid: %d, egid: %d",
+                 geteuid(), getegid());
+            exit(EXIT_FAILURE);
         }
     }
+    control_unlisten();
     slog(SLOG_INFO, "exiting scanbd");
     exit(EXIT_SUCCESS);
 }
 
+// runs the commands of the control loop in the main thread
+static bool scanbd_control(const control_request_t* r) {
+    switch(r->cmd) {
+    case CONTROL_RECONFIGURE:
+    case CONTROL_RESTART:
+        if (scanbd_acquired) {
+            // don't take the devices away from saned
+            slog(SLOG_INFO, "polling stopped, reconfiguration deferred");
+            if (r->cmd == CONTROL_RESTART) {
+                scanbd_restart_deferred = true;
+            }
+            else {
+                scanbd_reconfigure_deferred = true;
+            }
+            break;
+        }
+        scanbd_reconfigure(r->cmd == CONTROL_RESTART);
+        break;
+    case CONTROL_ACQUIRE:
+        if (r->device != NULL) {
+            return scanbd_acquire_device(r->device);
+        }
+        scanbd_acquire();
+        break;
+    case CONTROL_RELEASE:
+        if (r->device != NULL) {
+            return scanbd_release_device(r->device);
+        }
+        scanbd_release();
+        break;
+    case CONTROL_HOTPLUG:
+        dbus_signal_devices_changed(r->added, r->num_added,
+                                    r->removed, r->num_removed);
+        break;
+    case CONTROL_SANED:
+        return scanbd_saned(r);
+    case CONTROL_DISCOVERED:
+#ifdef USE_SANE
+        sane_discovered();
+#endif
+        break;
+    case CONTROL_TERMINATE:
+        scanbd_terminate();
+        break;
+    }
+    return true;
+}
+
 bool isNumber(const char* string) {
     if (!string) {
         return false;
@@ -211,64 +413,42 @@ int main(int argc, char** argv) {
 #endif
 
     // install all the signalhandlers early
+    // the handlers only post commands to the control loop of the main
+    // thread (not in manager-mode, there the signals are ignored):
     // SIGHUP rereads the config as usual
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_handler = sig_hup_handler;
-    sigemptyset(&sa.sa_mask);
-    // prevent interleaving with stop/start_sane_threads
-    sigaddset(&sa.sa_mask, SIGUSR1);
-    sigaddset(&sa.sa_mask, SIGUSR2);
-    if (sigaction(SIGHUP, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGHUP: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-#ifdef USE_SCANBUTTOND
-    // install the SIGHUP handler also for SIGALARM
-    // SIGALARM is used if there is a open failure of the
-    // scanbuutond backends, possible cause is a device scanning from other
-    // processes like cupsd
-    if (sigaction(SIGALRM, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGALARM: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-#endif
-
     // SIGUSR1 is used to stop all polling threads
-    memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_handler = sig_usr1_handler;
-    sigemptyset(&sa.sa_mask);
-    // prevent interleaving the stop_sane_threads with start_sane_threads
-    sigaddset(&sa.sa_mask, SIGUSR2);
-    sigaddset(&sa.sa_mask, SIGHUP);
-    if (sigaction(SIGUSR1, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGUSR1: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-
     // SIGUSR2 is used to restart all polling threads
-    memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_handler = sig_usr2_handler;
-    sigemptyset(&sa.sa_mask);
-    // prevent interleaving the start_sane_threads with stop_sane_threads
-    sigaddset(&sa.sa_mask, SIGUSR1);
-    sigaddset(&sa.sa_mask, SIGHUP);
-    if (sigaction(SIGUSR2, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGUSR2: %s", strerror(errno));
+    // SIGTERM and SIGINT terminates the process gracefully
+    if (!control_init(scanbd_control)) {
         exit(EXIT_FAILURE);
     }
-
-    // SIGTERM and SIGINT terminates the process gracefully
+    const struct {
+        int signal;
+        const char* name;
+    } signals[] = {
+        {SIGHUP,  "SIGHUP"},
+        {SIGUSR1, "SIGUSR1"},
+        {SIGUSR2, "SIGUSR2"},
+        {SIGTERM, "SIGTERM"},
+        {SIGINT,  "SIGINT"},
+#ifdef USE_SCANBUTTOND
+        // SIGALARM is used if there is a open failure of the
+        // scanbuutond backends, possible cause is a device scanning from other
+        // processes like cupsd
+        {SIGALRM, "SIGALARM"},
+#endif
+    };
+    struct sigaction sa;
     memset(&sa, 0, sizeof(struct sigaction));
-    sa.sa_handler = sig_term_handler;
+    sa.sa_handler = control_signal_handler;
     sigemptyset(&sa.sa_mask);
-    if (sigaction(SIGTERM, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGTERM: %s", strerror(errno));
-        exit(EXIT_FAILURE);
-    }
-    if (sigaction(SIGINT, &sa, NULL) < 0) {
-        slog(SLOG_ERROR, "Can't install signalhandler for SIGINT: %s", strerror(errno));
-        exit(EXIT_FAILURE);
+    sa.sa_flags = SA_RESTART;
+    for(size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i += 1) {
+        if (sigaction(signals[i].signal, &sa, NULL) < 0) {
+            slog(SLOG_ERROR, "Can't install signalhandler for %s: %s",
+                 signals[i].name, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
     }
 
     int trigger_device = -1;
@@ -278,7 +458,7 @@ int main(int argc, char** argv) {
     while(true) {
         int option_index = 0;
         int c = 0;
-        if ((c = getopt_long(argc, argv, "mc:d::ft:a:", options, &option_index)) < 0) {
+        if ((c = getopt_long(argc, argv, "mc:d::ft:a:D:", options, &option_index)) < 0) {
             break;
         }
         switch(c) {
@@ -330,6 +510,10 @@ int main(int argc, char** argv) {
                 slog(SLOG_WARN, "use numerical argument for option -a");
             }
             break;
+        case 'D':
+            slog(SLOG_INFO, "device: %s", optarg);
+            scanbd_options.device = strdup(optarg);
+            break;
         default:
             break;
         }
@@ -401,8 +585,36 @@ int main(int argc, char** argv) {
         saned = cfg_getstr(cfg_sec_global, C_SANED);
         assert(saned);
 
-        if (scanbd_options.signal) {
+        // the control socket of the running scanbd replies when the
+        // devices are closed, so no sleep is needed
+        int control_fd = -1;
+        const char* control_socket = cfg_getstr(cfg_sec_global, C_CONTROL_SOCKET);
+        if ((control_socket != NULL) && (strlen(control_socket) > 0)) {
+            control_fd = control_connect(control_socket);
+        }
+
+        // a pre-forked saned of the running scanbd takes the connection,
+        // systemd passes the connection as LISTEN_FDS instead of stdin
+        if ((control_fd >= 0) && (getenv("LISTEN_PID") == NULL)) {
+            if (control_handoff(control_fd, scanbd_options.device, STDIN_FILENO)) {
+                slog(SLOG_DEBUG, "manager mode: connection passed to a saned helper");
+                close(control_fd);
+                exit(EXIT_SUCCESS);
+            }
+            slog(SLOG_DEBUG, "manager mode: no saned helper");
+        }
+
+        if (control_fd >= 0) {
+            slog(SLOG_DEBUG, "manager mode: control socket");
+            if (!control_command(control_fd, CONTROL_CMD_ACQUIRE, scanbd_options.device)) {
+                slog(SLOG_WARN, "Can't acquire the devices from scanbd");
+            }
+        }
+        else if (scanbd_options.signal) {
             slog(SLOG_DEBUG, "manager mode: signal");
+            if (scanbd_options.device != NULL) {
+                slog(SLOG_INFO, "signal-mode stops the polling of all devices");
+            }
             // get the path of the pid-file of the running scanbd
             const char* scanbd_pid_file = NULL;
             scanbd_pid_file = cfg_getstr(cfg_sec_global, C_PIDFILE);
@@ -441,7 +653,7 @@ int main(int argc, char** argv) {
             dbus_send_signal(SCANBD_DBUS_SIGNAL_SANED_BEGIN, NULL);
             slog(SLOG_DEBUG, "manager mode: dbus");
             slog(SLOG_DEBUG, "calling dbus method: %s", SCANBD_DBUS_METHOD_ACQUIRE);
-            dbus_call_method(SCANBD_DBUS_METHOD_ACQUIRE, NULL);
+            dbus_call_method(SCANBD_DBUS_METHOD_ACQUIRE, scanbd_options.device);
         }
         // start the real saned
         slog(SLOG_DEBUG, "forking subprocess for saned");
@@ -466,7 +678,13 @@ int main(int argc, char** argv) {
             }
             // saned finished and now
             // reactivate scandb
-            if (scanbd_options.signal) {
+            if (control_fd >= 0) {
+                if (!control_command(control_fd, CONTROL_CMD_RELEASE, scanbd_options.device)) {
+                    slog(SLOG_WARN, "Can't release the devices to scanbd");
+                }
+                close(control_fd);
+            }
+            else if (scanbd_options.signal) {
                 // sleep some time to give the other scanbd to close all the
                 // usb-connections
                 sleep(1);
@@ -480,7 +698,7 @@ int main(int argc, char** argv) {
             } // signal-mode
             else {
                 slog(SLOG_DEBUG, "calling dbus method: %s", SCANBD_DBUS_METHOD_RELEASE);
-                dbus_call_method(SCANBD_DBUS_METHOD_RELEASE, NULL);
+                dbus_call_method(SCANBD_DBUS_METHOD_RELEASE, scanbd_options.device);
                 slog(SLOG_DEBUG, "dbus signal saned-end");
                 dbus_send_signal(SCANBD_DBUS_SIGNAL_SANED_END, NULL);
             }
@@ -597,6 +815,15 @@ int main(int argc, char** argv) {
             }
         }
 
+        // the control socket lives in /var/run like the pidfile
+        const char* control_socket = cfg_getstr(cfg_sec_global, C_CONTROL_SOCKET);
+        if ((control_socket != NULL) && (strlen(control_socket) > 0)) {
+            if (!control_listen(control_socket, pwd->pw_uid, grp->gr_gid)) {
+                slog(SLOG_WARN, "Can't create control socket %s, scanbm falls back to dbus or signals",
+                     control_socket);
+            }
+        }
+
         // drop the privileges
         // first change our effective gid
         if (grp != NULL) {
@@ -627,6 +854,10 @@ int main(int argc, char** argv) {
             }
         }
 
+        // the static part of the script environment, taken as the
+        // user from config file
+        launcher_env_snapshot();
+
         // Init DBus well known interface
         // must be possible with the user from config file
         dbus_init();
@@ -638,6 +869,7 @@ int main(int argc, char** argv) {
         slog(SLOG_INFO, "sane version %d.%d",
              SANE_VERSION_MAJOR(sane_version),
              SANE_VERSION_MINOR(sane_version));
+        sane_layouts_reset(sane_version);
 #else
         if (scanbtnd_init() < 0) {
             slog(SLOG_INFO, "Could not initialize scanbuttond modules!\n");
@@ -651,6 +883,26 @@ int main(int argc, char** argv) {
 #else
         get_scbtn_devices();
 #endif
+        // start the reaper of the action scripts
+        launcher_start();
+
+        // the saned helpers, forked before the polling opens the devices
+        int saned_pool = cfg_getint(cfg_sec_global, C_SANED_POOL);
+        if (saned_pool > 0) {
+            const char* saned = cfg_getstr(cfg_sec_global, C_SANED);
+            assert(saned);
+            size_t numberOfEnvs = cfg_size(cfg_sec_global, C_SANED_ENVS);
+            char** envs = (char**) calloc(numberOfEnvs + 1, sizeof(char*));
+            assert(envs);
+            for(size_t i = 0; i < numberOfEnvs; i += 1) {
+                envs[i] = cfg_getnstr(cfg_sec_global, C_SANED_ENVS, i);
+            }
+            slog(SLOG_INFO, "starting %d saned helpers", saned_pool);
+            pool_start(saned_pool, saned, envs, pwd->pw_uid, grp->gr_gid);
+            free(envs);
+            pool_fill();
+        }
+
         // start the polling threads
 #ifdef USE_SANE
         start_sane_threads();
@@ -666,12 +918,8 @@ int main(int argc, char** argv) {
 #endif
 
         // well, sit here and wait ...
-        // this thread executes the signal handlers
-        while(true) {
-            if (pause() < 0) {
-                slog(SLOG_DEBUG, "pause: %s", strerror(errno));
-            }
-        }
+        // this thread runs the commands of the signals, dbus and udev
+        control_loop();
     }
     exit(EXIT_SUCCESS); // never reached
 }
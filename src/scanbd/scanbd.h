@@ -48,9 +48,14 @@
 #include "slog.h"
 #include "scanbd_dbus.h"
 #include "udev.h"
+#include "launcher.h"
+#include "control.h"
 
 #define SANE_REINIT_TIMEOUT 3 // TODO: don't know if this is really neccessary
 
+// the time a release waits for the devices to be reopened (ms)
+#define SANE_RELEASE_TIMEOUT 5000
+
 #define SCANBUTTOND_ALARM_TIMEOUT 5 // reconfigure after this amount of seconds if
 // device was busy
 
@@ -129,14 +134,55 @@
 #define C_SANED_ENVS "saned_env"
 #define C_SANED_ENVS_DEF "{}"
 
+#define C_SANED_POOL "saned_pool"
+#define C_SANED_POOL_DEF 0
+
 #define C_TIMEOUT "timeout"
 #define C_TIMEOUT_DEF 500
 
+#define C_TIMEOUT_MAX "timeout_max"
+#define C_TIMEOUT_MAX_DEF 0
+
+#define C_BURST_TIMEOUT "burst_timeout"
+#define C_BURST_TIMEOUT_DEF 0
+
+#define C_BURST_DURATION "burst_duration"
+#define C_BURST_DURATION_DEF 5
+
+#define C_POLL_WORKERS "poll_workers"
+#define C_POLL_WORKERS_DEF 4
+
+#define C_USB_IDS "usb_ids"
+#define C_USB_IDS_DEF "{}"
+
+#define C_HOTPLUG_DEBOUNCE "hotplug_debounce"
+#define C_HOTPLUG_DEBOUNCE_DEF 500
+
+#define C_DEVICE_CACHE "device_cache"
+#define C_DEVICE_CACHE_DEF ""
+
+#define C_OPTION_CACHE "option_cache"
+#define C_OPTION_CACHE_DEF ""
+
+#define C_ACTION_JOBS "action_jobs"
+#define C_ACTION_JOBS_DEF 4
+
+#define C_ACTION_BACKLOG "action_backlog"
+#define C_ACTION_BACKLOG_DEF 8
+
+#define C_ACTION_QUEUE "action_queue"
+#define C_ACTION_QUEUE_DEF "fifo"
+#define C_ACTION_QUEUE_FIFO "fifo"
+#define C_ACTION_QUEUE_COALESCE "coalesce"
+
 // TODO: move definition of scanbd.pid to configuration in Makefiles
 //
 #define C_PIDFILE "pidfile"
 #define C_PIDFILE_DEF "/var/run/scanbd.pid"
 
+#define C_CONTROL_SOCKET "control_socket"
+#define C_CONTROL_SOCKET_DEF "/var/run/scanbd.sock"
+
 #define C_ENVIRONMENT "environment"
 
 #define C_FUNCTION "function"
@@ -164,6 +210,8 @@ struct scanbdOptions {
     bool        foreground;
     bool        signal;
     const char* config_file_name;
+    const char* device;         // manager-mode: the device handed over
+    // to saned (name or number), NULL for all devices
 };
 
 // command-line options
@@ -180,7 +228,19 @@ extern void get_sane_devices(void);
 extern void sane_trigger_action(int, int);
 extern void stop_sane_threads(void);
 extern void start_sane_threads(void);
+extern void sane_reload_devices(void);
+extern bool sane_wait_polling(int);
+extern bool sane_acquire_device(const char*);
+extern bool sane_release_device(const char*);
+extern int update_sane_devices(void);
+extern void sane_discovered(void);
+extern void sane_wait_discovery(void);
+#ifdef USE_SANE
+extern void sane_layouts_reset(SANE_Int);
+#endif
+extern int remove_sane_device(int, int);
 
 extern void daemonize(void);
+extern bool isNumber(const char*);
 
 #endif
@@ -62,6 +62,7 @@
 
 extern void dbus_send_signal(const char*, const char*);
 extern void dbus_send_signal_argv(const char*, char**);
+extern void dbus_send_signal_async(const char*, const char*);
 extern void dbus_send_signal_argv_async(const char*, char**);
 
 extern bool dbus_init(void);
@@ -73,6 +74,19 @@ extern void dbus_call_trigger(unsigned int, unsigned int);
 extern void dbus_start_dbus_thread(void);
 extern void dbus_stop_dbus_thread(void);
 
-extern void dbus_signal_device_removed(void);
-extern void dbus_signal_device_added(void);
+// identity of a hotplugged usb device as reported by udev,
+// unknown fields are NULL or -1
+struct hotplug_device {
+    const char* syspath;
+    int busnum;
+    int devnum;
+    int vendor;
+    int product;
+};
+typedef struct hotplug_device hotplug_device_t;
+
+extern void dbus_signal_device_removed(const hotplug_device_t*);
+extern void dbus_signal_device_added(const hotplug_device_t*);
+extern void dbus_signal_devices_changed(const hotplug_device_t*, int,
+                                        const hotplug_device_t*, int);
 #endif
@@ -137,6 +137,11 @@ backend_t* scanbtnd_load_backend(const char* filename){
         slog(SLOG_ERROR, "Can't find symbol: %s", error);
         goto cleanup;
     }
+    // only the backends of scanners latching their buttons have it
+    backend->scanbtnd_get_button_events = dlsym(dll_handle, "scanbtnd_get_button_events");
+    if ((error = dlerror()) != NULL) {
+        backend->scanbtnd_get_button_events = NULL;
+    }
     backend->scanbtnd_get_sane_device_descriptor = dlsym(dll_handle, "scanbtnd_get_sane_device_descriptor");
     if ((error = dlerror()) != NULL) {
         slog(SLOG_ERROR, "Can't find symbol: %s", error);
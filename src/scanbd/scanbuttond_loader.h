@@ -34,6 +34,7 @@ struct backend {
     int (*scanbtnd_open)(scanner_t* scanner);
     int (*scanbtnd_close)(scanner_t* scanner);
     int (*scanbtnd_get_button)(scanner_t* scanner);
+    int (*scanbtnd_get_button_events)(scanner_t* scanner, int* buttons, int max); // optional
     char* (*scanbtnd_get_sane_device_descriptor)(scanner_t* scanner);
     int (*scanbtnd_exit)(void);
     void* handle;  // handle for dlopen/dlsym/dlclose
@@ -24,6 +24,10 @@
 #include <scanbuttond/scanbuttond.h>
 #include "scanbuttond_loader.h"
 #include "scanbuttond_wrapper.h"
+#include "event.h"
+
+// the presses read per cycle from a backend latching its buttons
+#define SCBTN_MAX_PRESSES 8
 
 // all programm-global scbtn functions use this mutex to avoid races
 #ifdef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
@@ -73,6 +77,7 @@ struct scbtn_dev_option {
     // fire the trigger)
     scbtn_opt_value_t value;      // the option value (from the last
     //				 // polling cycle)
+    event_ring_t events;          // the transitions of the option value
     const char* script;          // the found (matched) script to be called if
     // the option-valued changes
     const char* action_name;	 // the name of this action as
@@ -167,14 +172,6 @@ static void scbtn_thread_cleanup_mutex(void* arg) {
     }
 }
 
-// cleanup handler for sane_poll
-static void scbtn_thread_cleanup_value(void* arg) {
-    assert(arg != NULL);
-    slog(SLOG_DEBUG, "sane_thread_cleanup_value");
-    //    sane_opt_value_t* v = (sane_opt_value_t*)arg;
-    //    sane_option_value_free(v);
-}
-
 // this function can only be used in the critical region of *st
 static void scbtn_find_matching_options(scbtn_thread_t* st, cfg_t* sec) {
     slog(SLOG_DEBUG, "sane_find_matching_options");
@@ -322,6 +319,182 @@ void scbtn_find_matching_functions(scbtn_thread_t* st, cfg_t* sec) {
     st->num_of_options_with_functions = 0;
 }
 
+// reads the buttons of the device and pushes the transitions of the
+// watched options to their rings: a backend latching the presses
+// reports each press (0 -> 1 -> 0), otherwise the pressed button is
+// compared with the last cycle
+// returns the number of pressed buttons
+// this function can only be used in the critical region of *st
+static int scbtn_read_buttons(scbtn_thread_t* st) {
+    int presses[SCBTN_MAX_PRESSES];
+    int num = -ENOSYS;
+    if (backend->scanbtnd_get_button_events != NULL) {
+        num = backend->scanbtnd_get_button_events((scanner_t*)st->dev, presses,
+                                                  SCBTN_MAX_PRESSES);
+    }
+    if (num >= 0) {
+        for(int i = 0; i < num; i += 1) {
+            slog(SLOG_INFO, "################ button %d pressed ################", presses[i]);
+            for(int si = 0; si < st->num_of_options_with_scripts; si += 1) {
+                if (st->opts[si].number != presses[i]) {
+                    continue;
+                }
+                if (!event_ring_push(&st->opts[si].events, 0, 1) ||
+                        !event_ring_push(&st->opts[si].events, 1, 0)) {
+                    slog(SLOG_WARN, "too many presses of button %d, dropped", presses[i]);
+                }
+            }
+        }
+        return num;
+    }
+
+    int button = backend->scanbtnd_get_button((scanner_t*)st->dev);
+    if (button > 0) {
+        slog(SLOG_INFO, "################ button %d pressed ################", button);
+    } else {
+        slog(SLOG_INFO, "button %d", button);
+    }
+    for(int si = 0; si < st->num_of_options_with_scripts; si += 1) {
+        unsigned long value = ((button > 0) && (button == st->opts[si].number)) ? 1 : 0;
+        if (value == st->opts[si].value.num_value) {
+            continue;
+        }
+        if (!event_ring_push(&st->opts[si].events, st->opts[si].value.num_value, value)) {
+            slog(SLOG_WARN, "too many transitions of button %d, dropped", st->opts[si].number);
+        }
+        st->opts[si].value.num_value = value;
+    }
+    return (button > 0) ? 1 : 0;
+}
+
+// runs the script of the triggered option, the device is closed
+// meanwhile
+// this function can only be used in the critical region of *st
+static void scbtn_run_action(scbtn_thread_t* st, cfg_t* cfg_sec_global, int timeout) {
+    assert(st->triggered_option >= 0); // index into the opts-array
+    assert(st->triggered_option < st->num_of_options_with_scripts);
+
+    slog(SLOG_ERROR, "trigger action for device %s with script %s",
+         st->dev->product, st->opts[st->triggered_option].script);
+
+    // prepare the environment for the script to be called:
+    // PATH, PWD, USER, HOME and the values in the
+    // environment-section (device, action)
+    cfg_t* global_envs = cfg_getsec(cfg_sec_global, C_ENVIRONMENT);
+
+    assert(st->num_of_options_with_functions == 0);
+
+    launcher_env_t le;
+    launcher_env_init(&le);
+    launcher_env_add_defaults(&le);
+    const char* ev = cfg_getstr(global_envs, C_DEVICE);
+    if (ev != NULL) {
+        launcher_env_add(&le, ev, "%s", st->dev->sane_device);
+    }
+    ev = cfg_getstr(global_envs, C_ACTION);
+    if (ev != NULL) {
+        launcher_env_add(&le, ev, "%s",
+                         st->opts[st->triggered_option].action_name);
+    }
+    char** env = launcher_env_finish(&le);
+
+    // sendout an dbus-signal with all the values as
+    // arguments
+    dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_BEGIN, st->dev->product);
+
+    dbus_send_signal_argv_async(SCANBD_DBUS_SIGNAL_TRIGGER, env);
+
+    // the action-script will use the device,
+    // so we have to release the device
+    //		scbtn_close(st->h);
+    //		st->h = NULL;
+
+    if (backend->scanbtnd_close((scanner_t*)st->dev) < 0) {
+        slog(SLOG_ERROR, "unable to close scanner backend");
+    }
+
+    assert(st->triggered_option >= 0);
+    assert(st->opts[st->triggered_option].script);
+    assert(strlen(st->opts[st->triggered_option].script) > 0);
+
+    // need to copy the values because we leave the
+    // critical section
+    // int triggered_option = st->triggered_option;
+
+    char* script_abs = make_script_path_abs(st->opts[st->triggered_option].script);
+    assert(script_abs);
+
+    // leave the critical section
+    if (pthread_mutex_unlock(&st->mutex) < 0) {
+        // if we can't unlock the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        pthread_exit(NULL);
+    }
+
+    if (strcmp(script_abs, SCANBD_NULL_STRING) != 0) {
+
+        assert(timeout > 0);
+        usleep(timeout * 1000); //ms
+
+        // spawn the script and wait for its termination
+        launcher_run(script_abs, env);
+    } // script_abs == SCANBD_NULL_STRING
+
+    assert(script_abs != NULL);
+    free(script_abs);
+    script_abs = NULL;
+
+    launcher_env_free(&le);
+
+    // enter the critical section
+    if (pthread_mutex_lock(&st->mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        pthread_exit(NULL);
+    }
+
+    st->triggered = false;
+    st->triggered_option = -1; // invalid
+    // we need to trigger all waiting threads
+    if (pthread_cond_broadcast(&st->cv) < 0) {
+        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
+    }
+
+    // leave the critical section
+    if (pthread_mutex_unlock(&st->mutex) < 0) {
+        // if we can't release the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
+        pthread_exit(NULL);
+    }
+    // sleep the timeout to settle devices, necessary?
+    usleep(timeout * 1000); //ms
+
+    // send out the debus signal
+    dbus_send_signal_async(SCANBD_DBUS_SIGNAL_SCAN_END, st->dev->product);
+
+    // enter the critical section
+    if (pthread_mutex_lock(&st->mutex) < 0) {
+        // if we can't get the mutex, something is heavily wrong!
+        slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
+        pthread_exit(NULL);
+    }
+
+    slog(SLOG_DEBUG, "reopen device %s", st->dev->product);
+
+    int ores = backend->scanbtnd_open((scanner_t*)st->dev);
+    if (ores != 0) {
+        slog(SLOG_WARN, "scanbtnd_open failed, error code: %d", ores);
+        slog(SLOG_WARN, "abandon polling of %s", st->dev->product);
+        if (ores == -ENODEV) {
+            slog(SLOG_WARN, "scanbtnd_open failed, no device -> canceling thread");
+        }
+        if (alarm(SCANBUTTOND_ALARM_TIMEOUT) > 0) {
+            slog(SLOG_WARN, "alarm error, there was a pending alarm");
+        }
+        pthread_exit(NULL);
+    }
+}
+
 void* scbtn_poll(void* arg) {
     scbtn_thread_t* st = (scbtn_thread_t*)arg;
     assert(st != NULL);
@@ -404,7 +577,9 @@ void* scbtn_poll(void* arg) {
     st->num_of_options_with_functions = 0;
 
     // find out the functions and actions
-    // get the global sconfig section
+    // get the global sconfig section (the polling threads are stopped
+    // before another config is installed, see scanbd_reconfigure(), so
+    // they use the running config without a reference)
     cfg_t* cfg_sec_global = NULL;
     cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
     assert(cfg_sec_global);
@@ -463,6 +638,10 @@ void* scbtn_poll(void* arg) {
     }
     slog(SLOG_DEBUG, "timeout: %d ms", timeout);
 
+    // the adaptive polling interval
+    poll_interval_t interval;
+    poll_interval_init(&interval);
+
     slog(SLOG_DEBUG, "Start the polling for device %s", st->dev->product);
 
     while(true) {
@@ -471,303 +650,39 @@ void* scbtn_poll(void* arg) {
         pthread_testcancel();
         slog(SLOG_DEBUG, "polling device %s", st->dev->product);
 
-        int button = backend->scanbtnd_get_button((scanner_t*)st->dev);
-        if (button) {
-            slog(SLOG_INFO, "################ button %d pressed ################", button);
-        } else {
-            slog(SLOG_INFO, "button %d", button);
-        }
+        // the button transitions since the last cycle
+        int pressed = scbtn_read_buttons(st);
 
         for(si = 0; si < st->num_of_options_with_scripts; si += 1) {
-            //	    const scbtn_Option_Descriptor* odesc = NULL;
-            //	    assert((odesc = scbtn_get_option_descriptor(st->h, st->opts[i].number)) != NULL);
-
             const backend_t* b = st->dev->meta_info;
-            slog(SLOG_INFO, "option: %d", st->opts[si].number);
             const char* name = scanbtnd_button_name(b, st->opts[si].number);
             assert(name);
 
-            if (st->opts[si].script != NULL) {
-                if (strlen(st->opts[si].script) <= 0) {
+            // each transition is checked, the press and the release
+            // of a latched button fire a 0 -> 1 and a 1 -> 0 trigger
+            event_transition_t ev;
+            while(event_ring_pop(&st->opts[si].events, &ev)) {
+                slog(SLOG_INFO, "option %s number %d (%d) for device %s changed %lu -> %lu",
+                     name, st->opts[si].number, si, st->dev->product, ev.from, ev.to);
+
+                if ((st->opts[si].from_value.num_value != ev.from) ||
+                        (st->opts[si].to_value.num_value != ev.to)) {
+                    continue;
+                }
+                if ((st->opts[si].script == NULL) || (strlen(st->opts[si].script) <= 0)) {
                     slog(SLOG_WARN, "No valid script for option %s for device %s",
                          name, st->dev->product);
                     continue;
                 }
-            }
-            else {
-                slog(SLOG_WARN, "No script for option %s for device %s",
-                     name, st->dev->product);
-                continue;
-            }
-            assert(st->opts[si].script != NULL);
-            assert(strlen(st->opts[si].script) > 0);
-
-            //	    scbtn_opt_value_t value;
-            //	    scbtn_option_value_init(&value);
-            // push the cleanup-handle to free the value storage
-            pthread_cleanup_push(scbtn_thread_cleanup_value, NULL);
-
-            slog(SLOG_INFO, "checking option %s number %d (%d) for device %s",
-                 name, st->opts[si].number, si,
-                 st->dev->product);
-
-
-            unsigned long value = 0;
-
-            if ((button > 0) && (button == st->opts[si].number)) {
-                value = 1;
-                slog(SLOG_INFO, "button %d has been pressed.", button);
-                if ((st->opts[si].from_value.num_value == st->opts[si].value.num_value) &&
-                        (st->opts[si].to_value.num_value == value)) {
-                    slog(SLOG_DEBUG, "value trigger: numerical");
-                    st->triggered = true;
-                    st->triggered_option = si;
-                    // we need to trigger all waiting threads
-                    if (pthread_cond_broadcast(&st->cv) < 0) {
-                        slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
-                    }
-                }
-            }
-
-            // pass the responsibility to free the value to the main
-            // thread, if this thread gets canceled
-            if (pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL) < 0) {
-                slog(SLOG_ERROR, "pthread_setcancelstate: %s", strerror(errno));
-            }
-            st->opts[si].value.num_value = value;
-            pthread_cleanup_pop(0);
-            if (pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL) < 0) {
-                slog(SLOG_ERROR, "pthread_setcancelstate: %s", strerror(errno));
-            }
-
-            // was there a value change?
-            if (st->triggered && (st->triggered_option >= 0)) {
-                assert(st->triggered_option >= 0); // index into the opts-array
-                assert(st->triggered_option < st->num_of_options_with_scripts);
-
-                slog(SLOG_ERROR, "trigger action for device %s with script %s",
-                     st->dev->product, st->opts[st->triggered_option].script);
-
-                // prepare the environment for the script to be called
-
-                // number of env-vars =
-                // number of found function-options
-                // plus the values in the environment-section (2):
-                // device, action
-                // plus those 4:
-                // PATH, PWD, USER, HOME
-                // plus the sentinel
-                cfg_t* global_envs = cfg_getsec(cfg_sec_global, C_ENVIRONMENT);
-
-                assert(st->num_of_options_with_functions == 0);
-
-                int number_of_envs = st->num_of_options_with_functions + 4 + 2 + 1;
-                char** env = calloc(number_of_envs, sizeof(char*));
-                for(int e = 0; e < number_of_envs; e += 1) {
-                    env[e] = calloc(NAME_MAX + 1, sizeof(char));
-                }
-                int e = 0;
-                const char* ev = "PATH";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, "/usr/sbin:/usr/bin:/sbin:/bin");
-                    slog(SLOG_DEBUG, "No PATH, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = "PWD";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    char buf[PATH_MAX];
-                    char* ptr = getcwd(buf, PATH_MAX - 1);
-                    if (!ptr) {
-                        slog(SLOG_ERROR, "can't get pwd");
-                    }
-                    else {
-                        assert(ptr);
-                        snprintf(env[e], NAME_MAX, "%s=%s", ev, ptr);
-                        slog(SLOG_DEBUG, "No PWD, setting env: %s", env[e]);
-                        e += 1;
-                    }
-                }
-                ev = "USER";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    struct passwd* pwd = NULL;
-                    pwd = getpwuid(geteuid());
-                    assert(pwd);
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_name);
-                    slog(SLOG_DEBUG, "No USER, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = "HOME";
-                if (getenv(ev) != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, getenv(ev));
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                else {
-                    struct passwd* pwd = 0;
-                    pwd = getpwuid(geteuid());
-                    assert(pwd);
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, pwd->pw_dir);
-                    slog(SLOG_DEBUG, "No HOME, setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = cfg_getstr(global_envs, C_DEVICE);
-                if (ev != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev, st->dev->sane_device);
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                ev = cfg_getstr(global_envs, C_ACTION);
-                if (ev != NULL) {
-                    snprintf(env[e], NAME_MAX, "%s=%s", ev,
-                             st->opts[st->triggered_option].action_name);
-                    slog(SLOG_DEBUG, "setting env: %s", env[e]);
-                    e += 1;
-                }
-                env[e] = NULL;
-                assert(e == number_of_envs-1);
-
-                // sendout an dbus-signal with all the values as
-                // arguments
-                dbus_send_signal(SCANBD_DBUS_SIGNAL_SCAN_BEGIN, st->dev->product);
-
-                //dbus_send_signal_argv_async(SCANBD_DBUS_SIGNAL_TRIGGER, env);
-                dbus_send_signal_argv(SCANBD_DBUS_SIGNAL_TRIGGER, env);
-
-                // the action-script will use the device,
-                // so we have to release the device
-                //		scbtn_close(st->h);
-                //		st->h = NULL;
-
-                if (backend->scanbtnd_close((scanner_t*)st->dev) < 0) {
-                    slog(SLOG_ERROR, "unable to close scanner backend");
-                }
-
-                assert(st->triggered_option >= 0);
-                assert(st->opts[st->triggered_option].script);
-                assert(strlen(st->opts[st->triggered_option].script) > 0);
-
-                // need to copy the values because we leave the
-                // critical section
-                // int triggered_option = st->triggered_option;
-
-                char* script_abs = make_script_path_abs(st->opts[st->triggered_option].script);
-                assert(script_abs);
-
-                // leave the critical section
-                if (pthread_mutex_unlock(&st->mutex) < 0) {
-                    // if we can't unlock the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
-
-                if (strcmp(script_abs, SCANBD_NULL_STRING) != 0) {
-
-                    assert(timeout > 0);
-                    usleep(timeout * 1000); //ms
-
-                    pid_t cpid;
-                    if ((cpid = fork()) < 0) {
-                        slog(SLOG_ERROR, "Can't fork: %s", strerror(errno));
-                    }
-                    else if (cpid > 0) { // parent
-                        slog(SLOG_INFO, "waiting for child: %s", script_abs);
-                        int status;
-                        if (waitpid(cpid, &status, 0) < 0) {
-                            slog(SLOG_ERROR, "waitpid: %s", strerror(errno));
-                        }
-                        if (WIFEXITED(status)) {
-                            slog(SLOG_INFO, "child %s exited with status: %d",
-                                 script_abs, WEXITSTATUS(status));
-                        }
-                        if (WIFSIGNALED(status)) {
-                            slog(SLOG_INFO, "child %s signaled with signal: %d",
-                                 script_abs, WTERMSIG(status));
-                        }
-                    }
-                    else { // child
-                        slog(SLOG_DEBUG, "exec for %s", script_abs);
-                        if (execle(script_abs, script_abs, NULL, env) < 0) {
-                            slog(SLOG_ERROR, "execlp: %s", strerror(errno));
-                        }
-                        exit(EXIT_FAILURE); // not reached
-                    }
-                } // script_abs == SCANBD_NULL_STRING
-
-                assert(script_abs != NULL);
-                free(script_abs);
-                script_abs = NULL;
-
-                // free (last element is the sentinel!)
-                assert(env != NULL);
-                for(int e = 0; e < number_of_envs - 1; e += 1) {
-                    assert(env[e] != NULL);
-                    free(env[e]);
-                }
-                free(env);
-
-                // enter the critical section
-                if (pthread_mutex_lock(&st->mutex) < 0) {
-                    // if we can't get the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
-
-                st->triggered = false;
-                st->triggered_option = -1; // invalid
+                slog(SLOG_DEBUG, "value trigger: numerical");
+                st->triggered = true;
+                st->triggered_option = si;
                 // we need to trigger all waiting threads
                 if (pthread_cond_broadcast(&st->cv) < 0) {
                     slog(SLOG_ERROR, "pthread_cond_broadcats: this shouln't happen");
                 }
-
-                // leave the critical section
-                if (pthread_mutex_unlock(&st->mutex) < 0) {
-                    // if we can't release the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_unlock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
-                // sleep the timeout to settle devices, necessary?
-                usleep(timeout * 1000); //ms
-
-                // send out the debus signal
-                dbus_send_signal(SCANBD_DBUS_SIGNAL_SCAN_END, st->dev->product);
-
-                // enter the critical section
-                if (pthread_mutex_lock(&st->mutex) < 0) {
-                    // if we can't get the mutex, something is heavily wrong!
-                    slog(SLOG_ERROR, "pthread_mutex_lock: %s", strerror(errno));
-                    pthread_exit(NULL);
-                }
-
-                slog(SLOG_DEBUG, "reopen device %s", st->dev->product);
-
-                int ores = backend->scanbtnd_open((scanner_t*)st->dev);
-                if (ores != 0) {
-                    slog(SLOG_WARN, "scanbtnd_open failed, error code: %d", ores);
-                    slog(SLOG_WARN, "abandon polling of %s", st->dev->product);
-                    if (ores == -ENODEV) {
-                        slog(SLOG_WARN, "scanbtnd_open failed, no device -> canceling thread");
-                    }
-                    if (alarm(SCANBUTTOND_ALARM_TIMEOUT) > 0) {
-                        slog(SLOG_WARN, "alarm error, there was a pending alarm");
-                    }
-                    pthread_exit(NULL);
-                }
-            } // if triggered
+                scbtn_run_action(st, cfg_sec_global, timeout);
+            }
         } // foreach option
 
         // release the mutex
@@ -780,8 +695,9 @@ void* scbtn_poll(void* arg) {
             pthread_exit(NULL);
         }
 
-        // sleep the polling timeout
-        usleep(timeout * 1000); //ms
+        // sleep the polling interval, a pressed button switches to
+        // the burst mode
+        usleep(poll_interval_next(&interval, (pressed > 0)) * 1000); //ms
 
         // regain the mutex
         // because pthread_cleanup_push is a macro we can't use it here
@@ -0,0 +1,123 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// checks that the reaper thread calls the completion callback of every
+// child, even if more than LAUNCHER_MAX_DONE children terminate at once
+
+// usleep()
+#define _DEFAULT_SOURCE
+
+#include "common.h"
+#include "launcher.h"
+#include "slog.h"
+
+// more children than the reaper passes to the callbacks per pass
+#define NUM_CHILDREN (2 * LAUNCHER_MAX_DONE + 1)
+
+static pthread_mutex_t test_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t test_cv = PTHREAD_COND_INITIALIZER;
+static int num_done = 0;
+
+// the write end of the pipe the children wait on
+static int release_fd = -1;
+
+static void child_done(pid_t pid, int status, void* arg) {
+    (void)pid;
+    (void)status;
+    (void)arg;
+    pthread_mutex_lock(&test_mutex);
+    num_done += 1;
+    pthread_cond_broadcast(&test_cv);
+    pthread_mutex_unlock(&test_mutex);
+}
+
+// the first child: releases the others and keeps the reaper thread busy
+// until all of them are zombies, so the next pass reaps them at once
+static void first_done(pid_t pid, int status, void* arg) {
+    close(release_fd);
+    usleep(200 * 1000);
+    child_done(pid, status, arg);
+}
+
+static pid_t fork_child(int wait_fd) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        char c;
+        // EOF once the parent closed the write end
+        close(release_fd);
+        if (wait_fd >= 0) {
+            while(read(wait_fd, &c, 1) > 0) {
+                // wait for EOF
+            }
+        }
+        _exit(EXIT_SUCCESS);
+    }
+    return pid;
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    debug = true;
+    debug_level = SLOG_WARN;
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    release_fd = fds[PIPE_WRITE];
+
+    launcher_start();
+
+    pid_t pids[NUM_CHILDREN];
+    for(int i = 1; i < NUM_CHILDREN; i += 1) {
+        pids[i] = fork_child(fds[PIPE_READ]);
+        if (pids[i] < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+    }
+    close(fds[PIPE_READ]);
+    for(int i = 1; i < NUM_CHILDREN; i += 1) {
+        launcher_adopt(pids[i], child_done, NULL);
+    }
+    pids[0] = fork_child(-1);
+    launcher_adopt(pids[0], first_done, NULL);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 10;
+    pthread_mutex_lock(&test_mutex);
+    while(num_done < NUM_CHILDREN) {
+        if (pthread_cond_timedwait(&test_cv, &test_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    const int done = num_done;
+    pthread_mutex_unlock(&test_mutex);
+
+    launcher_stop();
+
+    printf("%d of %d completion callbacks called\n", done, NUM_CHILDREN);
+    return (done == NUM_CHILDREN) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+/*
+ * $Id$
+ *
+ *  scanbd - KMUX scanner button daemon
+ *
+ *  Copyright (C) 2008 - 2013  Wilhelm Meier (wilhelm.meier@fh-kl.de)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// checks the classification of the trigger patterns: the patterns matched
+// without the regex engine must match like the regex
+
+#include "common.h"
+#include "pattern.h"
+
+struct pattern_case {
+    const char* source;
+    enum pattern_kind kind;
+    const char* literal;         // the unescaped literal or NULL
+};
+
+static const struct pattern_case cases[] = {
+    {"",                  PATTERN_ANY,       NULL},
+    {".*",                PATTERN_ANY,       NULL},
+    {"^$",                PATTERN_EXACT,     ""},
+    {"^email$",           PATTERN_EXACT,     "email"},
+    {"^email.*",          PATTERN_PREFIX,    "email"},
+    {"email",             PATTERN_SUBSTRING, "email"},
+    {"^foo\\.bar$",       PATTERN_EXACT,     "foo.bar"},
+    {"^foo\\.bar",        PATTERN_PREFIX,    "foo.bar"},
+    {"a\\*b\\\\c",        PATTERN_SUBSTRING, "a*b\\c"},
+    {"^cost\\$",          PATTERN_PREFIX,    "cost$"},
+    {"^foo\\.*",          PATTERN_REGEX,     NULL},
+    {"^foo\\\\.*",        PATTERN_PREFIX,    "foo\\"},
+    {"^foo\\n$",          PATTERN_REGEX,     NULL},
+    {"foo$",              PATTERN_REGEX,     NULL},
+    {"^a|b$",             PATTERN_REGEX,     NULL},
+};
+
+static const char* const values[] = {
+    "", "email", "email2", "my email", "foo.bar", "fooxbar", "foo.bar.baz",
+    "foo", "foo..", "foo\\", "a*b\\c", "xa*b\\cx", "cost$", "cost", "a", "b",
+};
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    int failed = 0;
+    const int num_cases = sizeof(cases) / sizeof(cases[0]);
+    const int num_values = sizeof(values) / sizeof(values[0]);
+    for(int c = 0; c < num_cases; c += 1) {
+        regex_t reg;
+        if (regcomp(&reg, cases[c].source, REG_EXTENDED | REG_NOSUB) != 0) {
+            printf("can't compile %s\n", cases[c].source);
+            failed += 1;
+            continue;
+        }
+        pattern_t pat;
+        pattern_compile(&pat, cases[c].source, &reg);
+        if (pat.kind != cases[c].kind) {
+            printf("%s: kind %d, expected %d\n", cases[c].source, pat.kind, cases[c].kind);
+            failed += 1;
+        }
+        else if ((cases[c].literal != NULL) &&
+                 ((pat.literal == NULL) || (strcmp(pat.literal, cases[c].literal) != 0))) {
+            printf("%s: literal %s, expected %s\n", cases[c].source,
+                   pat.literal ? pat.literal : "(null)", cases[c].literal);
+            failed += 1;
+        }
+        for(int v = 0; v < num_values; v += 1) {
+            bool expected = (regexec(&reg, values[v], 0, NULL, 0) == 0);
+            if (pattern_match(&pat, values[v], strlen(values[v])) != expected) {
+                printf("%s: \"%s\" %s\n", cases[c].source, values[v],
+                       expected ? "not matched" : "matched");
+                failed += 1;
+            }
+        }
+        pattern_free(&pat);
+        regfree(&reg);
+    }
+    printf("%d failed checks\n", failed);
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -33,6 +33,261 @@ static pthread_t udev_tid = 0;
 static struct udev* udev = NULL;
 static struct udev_monitor* mon = NULL;
 
+// the usb ids we react on, an empty list accepts all usb devices
+struct udev_usb_id {
+    int vendor;
+    int product; // -1: all products of the vendor
+};
+// the allow-list and the debounce window of the config, reread on
+// reload by the main thread (guarded by udev_cfg_mutex)
+static pthread_mutex_t udev_cfg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct udev_usb_id* usb_ids = NULL;
+static int num_usb_ids = 0;
+static int udev_debounce = 0;
+
+// reads the vendor:product allow-list from the config, entries are
+// hex ids like "04a9:1909", "04a9:*" or "04a9"
+// the list is empty by default (all usb devices): neither the SANE API
+// nor the scanbuttond backend interface exposes the supported ids
+// returns the list (NULL: all usb devices), its size in *num
+static struct udev_usb_id* udev_read_usb_ids(cfg_t* cfg_sec_global, int* num) {
+    struct udev_usb_id* ids = NULL;
+    *num = 0;
+
+    const int n = cfg_size(cfg_sec_global, C_USB_IDS);
+    if (n <= 0) {
+        slog(SLOG_DEBUG, "no usb ids configured, accepting all usb devices");
+        return NULL;
+    }
+    ids = calloc(n, sizeof(struct udev_usb_id));
+    if (!ids) {
+        slog(SLOG_ERROR, "Can't allocate memory for usb ids");
+        return NULL;
+    }
+    for(int i = 0; i < n; i += 1) {
+        const char* id = cfg_getnstr(cfg_sec_global, C_USB_IDS, i);
+        struct udev_usb_id* ui = &ids[*num];
+        char* end = NULL;
+        long vendor = strtol(id, &end, 16);
+        bool valid = (end != id) && (vendor >= 0) && (vendor <= 0xffff);
+        if (valid && (*end == '\0' || strcmp(end, ":*") == 0)) {
+            ui->product = -1;
+        }
+        else if (valid && (*end == ':')) {
+            const char* p = end + 1;
+            long product = strtol(p, &end, 16);
+            valid = (end != p) && (*end == '\0') && (product >= 0) && (product <= 0xffff);
+            ui->product = product;
+        }
+        else {
+            valid = false;
+        }
+        if (!valid) {
+            slog(SLOG_WARN, "invalid usb id: %s", id);
+            continue;
+        }
+        ui->vendor = vendor;
+        slog(SLOG_DEBUG, "accepting usb id: %s", id);
+        *num += 1;
+    }
+    if (*num == 0) {
+        slog(SLOG_WARN, "no valid usb ids, accepting all usb devices");
+        free(ids);
+        ids = NULL;
+    }
+    return ids;
+}
+
+// reads the allow-list and the debounce window from the running config
+// this function can only be used by the thread installing the config
+static void udev_read_config(void) {
+    cfg_t* cfg_sec_global = cfg_getsec(cfg, C_GLOBAL);
+    assert(cfg_sec_global);
+
+    int num = 0;
+    struct udev_usb_id* ids = udev_read_usb_ids(cfg_sec_global, &num);
+    int debounce = cfg_getint(cfg_sec_global, C_HOTPLUG_DEBOUNCE);
+    if (debounce < 0) {
+        debounce = 0;
+    }
+
+    pthread_mutex_lock(&udev_cfg_mutex);
+    struct udev_usb_id* old_ids = usb_ids;
+    usb_ids = ids;
+    num_usb_ids = num;
+    udev_debounce = debounce;
+    pthread_mutex_unlock(&udev_cfg_mutex);
+    free(old_ids);
+}
+
+static bool udev_usb_id_accepted(int vendor, int product) {
+    bool accepted = false;
+    pthread_mutex_lock(&udev_cfg_mutex);
+    if (!usb_ids) {
+        accepted = true;
+    }
+    for(int i = 0; i < num_usb_ids; i += 1) {
+        if ((usb_ids[i].vendor == vendor) &&
+                ((usb_ids[i].product < 0) || (usb_ids[i].product == product))) {
+            accepted = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&udev_cfg_mutex);
+    return accepted;
+}
+
+static int udev_get_debounce(void) {
+    pthread_mutex_lock(&udev_cfg_mutex);
+    int debounce = udev_debounce;
+    pthread_mutex_unlock(&udev_cfg_mutex);
+    return debounce;
+}
+
+// reads an integer property of the uevent, falls back to the sysfs
+// attribute which is only available as long as the device exists
+static int udev_device_get_int(struct udev_device* device, const char* property,
+                               const char* sysattr, int base) {
+    const char* s = udev_device_get_property_value(device, property);
+    if (!s && sysattr) {
+        s = udev_device_get_sysattr_value(device, sysattr);
+    }
+    if (!s) {
+        return -1;
+    }
+    char* end = NULL;
+    long v = strtol(s, &end, base);
+    if (end == s) {
+        return -1;
+    }
+    return (int)v;
+}
+
+// fills in the identity of the usb device of the uevent, the strings
+// belong to the udev device
+static void udev_get_hotplug_device(struct udev_device* device,
+                                    hotplug_device_t* hd) {
+    hd->syspath = udev_device_get_syspath(device);
+    hd->busnum = udev_device_get_int(device, "BUSNUM", "busnum", 10);
+    hd->devnum = udev_device_get_int(device, "DEVNUM", "devnum", 10);
+    hd->vendor = -1;
+    hd->product = -1;
+
+    // PRODUCT is set by the kernel for add and remove: vendor/product/bcd
+    // in hex without leading zeros
+    unsigned int vendor = 0;
+    unsigned int product = 0;
+    const char* s = udev_device_get_property_value(device, "PRODUCT");
+    if (s && (sscanf(s, "%x/%x", &vendor, &product) == 2)) {
+        hd->vendor = vendor;
+        hd->product = product;
+    }
+    else {
+        hd->vendor = udev_device_get_int(device, "ID_VENDOR_ID", "idVendor", 16);
+        hd->product = udev_device_get_int(device, "ID_MODEL_ID", "idProduct", 16);
+    }
+}
+
+// hotplug events collected during the debounce window
+struct udev_event {
+    hotplug_device_t hd; // syspath is a copy
+    bool added;
+};
+static struct udev_event* udev_events = NULL;
+static int num_udev_events = 0;
+static int udev_events_capacity = 0;
+
+static long udev_now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+static void udev_events_clear(void) {
+    for(int i = 0; i < num_udev_events; i += 1) {
+        free((void*)udev_events[i].hd.syspath);
+    }
+    num_udev_events = 0;
+}
+
+static bool udev_same_device(const hotplug_device_t* a, const hotplug_device_t* b) {
+    return (a->busnum == b->busnum) && (a->devnum == b->devnum) &&
+            (a->syspath && b->syspath && (strcmp(a->syspath, b->syspath) == 0));
+}
+
+// adds an event to the batch, collapsing it with the pending events of
+// the same device: a repeated event is dropped and a device added and
+// removed again within the window is forgotten
+static void udev_events_add(const hotplug_device_t* hd, bool added) {
+    for(int i = num_udev_events - 1; i >= 0; i -= 1) {
+        struct udev_event* ev = &udev_events[i];
+        if (!udev_same_device(&ev->hd, hd)) {
+            continue;
+        }
+        if (ev->added == added) {
+            slog(SLOG_DEBUG, "coalescing repeated event of %s", hd->syspath);
+            return;
+        }
+        if (ev->added && !added) {
+            slog(SLOG_DEBUG, "%s came and went, dropping its events", hd->syspath);
+            free((void*)ev->hd.syspath);
+            memmove(ev, ev + 1, (num_udev_events - i - 1) * sizeof(struct udev_event));
+            num_udev_events -= 1;
+            return;
+        }
+        break;
+    }
+    if (num_udev_events >= udev_events_capacity) {
+        int capacity = udev_events_capacity > 0 ? 2 * udev_events_capacity : 8;
+        struct udev_event* events = realloc(udev_events, capacity * sizeof(struct udev_event));
+        if (!events) {
+            slog(SLOG_ERROR, "Can't allocate memory for udev events");
+            return;
+        }
+        udev_events = events;
+        udev_events_capacity = capacity;
+    }
+    struct udev_event* ev = &udev_events[num_udev_events];
+    ev->hd = *hd;
+    ev->hd.syspath = hd->syspath ? strdup(hd->syspath) : NULL;
+    ev->added = added;
+    num_udev_events += 1;
+}
+
+// hands the collected events over as one batch
+static void udev_events_flush(void) {
+    if (num_udev_events == 0) {
+        return;
+    }
+    hotplug_device_t* added = calloc(num_udev_events, sizeof(hotplug_device_t));
+    hotplug_device_t* removed = calloc(num_udev_events, sizeof(hotplug_device_t));
+    if (added && removed) {
+        int num_added = 0;
+        int num_removed = 0;
+        for(int i = 0; i < num_udev_events; i += 1) {
+            if (udev_events[i].added) {
+                added[num_added++] = udev_events[i].hd;
+            }
+            else {
+                removed[num_removed++] = udev_events[i].hd;
+            }
+        }
+        slog(SLOG_INFO, "udev: %d devices added, %d devices removed",
+             num_added, num_removed);
+        // don't get cancelled while reconfiguring
+        int state;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        control_hotplug(added, num_added, removed, num_removed);
+        pthread_setcancelstate(state, NULL);
+    }
+    else {
+        slog(SLOG_ERROR, "Can't allocate memory for udev events");
+    }
+    free(added);
+    free(removed);
+    udev_events_clear();
+}
+
 static int udev_init() {
     slog(SLOG_DEBUG, "udev init");
     udev = udev_new();
@@ -47,6 +302,14 @@ static int udev_init() {
         return -1;
     }
 
+    // let the kernel drop all events except those of whole usb devices,
+    // interfaces, disks, input devices ... never wake us up
+    if (udev_monitor_filter_add_match_subsystem_devtype(mon, UDEV_SUBSYSTEM,
+                                                        UDEV_DEVICE_TYPE) < 0) {
+        slog(SLOG_WARN, "Can't install udev filter, filtering in userspace");
+    }
+    udev_read_config();
+
     if (udev_monitor_enable_receiving(mon) < 0) {
         slog(SLOG_DEBUG, "Can't enable udev receiving");
         return -1;
@@ -90,6 +353,15 @@ static int udev_close() {
         udev_unref(udev);
     }
     udev = NULL;
+    udev_events_clear();
+    free(udev_events);
+    udev_events = NULL;
+    udev_events_capacity = 0;
+    pthread_mutex_lock(&udev_cfg_mutex);
+    free(usb_ids);
+    usb_ids = NULL;
+    num_usb_ids = 0;
+    pthread_mutex_unlock(&udev_cfg_mutex);
     return 0;
 }
 
@@ -111,9 +383,38 @@ static void* udev_thread(void* arg)
     sigfillset(&mask);
     pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
+    // the end of the debounce window, extended with every event, but
+    // a storm never delays the reconciliation for more than
+    // UDEV_DEBOUNCE_MAX_WINDOWS windows
+    long deadline = 0;
+    long max_deadline = 0;
+
     while(true) {
         assert(mon);
 
+        if (num_udev_events > 0) {
+            long timeout = deadline - udev_now_ms();
+            if (timeout > 0) {
+                struct pollfd pfd;
+                pfd.fd = udev_monitor_get_fd(mon);
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, timeout) < 0) {
+                    if (errno != EINTR) {
+                        slog(SLOG_WARN, "poll: %s", strerror(errno));
+                    }
+                    continue;
+                }
+                if (!(pfd.revents & POLLIN)) {
+                    continue; // check the deadline
+                }
+            }
+            else {
+                udev_events_flush();
+                continue;
+            }
+        }
+
         struct udev_device* device = 0;
         pthread_cleanup_push(udev_thread_cleanup, &device);
         device = udev_monitor_receive_device(mon);
@@ -126,20 +427,35 @@ static void* udev_thread(void* arg)
         }
         else {
             assert(device);
-            slog(SLOG_INFO, "new devive");
+            slog(SLOG_DEBUG, "new device");
             const char* s = 0;
             s = udev_device_get_devtype(device);
             if (s) {
-                slog(SLOG_INFO, "udev device type: %s", s);
+                slog(SLOG_DEBUG, "udev device type: %s", s);
                 if (strcmp(s, UDEV_DEVICE_TYPE) == 0) {
+                    hotplug_device_t hd;
+                    udev_get_hotplug_device(device, &hd);
                     s = udev_device_get_action(device);
-                    if (s) {
-                        slog(SLOG_INFO, "udev device action: %s", s);
-                        if (strcmp(s, UDEV_ADD_ACTION) == 0) {
-                            dbus_signal_device_added();
-                        }
-                        if (strcmp(s, UDEV_REMOVE_ACTION) == 0) {
-                            dbus_signal_device_removed();
+                    if (!udev_usb_id_accepted(hd.vendor, hd.product)) {
+                        slog(SLOG_DEBUG, "ignoring usb device %04x:%04x",
+                             hd.vendor, hd.product);
+                    }
+                    else if (s) {
+                        slog(SLOG_INFO, "udev device action: %s, usb device %04x:%04x at %03d:%03d (%s)",
+                             s, hd.vendor, hd.product, hd.busnum, hd.devnum,
+                             hd.syspath ? hd.syspath : "");
+                        bool add = (strcmp(s, UDEV_ADD_ACTION) == 0);
+                        if (add || (strcmp(s, UDEV_REMOVE_ACTION) == 0)) {
+                            const long now = udev_now_ms();
+                            const int debounce = udev_get_debounce();
+                            if (num_udev_events == 0) {
+                                max_deadline = now + UDEV_DEBOUNCE_MAX_WINDOWS * debounce;
+                            }
+                            udev_events_add(&hd, add);
+                            deadline = now + debounce;
+                            if (deadline > max_deadline) {
+                                deadline = max_deadline;
+                            }
                         }
                     }
                 }
@@ -169,6 +485,16 @@ void udev_start_udev_thread(void)
     }
 }
 
+// applies the allow-list and the debounce window of a reloaded config
+// to the running udev thread
+void udev_reload_config(void) {
+    if (udev_tid == 0) {
+        return;
+    }
+    slog(SLOG_DEBUG, "reread the udev config");
+    udev_read_config();
+}
+
 void udev_stop_udev_thread(void) {
     slog(SLOG_DEBUG, "stop udev thread");
     if (udev_tid == 0) {
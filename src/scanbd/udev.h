@@ -29,11 +29,14 @@
 # include <libudev.h>
 # define UDEV_ADD_ACTION "add"
 # define UDEV_REMOVE_ACTION "remove"
+# define UDEV_SUBSYSTEM "usb"
 # define UDEV_DEVICE_TYPE "usb_device"
 # define UDEV_SLEEP_IF_NO_DEVICE 1000
+# define UDEV_DEBOUNCE_MAX_WINDOWS 5
 
 extern void udev_start_udev_thread(void);
 extern void udev_stop_udev_thread(void);
+extern void udev_reload_config(void);
 
 #endif
 #endif // UDEV_H
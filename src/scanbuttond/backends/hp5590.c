@@ -32,6 +32,9 @@ static char* backend_name = "HP5590 USB";
 
 #define NUM_SUPPORTED_USB_DEVICES 4
 
+/* The size of an interrupt report, the reports are only counted */
+#define HP5590_INTERRUPT_SIZE  8
+
 static int supported_usb_devices[NUM_SUPPORTED_USB_DEVICES][3] =
 {
        /* vendor, product, num_buttons */
@@ -201,6 +204,12 @@ scanbtnd_open (scanner_t* scanner)
                        if (libusb_get_changed_device_count () != 0)
                                return -ENODEV;
                        result = libusb_open ((libusb_device_t*) scanner->internal_dev_ptr);
+                       /* The interrupt reports tell when to read the
+                        * button status, without a report it isn't polled
+                        */
+                       if (result == 0)
+                               libusb_interrupt_start ((libusb_device_t*) scanner->internal_dev_ptr,
+                                                       HP5590_INTERRUPT_SIZE, NULL, NULL);
                        break;
        }
 
@@ -530,44 +539,85 @@ hp5590_cmd (scanner_t *scanner, unsigned int flags,
        return ret;
 }
 
+/* Reads the button status register, the flags are kept until it is read */
+static int
+hp5590_read_button_status (scanner_t* scanner, u_int16_t* button_status)
+{
+       int                     ret;
+
+       /* The USB-in-USB sequence isn't interleaved with the interrupt read */
+       libusb_lock ((libusb_device_t *) scanner->internal_dev_ptr);
+       ret = hp5590_cmd (scanner, CMD_IN | CMD_VERIFY,
+                                         CMD_BUTTON_STATUS,
+                                         (unsigned char *) button_status,
+                                         sizeof (*button_status), CORE_NONE);
+       libusb_unlock ((libusb_device_t *) scanner->internal_dev_ptr);
+       if (ret != 0) {
+               hp5590_flush (scanner);
+               return ret;
+       }
+
+       /* Network order */
+       *button_status = ntohs (*button_status);
+       return 0;
+}
+
+/* The buttons in the order of their numbers */
+static const u_int16_t hp5590_button_flags[] = {
+       BUTTON_FLAG_SCAN,
+       BUTTON_FLAG_COLLECT,
+       BUTTON_FLAG_FILE,
+       BUTTON_FLAG_EMAIL,
+       BUTTON_FLAG_COPY
+};
+
 int
 scanbtnd_get_button(scanner_t* scanner)
 {
        int             button = 0;
+       int             i;
        u_int16_t       button_status;
-       int                     ret;
 
        if (!scanner->is_open)
                return -EINVAL;
        
-       ret = hp5590_cmd (scanner, CMD_IN | CMD_VERIFY,
-                                         CMD_BUTTON_STATUS,
-                                         (unsigned char *) &button_status,
-                                         sizeof (button_status), CORE_NONE);
-       if (ret != 0) {
-               hp5590_flush (scanner);
+       if (hp5590_read_button_status (scanner, &button_status) != 0)
                return 0;
+
+       for (i = 0; i < (int) (sizeof (hp5590_button_flags) / sizeof (u_int16_t)); i++) {
+               if (button_status & hp5590_button_flags[i])
+                       button = i + 1;
        }
 
-       /* Network order */
-       button_status = ntohs (button_status);
+       return button;
+}
 
-       if (button_status & BUTTON_FLAG_SCAN)
-               button = 1;
+int
+scanbtnd_get_button_events(scanner_t* scanner, int* buttons, int max)
+{
+       int             num = 0;
+       int             i;
+       u_int16_t       button_status;
 
-       if (button_status & BUTTON_FLAG_COLLECT)
-               button = 2;
+       if (!scanner->is_open)
+               return -EINVAL;
 
-       if (button_status & BUTTON_FLAG_FILE)
-               button = 3;
+       /* Without an interrupt report since the last call no button was
+        * pressed. Scanners without an interrupt endpoint are polled.
+        */
+       if (libusb_interrupt_take ((libusb_device_t *) scanner->internal_dev_ptr) == 0)
+               return 0;
 
-       if (button_status & BUTTON_FLAG_EMAIL)
-               button = 4;
+       if (hp5590_read_button_status (scanner, &button_status) != 0)
+               return 0;
 
-       if (button_status & BUTTON_FLAG_COPY)
-               button = 5;
+       /* All latched buttons, not only the last one */
+       for (i = 0; i < (int) (sizeof (hp5590_button_flags) / sizeof (u_int16_t)); i++) {
+               if ((button_status & hp5590_button_flags[i]) && (num < max))
+                       buttons[num++] = i + 1;
+       }
 
-       return button;
+       return num;
 }
 
 const char*
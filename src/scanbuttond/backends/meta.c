@@ -273,6 +273,15 @@ int scanbtnd_get_button(scanner_t* scanner)
 }
 
 
+int scanbtnd_get_button_events(scanner_t* scanner, int* buttons, int max)
+{
+	backend_t* backend = meta_lookup_backend(scanner);
+	if (backend == NULL) return 0;
+	if (backend->scanbtnd_get_button_events == NULL) return -ENOSYS;
+	return backend->scanbtnd_get_button_events(scanner, buttons, max);
+}
+
+
 const char* scanbtnd_get_sane_device_descriptor(scanner_t* scanner)
 {
 	backend_t* backend = meta_lookup_backend(scanner);
@@ -98,6 +98,25 @@ int scanbtnd_close(scanner_t* scanner);
  */
 int scanbtnd_get_button(scanner_t* scanner);
 
+/**
+ * Queries the buttons pressed since the last query.
+ * This function is optional: a backend provides it if the scanner keeps the
+ * presses in a status register until it is read, so presses shorter than the
+ * polling interval aren't lost. Each pressed button is reported once, even if
+ * it was pressed several times, and the buttons are in no particular order.
+ * A scanner with an interrupt endpoint is only queried after a report, see
+ * libusb_interrupt_start().
+ * \param scanner the scanner device
+ * \param buttons the numbers of the pressed buttons
+ * \param max the size of buttons
+ * \return the number of stored buttons (0 if no button was pressed), or <0 if
+ * there was an error.
+ * \retval -EINVAL if the scanner device has not been opened before
+ * \retval -ENOSYS if the scanner doesn't latch its buttons, use
+ *         scanbtnd_get_button() instead
+ */
+int scanbtnd_get_button_events(scanner_t* scanner, int* buttons, int max);
+
 /**
  * Gets the SANE device name of this scanner.
  * The returned string should look like "epson:libusb:003:017".
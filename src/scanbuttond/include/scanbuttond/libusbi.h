@@ -20,6 +20,7 @@
 #define __LIBUSBI_H_INCLUDED
 
 #include <sys/types.h>
+#include <pthread.h>
 
 #ifdef HAVE_LINUX_LIMITS_H
 #include <linux/limits.h>
@@ -31,6 +32,8 @@
 struct libusb_device;
 typedef struct libusb_device libusb_device_t;
 
+struct libusb_interrupt;
+
 struct libusb_device {
 	int vendorID;
 	int productID;
@@ -40,6 +43,10 @@ struct libusb_device {
 	int interface;
 	int out_endpoint;
 	int in_endpoint;
+	int interrupt_endpoint; // 0 if the device has no interrupt-in endpoint
+	struct libusb_interrupt* interrupt; // set by libusb_interrupt_start(...)
+	pthread_mutex_t lock; // serializes the transfers on handle, see libusb_lock(...)
+	int lock_waiters;
 	libusb_device_t* next;
 };
 
@@ -76,6 +83,38 @@ void libusb_flush(libusb_device_t* device);
 int libusb_control_msg(libusb_device_t* device, int requesttype,
 					   int request, int value, int index, void* bytes, int size);
 
+// libusb-0.1 isn't thread-safe: the transfers on a handle are serialized,
+// the queued interrupt read waits while a transfer is done. A backend
+// holds the lock across a sequence of transfers that must not be
+// interleaved with the interrupt read. The lock is recursive.
+void libusb_lock(libusb_device_t* device);
+
+void libusb_unlock(libusb_device_t* device);
+
+// called by the reader thread of libusb_interrupt_start(...) for each
+// report of the interrupt endpoint, without the lock of the device
+typedef void (*libusb_interrupt_cb)(libusb_device_t* device,
+									const unsigned char* data, int size, void* arg);
+
+// keeps a read of the interrupt endpoint of the opened device queued, the
+// button reports are passed to the callback (may be NULL) and counted
+// without polling the scanner.
+// returns 0 on success, -ENOSYS if the device has no interrupt endpoint,
+// -ENODEV if the device is not open, -EBUSY if a read is queued already
+// or -EINVAL if size is out of range
+int libusb_interrupt_start(libusb_device_t* device, int size,
+						   libusb_interrupt_cb callback, void* arg);
+
+// stops the queued read, the callback is not called afterwards.
+// libusb_close(...) calls this automatically.
+void libusb_interrupt_stop(libusb_device_t* device);
+
+// returns the number of reports since the last call and resets it, or
+// -ENOSYS if no read is queued and -ENODEV if the read stopped on an
+// error. The state of the device before libusb_interrupt_start(...) is
+// unknown, so the first call counts one report more.
+int libusb_interrupt_take(libusb_device_t* device);
+
 void libusb_exit(libusb_handle_t* handle);
 
 #endif
@@ -16,11 +16,15 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
+// usleep()
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #ifdef HAVE_LINUX_LIMITS_H
@@ -32,6 +36,19 @@
 #include "scanbuttond/libusbi.h"
 
 #define TIMEOUT	   	10 * 1000	/* 10 seconds */
+#define INTERRUPT_TIMEOUT	100	/* the max. delay of a transfer by a queued read */
+#define INTERRUPT_MAX_SIZE	64	/* max. packet size of a full-speed device */
+
+// the queued read of an interrupt endpoint
+struct libusb_interrupt {
+	pthread_t thread;
+	int stop;
+	int failed;
+	int reports;
+	int size;
+	libusb_interrupt_cb callback;
+	void* arg;
+};
 
 int invocation_count = 0;
 
@@ -142,6 +159,29 @@ static int libusb_search_out_endpoint(struct usb_device* device)
 }
 
 
+// the scanners reporting their buttons asynchronously do so on an
+// interrupt-in endpoint next to the bulk endpoints
+static int libusb_search_interrupt_endpoint(struct usb_device* device)
+{
+	struct usb_interface_descriptor *interface;
+	interface = &device->config[0].interface->altsetting[0];
+
+	int num;
+	for (num = 0; num < interface->bNumEndpoints; num++) {
+		struct usb_endpoint_descriptor *endpoint;
+		int direction, transfer_type;
+
+		endpoint = &interface->endpoint[num];
+		direction = endpoint->bEndpointAddress & USB_ENDPOINT_DIR_MASK;
+		transfer_type = endpoint->bmAttributes & USB_ENDPOINT_TYPE_MASK;
+
+		if (transfer_type == USB_ENDPOINT_TYPE_INTERRUPT && direction)
+			return endpoint->bEndpointAddress;
+	}
+	return 0;
+}
+
+
 static void libusb_attach_device(struct usb_device* device, libusb_handle_t* handle)
 {
 	libusb_device_t* libusb_device = (libusb_device_t*)malloc(sizeof(libusb_device_t));
@@ -174,6 +214,14 @@ static void libusb_attach_device(struct usb_device* device, libusb_handle_t* han
 		free(libusb_device);
 		return;
 	}
+	libusb_device->interrupt_endpoint = libusb_search_interrupt_endpoint(device);
+	libusb_device->interrupt = NULL;
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&libusb_device->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	libusb_device->lock_waiters = 0;
 	libusb_device->next = handle->devices;
 	handle->devices = libusb_device;
 }
@@ -184,6 +232,8 @@ static void libusb_detach_devices(libusb_handle_t* handle)
 	libusb_device_t* next;
 	while (handle->devices != NULL) {
 		next = handle->devices->next;
+		libusb_interrupt_stop(handle->devices);
+		pthread_mutex_destroy(&handle->devices->lock);
 		free(handle->devices->location);
 		free(handle->devices);
 		handle->devices = next;
@@ -274,6 +324,7 @@ int libusb_open(libusb_device_t* device)
 int libusb_close(libusb_device_t* device)
 {
 	int result;
+	libusb_interrupt_stop(device);
 	result = usb_release_interface(device->handle, device->interface);
 	if (result < 0) {
 		syslog(LOG_ERR, "libusbi: could not release interface, error code=%d, device=%s",
@@ -290,26 +341,44 @@ int libusb_close(libusb_device_t* device)
 }
 
 
+void libusb_lock(libusb_device_t* device)
+{
+	__atomic_add_fetch(&device->lock_waiters, 1, __ATOMIC_ACQ_REL);
+	pthread_mutex_lock(&device->lock);
+	__atomic_sub_fetch(&device->lock_waiters, 1, __ATOMIC_ACQ_REL);
+}
+
+
+void libusb_unlock(libusb_device_t* device)
+{
+	pthread_mutex_unlock(&device->lock);
+}
+
+
 int libusb_read(libusb_device_t* device, void* buffer, int bytecount)
 {
+	libusb_lock(device);
 	int num_bytes = usb_bulk_read(device->handle, device->in_endpoint,
 								  buffer, bytecount, TIMEOUT);
 	if (num_bytes<0) {
 		usb_clear_halt(device->handle, device->in_endpoint);
-		return 0;
+		num_bytes = 0;
 	}
+	libusb_unlock(device);
 	return num_bytes;
 }
 
 
 int libusb_write(libusb_device_t* device, void* buffer, int bytecount)
 {
+	libusb_lock(device);
 	int num_bytes = usb_bulk_write(device->handle, device->out_endpoint,
 								   buffer, bytecount, TIMEOUT);
 	if (num_bytes<0) {
 		usb_clear_halt(device->handle, device->in_endpoint);
-		return 0;
+		num_bytes = 0;
 	}
+	libusb_unlock(device);
 	return num_bytes;
 }
 
@@ -317,15 +386,19 @@ int libusb_write(libusb_device_t* device, void* buffer, int bytecount)
 void libusb_flush(libusb_device_t* device)
 {
 	char buffer[16];
+	libusb_lock(device);
 	while (usb_bulk_read(device->handle, device->in_endpoint, buffer, 16, 500) > 0) {};
+	libusb_unlock(device);
 }
 
 
 int libusb_control_msg(libusb_device_t* device, int requesttype, int request,
 					   int value, int index, void* bytes, int size)
 {
+	libusb_lock(device);
 	int num_bytes = usb_control_msg(device->handle, requesttype, request, value,
 									index, bytes, size, TIMEOUT);
+	libusb_unlock(device);
 	if (num_bytes<0) {
 		// Doesn't seem to be needed... (bs, Jun 07 2005)
 		// usb_clear_halt(device->handle, device->in_endpoint);
@@ -335,6 +408,107 @@ int libusb_control_msg(libusb_device_t* device, int requesttype, int request,
 }
 
 
+// the reader thread: the read is queued again as soon as it completes,
+// it times out to let the other transfers on the handle through and to
+// notice libusb_interrupt_stop(...)
+static void* libusb_interrupt_run(void* arg)
+{
+	libusb_device_t* device = (libusb_device_t*)arg;
+	struct libusb_interrupt* interrupt = device->interrupt;
+	char buffer[INTERRUPT_MAX_SIZE];
+
+	while (!__atomic_load_n(&interrupt->stop, __ATOMIC_ACQUIRE)) {
+		// the mutex isn't fair: step aside for a waiting transfer
+		if (__atomic_load_n(&device->lock_waiters, __ATOMIC_ACQUIRE) > 0) {
+			usleep(1000);
+			continue;
+		}
+		pthread_mutex_lock(&device->lock);
+		int num_bytes = usb_interrupt_read(device->handle, device->interrupt_endpoint,
+										   buffer, interrupt->size, INTERRUPT_TIMEOUT);
+		if (num_bytes < 0 && num_bytes != -ETIMEDOUT && num_bytes != -ENODEV)
+			usb_clear_halt(device->handle, device->interrupt_endpoint);
+		pthread_mutex_unlock(&device->lock);
+
+		if (num_bytes > 0) {
+			__atomic_add_fetch(&interrupt->reports, 1, __ATOMIC_ACQ_REL);
+			if (interrupt->callback)
+				interrupt->callback(device, (const unsigned char*)buffer, num_bytes,
+									interrupt->arg);
+		} else if (num_bytes == -ENODEV) {
+			syslog(LOG_ERR, "libusbi: device %s is gone, interrupt read stopped",
+				   device->location);
+			__atomic_store_n(&interrupt->failed, 1, __ATOMIC_RELEASE);
+			break;
+		} else if (num_bytes < 0 && num_bytes != -ETIMEDOUT) {
+			// don't spin on a stalled endpoint
+			usleep(INTERRUPT_TIMEOUT * 1000);
+		}
+	}
+	return NULL;
+}
+
+
+int libusb_interrupt_start(libusb_device_t* device, int size,
+						   libusb_interrupt_cb callback, void* arg)
+{
+	if (!device || !device->handle)
+		return -ENODEV;
+	if (!device->interrupt_endpoint)
+		return -ENOSYS;
+	if (device->interrupt)
+		return -EBUSY;
+	if (size <= 0 || size > INTERRUPT_MAX_SIZE)
+		return -EINVAL;
+
+	struct libusb_interrupt* interrupt =
+		(struct libusb_interrupt*)malloc(sizeof(struct libusb_interrupt));
+	if (!interrupt)
+		return -ENOMEM;
+	interrupt->stop = 0;
+	interrupt->failed = 0;
+	interrupt->reports = 1;
+	interrupt->size = size;
+	interrupt->callback = callback;
+	interrupt->arg = arg;
+	device->interrupt = interrupt;
+
+	// the thread inherits the signal mask of the caller
+	int result = pthread_create(&interrupt->thread, NULL, libusb_interrupt_run, device);
+	if (result != 0) {
+		syslog(LOG_ERR, "libusbi: could not start interrupt read, error code=%d, device=%s",
+			   result, device->location);
+		device->interrupt = NULL;
+		free(interrupt);
+		return -result;
+	}
+	syslog(LOG_INFO, "libusbi: interrupt endpoint 0x%02x of device %s queued",
+		   device->interrupt_endpoint, device->location);
+	return 0;
+}
+
+
+void libusb_interrupt_stop(libusb_device_t* device)
+{
+	if (!device || !device->interrupt)
+		return;
+	__atomic_store_n(&device->interrupt->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(device->interrupt->thread, NULL);
+	free(device->interrupt);
+	device->interrupt = NULL;
+}
+
+
+int libusb_interrupt_take(libusb_device_t* device)
+{
+	if (!device || !device->interrupt)
+		return -ENOSYS;
+	if (__atomic_load_n(&device->interrupt->failed, __ATOMIC_ACQUIRE))
+		return -ENODEV;
+	return __atomic_exchange_n(&device->interrupt->reports, 0, __ATOMIC_ACQ_REL);
+}
+
+
 void libusb_exit(libusb_handle_t* handle)
 {
 	invocation_count--;